@@ -0,0 +1,286 @@
+/* Benchmark harness.
+ *
+ * Runs every benchmark program (the .lang files of a directory, or the files
+ * named on the command line) a number of times after a few warmup runs and
+ * reports median and 95th percentile wall time, allocations and peak RSS.
+ * Each run happens in a forked child, so a run starts from the same state and
+ * its peak RSS is its own; the time measured is parse + evaluation, without
+ * process startup.  Results can be written as JSON and compared against a
+ * JSON file saved earlier to flag regressions. */
+
+#define _DEFAULT_SOURCE
+#include "lexer.h"
+#include "parser.h"
+#include "interpreter.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef BENCH_DIR
+#define BENCH_DIR "benchmarks"
+#endif
+
+#define MAX_BENCHMARKS 256
+
+typedef struct {
+    char      path[1024];
+    char      name[128];
+    int       ok;
+    long long median_ns, p95_ns;
+    long long allocs;          /* allocations of one run */
+    long long peak_rss_kb;     /* largest over all runs */
+    long long baseline_ns;     /* median from the baseline file, 0 = none */
+} Bench;
+
+/* What a child reports back through its pipe. */
+typedef struct {
+    int       ok;
+    long long ns;
+    long long allocs;
+} RunResult;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return NULL; }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc((size_t)len + 1);
+    size_t n = fread(buf, 1, (size_t)len, f);
+    buf[n] = '\0';
+    fclose(f);
+    return buf;
+}
+
+/* Child side of one run: parse and evaluate src, charge it to a fresh
+   interpreter and report the result. */
+static RunResult run_in_child(const char *src) {
+    RunResult r = {0};
+    long long start = now_ns();
+
+    Interpreter interp;
+    interp_init(&interp);
+    Lexer lex;
+    lexer_init(&lex, src);
+    Parser parser;
+    parser_init(&parser, &lex);
+    AstNode *program = parse_program(&parser);
+    token_free(&parser.cur);
+    if (parser.had_error) {
+        fprintf(stderr, "%s\n", parser.error_msg);
+        return r;
+    }
+    interp_run(&interp, program);
+    r.ns = now_ns() - start;
+    r.allocs = interp.mem.allocs;
+    r.ok = !interp.had_error;
+    if (interp.had_error) fprintf(stderr, "%s\n", interp.error_msg);
+    return r;
+}
+
+/* Run src once in a child process; *rss_kb receives its peak RSS. */
+static RunResult run_once(const char *src, long long *rss_kb) {
+    RunResult r = {0};
+    int fd[2];
+    if (pipe(fd) != 0) { perror("pipe"); return r; }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork"); close(fd[0]); close(fd[1]); return r; }
+    if (pid == 0) {
+        close(fd[0]);
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+        RunResult cr = run_in_child(src);
+        ssize_t w = write(fd[1], &cr, sizeof(cr));
+        _exit(w == (ssize_t)sizeof(cr) && cr.ok ? 0 : 1);
+    }
+    close(fd[1]);
+    ssize_t n = read(fd[0], &r, sizeof(r));
+    close(fd[0]);
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) { perror("wait4"); r.ok = 0; return r; }
+    if (n != (ssize_t)sizeof(r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) r.ok = 0;
+    *rss_kb = ru.ru_maxrss;
+    return r;
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_bench(Bench *b, int warmup, int runs) {
+    char *src = read_file(b->path);
+    if (!src) return;
+    long long *times = malloc(sizeof(long long) * (size_t)runs);
+    long long rss = 0;
+    b->ok = 1;
+    for (int i = 0; i < warmup + runs && b->ok; i++) {
+        RunResult r = run_once(src, &rss);
+        if (!r.ok) { b->ok = 0; break; }
+        if (rss > b->peak_rss_kb) b->peak_rss_kb = rss;
+        if (i < warmup) continue;
+        times[i - warmup] = r.ns;
+        b->allocs = r.allocs;
+    }
+    if (b->ok) {
+        qsort(times, (size_t)runs, sizeof(long long), cmp_ll);
+        b->median_ns = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+        int p = (95 * runs + 99) / 100;   /* nearest rank */
+        b->p95_ns = times[(p > 0 ? p : 1) - 1];
+    }
+    free(times);
+    free(src);
+}
+
+/* ------------------------------------------------------------------ discovery */
+
+static int add_bench(Bench *list, int n, const char *path) {
+    if (n >= MAX_BENCHMARKS) { fprintf(stderr, "too many benchmarks\n"); return n; }
+    Bench *b = &list[n];
+    memset(b, 0, sizeof(*b));
+    snprintf(b->path, sizeof(b->path), "%s", path);
+    const char *base = strrchr(path, '/');
+    snprintf(b->name, sizeof(b->name), "%s", base ? base + 1 : path);
+    char *dot = strrchr(b->name, '.');
+    if (dot) *dot = '\0';
+    return n + 1;
+}
+
+static int by_name(const void *a, const void *b) {
+    return strcmp(((const Bench *)a)->name, ((const Bench *)b)->name);
+}
+
+/* Add every .lang file of dir, or path itself if it is not a directory. */
+static int collect(Bench *list, int n, const char *path) {
+    DIR *d = opendir(path);
+    if (!d) return add_bench(list, n, path);
+    int first = n;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        size_t len = strlen(de->d_name);
+        if (len < 6 || strcmp(de->d_name + len - 5, ".lang") != 0) continue;
+        char full[1024];
+        snprintf(full, sizeof(full), "%s/%s", path, de->d_name);
+        n = add_bench(list, n, full);
+    }
+    closedir(d);
+    qsort(list + first, (size_t)(n - first), sizeof(Bench), by_name);
+    return n;
+}
+
+/* ------------------------------------------------------------------ output */
+
+static void write_json(const Bench *list, int n, int runs, FILE *f) {
+    fprintf(f, "{\"runs\": %d, \"benchmarks\": [", runs);
+    for (int i = 0; i < n; i++) {
+        const Bench *b = &list[i];
+        fprintf(f, "%s\n  {\"name\": \"%s\", \"ok\": %s, \"median_ns\": %lld, \"p95_ns\": %lld,"
+                   " \"allocs\": %lld, \"peak_rss_kb\": %lld}",
+                i ? "," : "", b->name, b->ok ? "true" : "false",
+                b->median_ns, b->p95_ns, b->allocs, b->peak_rss_kb);
+    }
+    fprintf(f, "\n]}\n");
+}
+
+/* Fill baseline_ns from a file written by --json. */
+static int load_baseline(Bench *list, int n, const char *path) {
+    char *text = read_file(path);
+    if (!text) return -1;
+    for (int i = 0; i < n; i++) {
+        char key[160];
+        snprintf(key, sizeof(key), "\"name\": \"%s\"", list[i].name);
+        const char *p = strstr(text, key);
+        const char *m = p ? strstr(p, "\"median_ns\":") : NULL;
+        if (m) list[i].baseline_ns = strtoll(m + 12, NULL, 10);
+    }
+    free(text);
+    return 0;
+}
+
+static void print_table(const Bench *list, int n, double threshold) {
+    printf("%-16s %12s %12s %12s %12s  %s\n", "benchmark", "median ms", "p95 ms", "allocs", "peak KiB", "vs baseline");
+    for (int i = 0; i < n; i++) {
+        const Bench *b = &list[i];
+        if (!b->ok) { printf("%-16s %12s\n", b->name, "FAILED"); continue; }
+        printf("%-16s %12.3f %12.3f %12lld %12lld", b->name,
+               b->median_ns / 1e6, b->p95_ns / 1e6, b->allocs, b->peak_rss_kb);
+        if (b->baseline_ns > 0) {
+            double change = 100.0 * (double)(b->median_ns - b->baseline_ns) / (double)b->baseline_ns;
+            printf("  %+6.1f%%%s", change, change > threshold ? "  REGRESSION" : "");
+        }
+        printf("\n");
+    }
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] [dir | file.lang ...]\n", prog);
+    printf("  -n N               Measured runs per benchmark (default 10)\n");
+    printf("  -w N               Warmup runs per benchmark (default 2)\n");
+    printf("  --json FILE        Write results as JSON\n");
+    printf("  --baseline FILE    Compare medians with a JSON file written earlier\n");
+    printf("  --threshold PCT    Slowdown counted as a regression (default 10)\n");
+    printf("With no paths, runs the .lang files in %s.\n", BENCH_DIR);
+}
+
+int main(int argc, char **argv) {
+    int runs = 10, warmup = 2;
+    double threshold = 10.0;
+    const char *json_path = NULL, *baseline_path = NULL;
+    static Bench list[MAX_BENCHMARKS];
+    int n = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        int has_arg = i + 1 < argc;
+        if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) { usage(argv[0]); return 0; }
+        else if (strcmp(a, "-n") == 0 && has_arg)          runs = atoi(argv[++i]);
+        else if (strcmp(a, "-w") == 0 && has_arg)          warmup = atoi(argv[++i]);
+        else if (strcmp(a, "--json") == 0 && has_arg)      json_path = argv[++i];
+        else if (strcmp(a, "--baseline") == 0 && has_arg)  baseline_path = argv[++i];
+        else if (strcmp(a, "--threshold") == 0 && has_arg) threshold = atof(argv[++i]);
+        else if (a[0] == '-') { fprintf(stderr, "unknown option: %s\n", a); return 2; }
+        else n = collect(list, n, a);
+    }
+    if (runs < 1 || warmup < 0) { fprintf(stderr, "invalid run count\n"); return 2; }
+    if (n == 0) n = collect(list, 0, BENCH_DIR);
+    if (n == 0) { fprintf(stderr, "no benchmarks found\n"); return 2; }
+
+    for (int i = 0; i < n; i++) run_bench(&list[i], warmup, runs);
+
+    if (baseline_path && load_baseline(list, n, baseline_path) != 0) return 2;
+    print_table(list, n, threshold);
+
+    if (json_path) {
+        FILE *f = fopen(json_path, "w");
+        if (!f) { perror(json_path); return 2; }
+        write_json(list, n, runs, f);
+        fclose(f);
+    }
+
+    int failed = 0, regressed = 0;
+    for (int i = 0; i < n; i++) {
+        if (!list[i].ok) failed++;
+        else if (list[i].baseline_ns > 0 &&
+                 100.0 * (double)(list[i].median_ns - list[i].baseline_ns) / (double)list[i].baseline_ns > threshold)
+            regressed++;
+    }
+    fflush(stdout);
+    if (failed)    fprintf(stderr, "%d benchmark(s) failed\n", failed);
+    if (regressed) fprintf(stderr, "%d benchmark(s) regressed more than %.1f%%\n", regressed, threshold);
+    return failed || regressed ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+/* Front-end benchmark.
+ *
+ * Measures the lexer and the parser in isolation on a synthetic program from
+ * gensrc.c (or on a file): lexer_next over the whole source, then
+ * parse_program, each repeated and timed by median.  Reports tokens/s,
+ * nodes/s, bytes/s and the bytes the parser allocates per source byte, both
+ * in total and still held by the finished tree.  --emit writes the generated
+ * program instead, for inspection or for running through the interpreter. */
+
+#define _POSIX_C_SOURCE 200809L
+#include "gensrc.h"
+#include "lexer.h"
+#include "parser.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    long long bytes, tokens, nodes;
+    long long lex_ns, parse_ns;        /* medians */
+    double    alloc_per_byte;          /* bytes allocated while parsing / source byte */
+    double    tree_per_byte;           /* bytes held by the finished tree / source byte */
+} FrontResult;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static long long median(long long *v, int n) {
+    qsort(v, (size_t)n, sizeof(long long), cmp_ll);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static long long count_nodes(const AstNode *n) {
+    if (!n) return 0;
+    long long c = 1;
+    for (int i = 0; i < n->child_count; i++) c += count_nodes(n->children[i]);
+    return c + count_nodes(n->type_ann) + count_nodes(n->init) + count_nodes(n->body) +
+           count_nodes(n->cond) + count_nodes(n->alt) + count_nodes(n->tmpl);
+}
+
+static long long lex_all(const char *src) {
+    Lexer lex;
+    lexer_init(&lex, src);
+    long long n = 0;
+    for (;;) {
+        Token t = lexer_next(&lex);
+        TokenType type = t.type;
+        token_free(&t);
+        if (type == TK_EOF || type == TK_ERROR) break;
+        n++;
+    }
+    return n;
+}
+
+static int measure(const char *src, size_t len, int runs, FrontResult *r) {
+    long long *t = malloc(sizeof(long long) * (size_t)runs);
+    memset(r, 0, sizeof(*r));
+    r->bytes = (long long)len;
+
+    for (int i = 0; i < runs; i++) {
+        long long start = now_ns();
+        r->tokens = lex_all(src);
+        t[i] = now_ns() - start;
+    }
+    r->lex_ns = median(t, runs);
+
+    int ok = 1;
+    for (int i = 0; i < runs && ok; i++) {
+        MemStats ms;
+        memset(&ms, 0, sizeof(ms));
+        MemStats *prev = mem_set_current(&ms);
+
+        long long start = now_ns();
+        Lexer lex;
+        lexer_init(&lex, src);
+        Parser parser;
+        parser_init(&parser, &lex);
+        AstNode *program = parse_program(&parser);
+        t[i] = now_ns() - start;
+
+        token_free(&parser.cur);
+        if (parser.had_error) {
+            fprintf(stderr, "parse error: %s\n", parser.error_msg);
+            ok = 0;
+        }
+        if (i == 0) {
+            r->nodes = count_nodes(program);
+            r->alloc_per_byte = (double)ms.total / (double)len;
+            r->tree_per_byte  = (double)ms.current / (double)len;
+        }
+        ast_free(program);
+        mem_set_current(prev);
+    }
+    if (ok) r->parse_ns = median(t, runs);
+    free(t);
+    return ok;
+}
+
+static char *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return NULL; }
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc((size_t)n + 1);
+    *len = fread(buf, 1, (size_t)n, f);
+    buf[*len] = '\0';
+    fclose(f);
+    return buf;
+}
+
+static double per_sec(long long count, long long ns) {
+    return ns > 0 ? (double)count * 1e9 / (double)ns : 0.0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] [file.lang]\n", prog);
+    printf("  --size N          Bytes of synthetic source to generate (default 1000000)\n");
+    printf("  --seed N          Generator seed (default 1)\n");
+    printf("  -n N              Timed runs of each phase (default 5)\n");
+    printf("  --emit FILE       Write the generated program and exit\n");
+    printf("  --json FILE       Write results as JSON\n");
+    printf("  --baseline FILE   Compare throughput with a JSON file written earlier\n");
+    printf("  --threshold PCT   Slowdown counted as a regression (default 10)\n");
+}
+
+/* Throughput of key in a JSON file written by --json, 0 if absent. */
+static double baseline_value(const char *text, const char *key) {
+    char k[64];
+    snprintf(k, sizeof(k), "\"%s\":", key);
+    const char *p = strstr(text, k);
+    return p ? atof(p + strlen(k)) : 0.0;
+}
+
+int main(int argc, char **argv) {
+    size_t size = 1000000;
+    unsigned seed = 1;
+    int runs = 5;
+    double threshold = 10.0;
+    const char *emit_path = NULL, *json_path = NULL, *baseline_path = NULL, *file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        int has_arg = i + 1 < argc;
+        if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) { usage(argv[0]); return 0; }
+        else if (strcmp(a, "--size") == 0 && has_arg)      size = (size_t)strtoull(argv[++i], NULL, 10);
+        else if (strcmp(a, "--seed") == 0 && has_arg)      seed = (unsigned)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(a, "-n") == 0 && has_arg)          runs = atoi(argv[++i]);
+        else if (strcmp(a, "--emit") == 0 && has_arg)      emit_path = argv[++i];
+        else if (strcmp(a, "--json") == 0 && has_arg)      json_path = argv[++i];
+        else if (strcmp(a, "--baseline") == 0 && has_arg)  baseline_path = argv[++i];
+        else if (strcmp(a, "--threshold") == 0 && has_arg) threshold = atof(argv[++i]);
+        else if (a[0] == '-') { fprintf(stderr, "unknown option: %s\n", a); return 2; }
+        else file = a;
+    }
+    if (runs < 1 || size == 0) { fprintf(stderr, "invalid run count or size\n"); return 2; }
+
+    size_t len;
+    char *src = file ? read_file(file, &len) : gen_program(size, seed, &len);
+    if (!src) return 2;
+
+    if (emit_path) {
+        FILE *f = fopen(emit_path, "w");
+        if (!f) { perror(emit_path); return 2; }
+        fwrite(src, 1, len, f);
+        fclose(f);
+        free(src);
+        return 0;
+    }
+
+    FrontResult r;
+    int ok = measure(src, len, runs, &r);
+    free(src);
+    if (!ok) return 1;
+
+    double tok_s = per_sec(r.tokens, r.lex_ns), node_s = per_sec(r.nodes, r.parse_ns);
+    double lex_bs = per_sec(r.bytes, r.lex_ns), parse_bs = per_sec(r.bytes, r.parse_ns);
+    printf("source            %lld bytes, %lld tokens, %lld nodes\n", r.bytes, r.tokens, r.nodes);
+    printf("lexer             %10.3f ms  %12.0f tokens/s  %8.1f MB/s\n", r.lex_ns / 1e6, tok_s, lex_bs / 1e6);
+    printf("parser            %10.3f ms  %12.0f nodes/s   %8.1f MB/s\n", r.parse_ns / 1e6, node_s, parse_bs / 1e6);
+    printf("parser allocation %10.1f bytes/source byte (%.1f held by the tree)\n", r.alloc_per_byte, r.tree_per_byte);
+
+    if (json_path) {
+        FILE *f = fopen(json_path, "w");
+        if (!f) { perror(json_path); return 2; }
+        fprintf(f, "{\"bytes\": %lld, \"tokens\": %lld, \"nodes\": %lld, \"runs\": %d,\n"
+                   " \"lex_ns\": %lld, \"parse_ns\": %lld,\n"
+                   " \"tokens_per_s\": %.0f, \"nodes_per_s\": %.0f,"
+                   " \"lex_bytes_per_s\": %.0f, \"parse_bytes_per_s\": %.0f,\n"
+                   " \"alloc_per_byte\": %.2f, \"tree_per_byte\": %.2f}\n",
+                r.bytes, r.tokens, r.nodes, runs, r.lex_ns, r.parse_ns,
+                tok_s, node_s, lex_bs, parse_bs, r.alloc_per_byte, r.tree_per_byte);
+        fclose(f);
+    }
+
+    int regressed = 0;
+    if (baseline_path) {
+        size_t blen;
+        char *text = read_file(baseline_path, &blen);
+        if (!text) return 2;
+        static const char *keys[] = { "tokens_per_s", "nodes_per_s" };
+        double now[] = { tok_s, node_s };
+        for (int i = 0; i < 2; i++) {
+            double base = baseline_value(text, keys[i]);
+            if (base <= 0) continue;
+            double change = 100.0 * (now[i] - base) / base;
+            printf("%-17s %+6.1f%% vs baseline%s\n", keys[i], change, -change > threshold ? "  REGRESSION" : "");
+            if (-change > threshold) regressed++;
+        }
+        /* allocation is deterministic for the same source, so any growth counts */
+        double base_alloc = baseline_value(text, "alloc_per_byte");
+        if ((long long)baseline_value(text, "bytes") == r.bytes && base_alloc > 0 && r.alloc_per_byte > base_alloc + 0.005) {
+            printf("alloc_per_byte    %.2f -> %.2f  REGRESSION\n", base_alloc, r.alloc_per_byte);
+            regressed++;
+        }
+        free(text);
+    }
+    return regressed ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+#include "gensrc.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char    *buf;
+    size_t   len, cap;
+    unsigned rng;
+} Gen;
+
+static void emit(Gen *g, const char *fmt, ...) {
+    va_list ap;
+    for (;;) {
+        va_start(ap, fmt);
+        int n = vsnprintf(g->buf + g->len, g->cap - g->len, fmt, ap);
+        va_end(ap);
+        if (n >= 0 && g->len + (size_t)n < g->cap) { g->len += (size_t)n; return; }
+        g->cap *= 2;
+        g->buf = realloc(g->buf, g->cap);
+    }
+}
+
+static unsigned rnd(Gen *g, unsigned n) {
+    g->rng ^= g->rng << 13;
+    g->rng ^= g->rng >> 17;
+    g->rng ^= g->rng << 5;
+    return g->rng % n;
+}
+
+/* An integer expression over the names a and b, depth levels deep.  Only
+   operators that cannot fail at run time are used. */
+static void expr(Gen *g, int depth) {
+    static const char *ops[] = { "+", "-", "*", "&", "|", "^" };
+    if (depth == 0) {
+        switch (rnd(g, 4)) {
+            case 0:  emit(g, "a"); break;
+            case 1:  emit(g, "b"); break;
+            default: emit(g, "%u", rnd(g, 1000)); break;
+        }
+        return;
+    }
+    switch (rnd(g, 5)) {
+        case 0:
+            emit(g, "(");
+            expr(g, depth - 1);
+            emit(g, " << %u)", 1 + rnd(g, 3));
+            break;
+        case 1:
+            emit(g, "((");
+            expr(g, depth - 1);
+            emit(g, " < ");
+            expr(g, depth - 1);
+            emit(g, ") ? ");
+            expr(g, depth - 1);
+            emit(g, " : %u)", rnd(g, 10));
+            break;
+        default:
+            emit(g, "(");
+            expr(g, depth - 1);
+            emit(g, " %s ", ops[rnd(g, 6)]);
+            expr(g, depth - 1);
+            emit(g, ")");
+            break;
+    }
+}
+
+static void unit(Gen *g, int i) {
+    emit(g, "// unit %d\n", i);
+
+    emit(g, "pat <T> Box%d {\n    pub var value : T\n    pub var count:i32\n}\n\n", i);
+
+    emit(g, "fn <T> ident%d(x : T) : (result : T) {\n    result = x\n}\n\n", i);
+
+    emit(g, "fn calc%d(a:i32, b:i32 = %u):(sum:i32, diff:i32):: {\n", i, rnd(g, 50));
+    emit(g, "    var t::const = ");
+    expr(g, 2 + (int)rnd(g, 2));
+    emit(g, "\n    sum = t + ");
+    expr(g, 1 + (int)rnd(g, 3));
+    emit(g, "\n    diff = a - b\n}\n\n");
+
+    int cases = 2 + (int)rnd(g, 5);
+    emit(g, "fn pick%d(k:i32):(result:i32)::constexpr {\n    switch (k %% %d) {\n", i, cases + 1);
+    for (int c = 0; c < cases; c++) emit(g, "        case %d: result = %u break\n", c, rnd(g, 100));
+    emit(g, "        default: result = 0 break\n    }\n}\n\n");
+
+    emit(g, "var s%d = : (left:i32, right:i32) {\n    left = %u\n    right = %u\n}\n\n",
+         i, rnd(g, 10), rnd(g, 10));
+
+    emit(g, "fn tcall%d() {\n    ident%d<i32, i64>(0)\n}\n\n", i, i);
+
+    emit(g, "var v%d:i32 = calc%d(%u, %u).sum + pick%d(%u).result + ident%d(%d).result + s%d().left\n",
+         i, i, rnd(g, 100), rnd(g, 100), i, rnd(g, 100), i, i, i);
+    emit(g, "var t%d = (a=v%d, b=\"str %d\", c=%u.5, d:i32=-%u)\n", i, i, i, rnd(g, 10), rnd(g, 10));
+    emit(g, "var n%d = 0\nfor (k : %u) {\n    n%d = n%d + k\n}\n", i, 1 + rnd(g, 4), i, i);
+    emit(g, "while (n%d > 0) { n%d = n%d - 1 }\n", i, i, i);
+    emit(g, "var b%d = Box%d(%u, %u)\n", i, i, rnd(g, 10), rnd(g, 10));
+    emit(g, "var ok%d = b%d.count >= 0 && !(n%d != 0) || v%d == t%d.a\n", i, i, i, i, i);
+    emit(g, "assert(ok%d)\n\n", i);
+}
+
+char *gen_program(size_t target_bytes, unsigned seed, size_t *len_out) {
+    Gen g;
+    g.cap = target_bytes + 4096;
+    g.buf = malloc(g.cap);
+    g.len = 0;
+    g.rng = seed ? seed : 1;
+    emit(&g, "// generated: %zu bytes, seed %u\n\n", target_bytes, seed);
+    for (int i = 0; g.len < target_bytes; i++) unit(&g, i);
+    if (len_out) *len_out = g.len;
+    return g.buf;
+}
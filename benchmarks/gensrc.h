@@ -0,0 +1,16 @@
+#ifndef GENSRC_H
+#define GENSRC_H
+
+#include <stddef.h>
+
+/* Synthetic source generator.
+ *
+ * Emits a program of roughly target_bytes made of independent units, each
+ * exercising the constructs the parser supports: templated `fn` and `pat`
+ * declarations, `::` attributes and parameter defaults, named returns, scopes,
+ * switch, while and for loops, tuples and every operator class.  The same seed
+ * always gives the same program, and the program runs cleanly, so it can be
+ * checked with the interpreter as well as parsed.  The result is malloc'd. */
+char *gen_program(size_t target_bytes, unsigned seed, size_t *len_out);
+
+#endif /* GENSRC_H */
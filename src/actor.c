@@ -0,0 +1,468 @@
+#define _POSIX_C_SOURCE 200809L
+#include "actor.h"
+#include "module.h"
+#include "mem.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHAN_DEFAULT_CAPACITY 16
+#define CHAN_MAX_CAPACITY     (1u << 24)
+#define WAIT_SPINS            64   /* failed attempts before a blocked op sleeps */
+
+/* ------------------------------------------------------------------ channels */
+
+/* D. Vyukov's bounded MPMC ring.  A slot's sequence number says whose turn it
+   is: seq == pos, a sender's of lap pos / capacity; seq == pos + 1, the
+   receiver's.  Claiming a slot is one compare-and-swap on the position, and
+   handing it over one release store to seq. */
+typedef struct {
+    atomic_size_t seq;
+    Value        *val;     /* a value_send_copy, or NULL with error set */
+    char         *error;   /* why the actor behind a spawn handle failed */
+} Slot;
+
+struct Channel {
+    size_t        capacity;
+    atomic_size_t send_pos;
+    char          pad[64];   /* senders and receivers stay off each other's cache line */
+    atomic_size_t recv_pos;
+    Slot          slots[];
+};
+
+static size_t chan_size(size_t capacity) {
+    return sizeof(Channel) + sizeof(Slot) * capacity;
+}
+
+/* A channel's ring comes from the heap, never from an arena, and is charged to
+   the current MemStats (if any) until chan_release. */
+static Channel *chan_new(size_t capacity) {
+    MemArena *arena = mem_arena_enter(NULL);
+    Channel *ch = mem_calloc(1, chan_size(capacity));
+    mem_arena_enter(arena);
+    if (!ch) return NULL;
+    ch->capacity = capacity;
+    for (size_t i = 0; i < capacity; i++) atomic_init(&ch->slots[i].seq, i);
+    return ch;
+}
+
+/* Only the thread of the interpreter that made the channel sees it charged:
+   every way out of that interpreter releases it first. */
+void chan_release(Channel *ch) {
+    if (mem_owner(ch)) mem_disown(ch);
+}
+
+static int chan_try_send(Channel *ch, Value *val, char *error) {
+    size_t pos = atomic_load_explicit(&ch->send_pos, memory_order_relaxed);
+    Slot *s;
+    for (;;) {
+        s = &ch->slots[pos % ch->capacity];
+        size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        long long d = (long long)(seq - pos);
+        if (d == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ch->send_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (d < 0) {
+            return 0;   /* full */
+        } else {
+            pos = atomic_load_explicit(&ch->send_pos, memory_order_relaxed);
+        }
+    }
+    s->val = val;
+    s->error = error;
+    atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+    return 1;
+}
+
+static int chan_try_recv(Channel *ch, Value **val, char **error) {
+    size_t pos = atomic_load_explicit(&ch->recv_pos, memory_order_relaxed);
+    Slot *s;
+    for (;;) {
+        s = &ch->slots[pos % ch->capacity];
+        size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        long long d = (long long)(seq - (pos + 1));
+        if (d == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ch->recv_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (d < 0) {
+            return 0;   /* empty */
+        } else {
+            pos = atomic_load_explicit(&ch->recv_pos, memory_order_relaxed);
+        }
+    }
+    *val = s->val;
+    *error = s->error;
+    atomic_store_explicit(&s->seq, pos + ch->capacity, memory_order_release);
+    return 1;
+}
+
+void chan_free(Channel *ch) {
+    if (!ch) return;
+    Value *val;
+    char *error;
+    while (chan_try_recv(ch, &val, &error)) {
+        value_decref(val);
+        free(error);
+    }
+    mem_free(ch);
+}
+
+/* ------------------------------------------------------------------ waiting */
+
+/* One event count for all channels: every successful send or receive bumps
+   epoch, and wakes the sleepers if there are any.  A waiter that read epoch
+   before its last failed attempt only sleeps if it is still unchanged once it
+   has registered, so no wakeup falls between the two. */
+static atomic_uint     epoch;
+static atomic_int      sleepers;
+static pthread_mutex_t wait_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wait_cond = PTHREAD_COND_INITIALIZER;
+
+static void notify(void) {
+    atomic_fetch_add(&epoch, 1);
+    if (atomic_load(&sleepers)) {
+        pthread_mutex_lock(&wait_lock);
+        pthread_cond_broadcast(&wait_cond);
+        pthread_mutex_unlock(&wait_lock);
+    }
+}
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Sleep until epoch moves on from seen, or until the monotonic deadline (0 =
+   none) passes. */
+static void wait_change(unsigned seen, long long deadline) {
+    pthread_mutex_lock(&wait_lock);
+    atomic_fetch_add(&sleepers, 1);
+    if (atomic_load(&epoch) == seen) {
+        if (deadline) {
+            /* the condition variable runs on the realtime clock */
+            long long left = deadline - monotonic_ns();
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            if (left > 0) {
+                long long ns = ts.tv_nsec + left;
+                ts.tv_sec += ns / 1000000000LL;
+                ts.tv_nsec = ns % 1000000000LL;
+                pthread_cond_timedwait(&wait_cond, &wait_lock, &ts);
+            }
+        } else {
+            pthread_cond_wait(&wait_cond, &wait_lock);
+        }
+    }
+    atomic_fetch_sub(&sleepers, 1);
+    pthread_mutex_unlock(&wait_lock);
+}
+
+typedef int (*ChanOp)(void *arg);
+
+/* Retry op until it succeeds (1) or the running interpreter's deadline has
+   passed (0, with the error raised). */
+static int block_on(ChanOp op, void *arg) {
+    Interpreter *in = interp_current();
+    long long deadline = in ? in->deadline_ns : 0;
+    for (int tries = 0;; tries++) {
+        unsigned seen = atomic_load(&epoch);
+        if (op(arg)) {
+            notify();
+            return 1;
+        }
+        if (deadline && monotonic_ns() >= deadline) {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "deadline exceeded (%lld ms)", in->timeout_ns / 1000000);
+            interp_raise(msg);
+            return 0;
+        }
+        if (tries < WAIT_SPINS) sched_yield();
+        else wait_change(seen, deadline);
+    }
+}
+
+typedef struct {
+    Channel **chans;
+    int       count;
+    int       first;   /* where select starts looking, so no channel starves */
+    int       index;   /* out: the channel a message came from */
+    Value    *val;
+    char     *error;
+} RecvOp;
+
+static int try_recv_any(void *arg) {
+    RecvOp *op = arg;
+    for (int i = 0; i < op->count; i++) {
+        int k = (op->first + i) % op->count;
+        if (chan_try_recv(op->chans[k], &op->val, &op->error)) {
+            op->index = k;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    Channel *chan;
+    Value   *val;
+    char    *error;
+} SendOp;
+
+static int try_send(void *arg) {
+    SendOp *op = arg;
+    return chan_try_send(op->chan, op->val, op->error);
+}
+
+/* Receive from whichever of chans has a message first; the message, adopted
+   by the running interpreter, or NULL with the error raised. */
+static Value *recv_any(Channel **chans, int count, int *index) {
+    static _Thread_local unsigned rotate;
+    RecvOp op = { chans, count, (int)(rotate++ % (unsigned)count), 0, NULL, NULL };
+    if (!block_on(try_recv_any, &op)) return NULL;
+    *index = op.index;
+    if (op.error) {
+        interp_raise(op.error);
+        free(op.error);
+        return NULL;
+    }
+    value_adopt(op.val);
+    return op.val;
+}
+
+/* ------------------------------------------------------------------ actors */
+
+typedef struct {
+    char      *path;          /* module fn is defined in, as the spawner loaded it */
+    char      *name;          /* fn's name there */
+    Value    **args;          /* value_send_copy of each argument */
+    int        argc;
+    Value     *handle;        /* channel the result is sent to */
+    char      *module_root;
+    FILE      *out;
+    size_t     mem_limit;
+    long long  step_limit, timeout_ms;
+    int        stats;         /* runtime counters on, see stats.h */
+} Actor;
+
+static void actor_free(Actor *a) {
+    for (int i = 0; i < a->argc; i++) value_decref(a->args[i]);
+    free(a->args);
+    value_decref(a->handle);
+    free(a->path);
+    free(a->name);
+    free(a->module_root);
+    free(a);
+}
+
+static Value *module_def(Value *mod, const char *name) {
+    for (EnvEntry *en = mod->module.env ? mod->module.env->entries : NULL; en; en = en->next)
+        if (strcmp(en->name, name) == 0) return en->val;
+    return NULL;
+}
+
+static void *actor_main(void *arg) {
+    Actor *a = arg;
+    Interpreter in;
+    interp_init(&in);
+    in.module_root = a->module_root;
+    in.out = a->out;
+    interp_set_mem_limit(&in, a->mem_limit);
+    interp_set_step_limit(&in, a->step_limit);
+    interp_set_timeout(&in, a->timeout_ms);
+    interp_enable_stats(&in, a->stats);
+
+    char err[256] = "";
+    Value *result = NULL;
+    Value *mod = load_module(in.modules, a->path, &in, err, sizeof(err));
+    if (mod) {
+        Value *fn = module_def(mod, a->name);
+        if (fn) {
+            for (int i = 0; i < a->argc; i++) value_adopt(a->args[i]);
+            result = interp_call_value(&in, fn, a->args, a->argc);
+            if (!result) snprintf(err, sizeof(err), "%s", in.error_msg);
+        } else {
+            snprintf(err, sizeof(err), "module %s has no '%s'", a->path, a->name);
+        }
+        value_decref(mod);
+    }
+    for (int i = 0; i < a->argc; i++) value_decref(a->args[i]);
+    a->argc = 0;
+
+    /* the result must not depend on the interpreter, which goes first */
+    SendOp op = { a->handle->chan, NULL, NULL };
+    if (result) {
+        op.val = value_send_copy(result);
+        value_decref(result);
+    } else {
+        size_t n = strlen(a->name) + strlen(err) + 32;
+        op.error = malloc(n);
+        if (op.error) snprintf(op.error, n, "actor %s failed: %s", a->name, err);
+    }
+    interp_free(&in);
+    block_on(try_send, &op);   /* no interpreter is current: waits as long as it takes */
+    actor_free(a);
+    return NULL;
+}
+
+/* Where the running interpreter loaded fn from: the path of the module that
+   defines it at its top level and the name it has there. */
+static int find_definition(Value *fn, const char **path, const char **name) {
+    Interpreter *in = interp_current();
+    if (!in || !in->modules) return 0;
+    for (ModuleCache *c = in->modules->head; c; c = c->next) {
+        Env *env = c->module->module.env;
+        for (EnvEntry *en = env ? env->entries : NULL; en; en = en->next) {
+            if (en->val != fn) continue;
+            *path = c->path;
+            *name = en->name;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* spawn(fn, args...) -> channel the actor's result arrives on */
+static Value *builtin_spawn(Value **args, int argc) {
+    const char *path, *name;
+    if (!find_definition(args[0], &path, &name)) {
+        interp_raise("spawn: the function must be defined at the top level of an imported module");
+        return NULL;
+    }
+    /* the actor sends on it after its interpreter, and maybe ours, is gone */
+    MemStats *prev = mem_set_current(NULL);
+    Channel *ch = chan_new(1);
+    mem_set_current(prev);
+    Actor *a = calloc(1, sizeof(Actor));
+    if (!ch || !a) {
+        mem_free(ch);
+        free(a);
+        interp_raise("spawn: out of memory");
+        return NULL;
+    }
+    Interpreter *in = interp_current();
+    a->path = strdup(path);
+    a->name = strdup(name);
+    a->module_root = in->module_root ? strdup(in->module_root) : NULL;
+    a->out = in->out;
+    a->mem_limit = in->mem.limit;
+    a->step_limit = in->step_limit;
+    a->timeout_ms = in->timeout_ns / 1000000;
+    a->stats = in->stats_enabled;
+    a->args = calloc((size_t)argc, sizeof(Value *));
+    for (int i = 1; i < argc; i++) a->args[a->argc++] = value_send_copy(args[i]);
+    Value *handle = value_new_channel(ch);
+    a->handle = handle;
+    value_incref(handle);
+
+    pthread_t t;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&t, &attr, actor_main, a);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        actor_free(a);
+        value_decref(handle);
+        interp_raise("spawn: cannot start a thread");
+        return NULL;
+    }
+    return handle;
+}
+
+/* ------------------------------------------------------------------ builtins */
+
+/* channel(capacity = 16) -> new channel */
+static Value *builtin_channel(Value **args, int argc) {
+    long long capacity = argc > 0 ? args[0]->int_val : CHAN_DEFAULT_CAPACITY;
+    if (capacity <= 0) {
+        interp_raise("channel: capacity must be a positive integer");
+        return NULL;
+    }
+    if ((unsigned long long)capacity > CHAN_MAX_CAPACITY
+            || (size_t)capacity > (SIZE_MAX - sizeof(Channel)) / sizeof(Slot)) {
+        interp_raise("channel: capacity is too large");
+        return NULL;
+    }
+    if (mem_would_exceed(chan_size((size_t)capacity))) {
+        interp_raise("channel: capacity exceeds the memory limit");
+        return NULL;
+    }
+    Channel *ch = chan_new((size_t)capacity);
+    if (!ch) {
+        interp_raise("channel: out of memory");
+        return NULL;
+    }
+    return value_new_channel(ch);
+}
+
+/* send(ch, v): waits while ch is full */
+static Value *builtin_send(Value **args, int argc) {
+    (void)argc;
+    SendOp op = { args[0]->chan, value_send_copy(args[1]), NULL };
+    if (!block_on(try_send, &op)) {
+        value_decref(op.val);
+        return NULL;
+    }
+    return value_new_null();
+}
+
+/* recv(ch) -> next message; waits while ch is empty */
+static Value *builtin_recv(Value **args, int argc) {
+    (void)argc;
+    int index;
+    return recv_any(&args[0]->chan, 1, &index);
+}
+
+/* select(ch, ...) -> (index, value): the first message on any of the
+   channels, and the position of the one it came from */
+static Value *builtin_select(Value **args, int argc) {
+    Channel *small[8];
+    Channel **chans = argc <= 8 ? small : malloc(sizeof(Channel *) * (size_t)argc);
+    for (int i = 0; i < argc; i++) {
+        if (args[i]->type != VAL_CHANNEL) {
+            char msg[96];
+            snprintf(msg, sizeof(msg), "select: argument %d must be channel, got %s",
+                     i + 1, value_kind_name(args[i]->type));
+            if (chans != small) free(chans);
+            interp_raise(msg);
+            return NULL;
+        }
+        chans[i] = args[i]->chan;
+    }
+    int index = 0;
+    Value *v = recv_any(chans, argc, &index);
+    if (chans != small) free(chans);
+    if (!v) return NULL;
+
+    Value *t = value_new_tuple(2);
+    t->tuple.names = mem_calloc(2, sizeof(char *));
+    t->tuple.names[0] = mem_strdup("index");
+    t->tuple.names[1] = mem_strdup("value");
+    t->tuple.elems[0] = value_new_int(index);
+    t->tuple.elems[1] = v;
+    return t;
+}
+
+static const NativeSig spawn_sig   = { 1, -1, 1, { 1u << VAL_FUNCTION } };
+static const NativeSig channel_sig = { 0, 1, 1, { 1u << VAL_INT } };
+static const NativeSig send_sig    = { 2, 2, 1, { 1u << VAL_CHANNEL } };
+static const NativeSig recv_sig    = { 1, 1, 1, { 1u << VAL_CHANNEL } };
+static const NativeSig select_sig  = { 1, -1, 0, { 0 } };
+
+void actor_register(Env *env) {
+#define REG(name, fn, sig) do { Value *_v = value_new_builtin(fn, sig, name); env_def(env, name, _v); value_decref(_v); } while(0)
+    REG("spawn",   builtin_spawn,   &spawn_sig);
+    REG("channel", builtin_channel, &channel_sig);
+    REG("send",    builtin_send,    &send_sig);
+    REG("recv",    builtin_recv,    &recv_sig);
+    REG("select",  builtin_select,  &select_sig);
+#undef REG
+}
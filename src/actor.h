@@ -0,0 +1,39 @@
+#ifndef ACTOR_H
+#define ACTOR_H
+
+/* Actors and channels.
+ *
+ * spawn(fn, args...) runs fn(args...) on a thread of its own, in a fresh
+ * Interpreter that shares nothing with the one that spawned it: fn must be
+ * defined at the top level of an imported module, which the actor imports
+ * again for itself (the parsed tree is shared, see module.h), and it gets the
+ * script's module root, output stream, limits and runtime counters setting
+ * (stats.h).  spawn returns a channel that fn's result arrives on, or the
+ * error the actor stopped with, which recv then raises.
+ *
+ * Interpreters talk through channels: channel(capacity) makes one, send(ch, v)
+ * and recv(ch) wait while it is full or empty, and select(ch...) waits for
+ * whichever of several has a message first.  A channel is a bounded lock-free
+ * queue with any number of senders and receivers on any threads; a blocked
+ * actor sleeps until some channel changes, or until its interpreter's
+ * deadline passes, which is an error.
+ *
+ * A message crosses over without the receiver ever seeing the sender's Env
+ * graph.  Immutable values are shared, not copied: value_share hands them to
+ * no interpreter in particular and from then on their reference counts, and
+ * only theirs, are atomic.  Those are strings and channels, and frozen values
+ * that hold no pattern instance, which are not counted at all (see
+ * value_freeze).  Everything else is
+ * copied (value_send_copy), charged to nobody in transit, and charged to the
+ * receiver once it arrives; functions, scopes, modules and generators become
+ * null on the way.  Shared values count against no interpreter's memory
+ * limit, except a channel's ring: it is charged to the interpreter that made
+ * the channel until the channel first leaves it. */
+
+#include "interpreter.h"
+
+void chan_free(Channel *ch);     /* with the last reference to its value */
+void chan_release(Channel *ch);  /* stop charging ch's ring: it may reach another thread */
+void actor_register(Env *env);   /* spawn, channel, send, recv, select */
+
+#endif /* ACTOR_H */
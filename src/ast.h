@@ -72,14 +72,25 @@ struct AstNode {
     int is_const;
     int is_constexpr;
     int is_variadic;   /* for template parameters: Param:: or Param:type: */
+    int is_parallel;   /* for loops: ::parallel, reduction operator (if any) in op */
+    int is_generator;  /* functions: ::generator; yield: suspends the generator it is in */
     char *name;        /* declaration name */
-    char *op;          /* operator string for BINOP/UNOP */
+    char *op;          /* operator string for BINOP/UNOP, reduction of a parallel FOR */
     AstNode *type_ann; /* type annotation */
     AstNode *init;     /* initializer expression */
     AstNode *body;     /* function / loop body */
     AstNode *cond;     /* condition */
     AstNode *alt;      /* else-branch of optional */
     AstNode *tmpl;     /* template parameter list */
+
+    /* AST_FN_DECL: names the body refers to that are not parameters or named
+       returns, computed by the parser.  free_var_local[i] is set when the name
+       is also declared somewhere inside the function.  binds_late is set when
+       an enclosing scope declares one of them after the function. */
+    char          **free_vars;
+    unsigned char  *free_var_local;
+    int             free_var_count;
+    int             binds_late;
 };
 
 AstNode *ast_new(AstNodeType type, int line, int col);
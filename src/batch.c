@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include "batch.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+#include "mem.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    char      *path;
+    char      *name;       /* file name within the directory */
+    int        passed;
+    long long  ns;         /* wall time of the script's run, parse included */
+    char      *out;        /* captured print output, then the error if any */
+    size_t     out_len;
+} Script;
+
+typedef struct {
+    Script             *scripts;
+    int                 count;
+    atomic_int          next;        /* index of the next script to claim */
+    const char         *dir;
+    const BatchOptions *opt;
+} Batch;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = mem_alloc((size_t)len + 1);
+    size_t n = fread(buf, 1, (size_t)len, f);
+    buf[n] = '\0';
+    fclose(f);
+    return buf;
+}
+
+/* ------------------------------------------------------------------ one script */
+
+/* With --arena, the script, its interpreter included, lives in the worker
+   thread's arena (if one could be had), reset once it has run: nothing it
+   made outlives it but its output. */
+static void run_script(Script *s, const Batch *b, MemArena *arena) {
+    long long start = now_ns();
+    FILE *out = open_memstream(&s->out, &s->out_len);
+    if (!out) {
+        s->passed = 0;
+        return;
+    }
+
+    mem_arena_enter(arena);
+    Interpreter interp;
+    interp_init(&interp);
+    interp.module_root = b->dir;
+    interp.out = out;
+    interp_set_mem_limit(&interp, b->opt->mem_limit);
+    interp_set_step_limit(&interp, b->opt->max_steps);
+    interp_set_timeout(&interp, b->opt->timeout_ms);
+
+    AstNode *program = NULL;
+    char *src = read_file(s->path);
+    if (!src) {
+        fprintf(out, "%s: cannot read\n", s->name);
+    } else {
+        Lexer lex;
+        lexer_init(&lex, src);
+        Parser parser;
+        parser_init(&parser, &lex);
+        program = parse_program(&parser);
+        token_free(&parser.cur);
+        if (parser.had_error) {
+            fprintf(out, "%s: %s\n", s->name, parser.error_msg);
+        } else {
+            interp_run(&interp, program);
+            if (interp.had_error) fprintf(out, "%s\n", interp.error_msg);
+            else s->passed = 1;
+        }
+    }
+
+    mem_arena_enter(NULL);
+    if (arena) {
+        interp_discard(&interp);
+        mem_arena_reset(arena);
+    } else {
+        /* the script's functions point into its tree: drop them first */
+        interp_free(&interp);
+        ast_free(program);
+        mem_free(src);
+    }
+    fclose(out);
+    s->ns = now_ns() - start;
+}
+
+static void *worker(void *arg) {
+    Batch *b = arg;
+    MemArena *arena = b->opt->arena ? mem_arena_new(0) : NULL;
+    for (;;) {
+        int i = atomic_fetch_add_explicit(&b->next, 1, memory_order_relaxed);
+        if (i >= b->count) break;
+        run_script(&b->scripts[i], b, arena);
+    }
+    mem_arena_free(arena);
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ directory */
+
+static int by_name(const void *a, const void *b) {
+    return strcmp(((const Script *)a)->name, ((const Script *)b)->name);
+}
+
+static int list_scripts(Batch *b) {
+    DIR *d = opendir(b->dir);
+    if (!d) { perror(b->dir); return -1; }
+    int cap = 0;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        size_t n = strlen(e->d_name);
+        if (n <= 5 || strcmp(e->d_name + n - 5, ".lang") != 0) continue;
+        if (b->count >= cap) {
+            cap = cap ? cap * 2 : 64;
+            b->scripts = realloc(b->scripts, sizeof(Script) * (size_t)cap);
+        }
+        Script *s = &b->scripts[b->count++];
+        memset(s, 0, sizeof(*s));
+        s->name = strdup(e->d_name);
+        s->path = malloc(strlen(b->dir) + n + 2);
+        sprintf(s->path, "%s/%s", b->dir, e->d_name);
+    }
+    closedir(d);
+    qsort(b->scripts, (size_t)b->count, sizeof(Script), by_name);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ report */
+
+static void print_output(const Script *s) {
+    printf("--- %s\n", s->name);
+    fwrite(s->out, 1, s->out_len, stdout);
+    if (s->out_len && s->out[s->out_len - 1] != '\n') putchar('\n');
+}
+
+int batch_run(const char *dir, const BatchOptions *opt) {
+    Batch b;
+    memset(&b, 0, sizeof(b));
+    b.dir = dir;
+    b.opt = opt;
+    if (list_scripts(&b) != 0) return 1;
+    if (!b.count) {
+        fprintf(stderr, "%s: no .lang scripts\n", dir);
+        return 1;
+    }
+
+    int jobs = opt->jobs > 0 ? opt->jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if (jobs > b.count) jobs = b.count;
+
+    long long start = now_ns();
+    pthread_t *threads = calloc((size_t)jobs, sizeof(pthread_t));
+    int started = 0;
+    for (; started < jobs; started++)
+        if (pthread_create(&threads[started], NULL, worker, &b) != 0) break;
+    if (!started) worker(&b);   /* no threads to be had: run them all here */
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    free(threads);
+    long long wall = now_ns() - start;
+
+    int passed = 0;
+    long long script_ns = 0;
+    for (int i = 0; i < b.count; i++) {
+        Script *s = &b.scripts[i];
+        printf("%s %10.2f ms  %s\n", s->passed ? "PASS" : "FAIL", (double)s->ns / 1e6, s->name);
+        passed += s->passed;
+        script_ns += s->ns;
+    }
+    for (int i = 0; i < b.count; i++) {
+        Script *s = &b.scripts[i];
+        if ((!s->passed || opt->verbose) && s->out_len) print_output(s);
+    }
+    int threads_used = started ? started : 1;
+    printf("%d scripts: %d passed, %d failed in %.2f ms on %d thread%s (script time %.2f ms)\n",
+           b.count, passed, b.count - passed, (double)wall / 1e6, threads_used, threads_used == 1 ? "" : "s",
+           (double)script_ns / 1e6);
+
+    for (int i = 0; i < b.count; i++) {
+        free(b.scripts[i].path);
+        free(b.scripts[i].name);
+        free(b.scripts[i].out);
+    }
+    free(b.scripts);
+    return passed == b.count ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/* Batch runner (--batch).
+ *
+ * Runs every .lang file directly inside a directory, each in an Interpreter of
+ * its own, on a pool of worker threads.  Imports resolve against the
+ * directory, and each module is parsed once for the whole batch and its tree
+ * shared by every interpreter that imports it (see module.h).  What a script
+ * prints, and the error it stopped with, are captured per script; the report
+ * on stdout lists every script's status and time in name order, then the
+ * captured output of the scripts that failed, then a summary. */
+
+#include <stddef.h>
+
+typedef struct {
+    int       jobs;          /* worker threads; 0 = one per online CPU */
+    int       verbose;       /* also show the output of scripts that passed */
+    size_t    mem_limit;     /* per script, as --mem-limit; 0 = unlimited */
+    long long max_steps;     /* per script; 0 = unlimited */
+    long long timeout_ms;    /* per script; 0 = unlimited */
+    int       arena;         /* run each script in its worker's arena (--arena) */
+} BatchOptions;
+
+/* Exit status: 0 when every script passed. */
+int batch_run(const char *dir, const BatchOptions *opt);
+
+#endif /* BATCH_H */
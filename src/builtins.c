@@ -1,31 +1,41 @@
+#define _POSIX_C_SOURCE 200809L
 #include "builtins.h"
 #include "value.h"
+#include "interpreter.h"
+#include "gc.h"
+#include "mem.h"
+#include "instrument.h"
+#include "stats.h"
+#include "heapprof.h"
+#include "actor.h"
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
-/* ------------------------------------------------------------------ helper */
+/* ------------------------------------------------------------------ I/O */
 
-static Value *check_argc(Value **args, int argc, int expected, const char *name) {
-    if (argc < expected) {
-        fprintf(stderr, "builtin %s: expected %d args, got %d\n", name, expected, argc);
-        return NULL;
-    }
-    (void)args;
-    return (Value *)1; /* non-null = ok */
+/* print writes to the interpreter's output stream (stdout unless redirected,
+   see Interpreter.out), locked for the whole line so interpreters printing on
+   other threads cannot interleave with it. */
+static FILE *out_stream(void) {
+    Interpreter *in = interp_current();
+    return in && in->out ? in->out : stdout;
 }
 
-/* ------------------------------------------------------------------ I/O */
-
 static Value *builtin_print(Value **args, int argc) {
+    FILE *out = out_stream();
+    flockfile(out);
     for (int i = 0; i < argc; i++) {
         char *s = value_to_string(args[i]);
-        printf("%s", s);
-        free(s);
-        if (i < argc - 1) printf(" ");
+        fputs(s, out);
+        mem_free(s);
+        if (i < argc - 1) putc_unlocked(' ', out);
     }
-    printf("\n");
+    putc_unlocked('\n', out);
+    funlockfile(out);
     return value_new_null();
 }
 
@@ -36,8 +46,10 @@ static Value *builtin_println(Value **args, int argc) {
 static Value *builtin_input(Value **args, int argc) {
     if (argc > 0) {
         char *prompt = value_to_string(args[0]);
-        printf("%s", prompt);
-        free(prompt);
+        FILE *out = out_stream();
+        fputs(prompt, out);
+        fflush(out);
+        mem_free(prompt);
     }
     char buf[1024];
     if (!fgets(buf, sizeof(buf), stdin)) return value_new_string("");
@@ -50,7 +62,7 @@ static Value *builtin_input(Value **args, int argc) {
 /* ------------------------------------------------------------------ type conversions */
 
 static Value *builtin_int(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "int")) return value_new_null();
+    (void)argc;
     Value *a = args[0];
     if (a->type == VAL_INT)   return value_new_int(a->int_val);
     if (a->type == VAL_FLOAT) return value_new_int((long long)a->float_val);
@@ -60,7 +72,7 @@ static Value *builtin_int(Value **args, int argc) {
 }
 
 static Value *builtin_float(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "float")) return value_new_null();
+    (void)argc;
     Value *a = args[0];
     if (a->type == VAL_FLOAT) return value_new_float(a->float_val);
     if (a->type == VAL_INT)   return value_new_float((double)a->int_val);
@@ -70,87 +82,186 @@ static Value *builtin_float(Value **args, int argc) {
 }
 
 static Value *builtin_string(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "string")) return value_new_null();
+    (void)argc;
     char *s = value_to_string(args[0]);
     Value *r = value_new_string(s);
-    free(s);
+    mem_free(s);
     return r;
 }
 
 static Value *builtin_bool(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "bool")) return value_new_null();
+    (void)argc;
     return value_new_bool(value_is_truthy(args[0]));
 }
 
 /* ------------------------------------------------------------------ type checks */
 
 static Value *builtin_is_null(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "is_null")) return value_new_null();
+    (void)argc;
     return value_new_bool(args[0]->type == VAL_NULL);
 }
 
 static Value *builtin_is_int(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "is_int")) return value_new_null();
+    (void)argc;
     return value_new_bool(args[0]->type == VAL_INT);
 }
 
 static Value *builtin_is_float(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "is_float")) return value_new_null();
+    (void)argc;
     return value_new_bool(args[0]->type == VAL_FLOAT);
 }
 
 static Value *builtin_is_string(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "is_string")) return value_new_null();
+    (void)argc;
     return value_new_bool(args[0]->type == VAL_STRING);
 }
 
 static Value *builtin_type_of(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "type_of")) return value_new_null();
+    (void)argc;
     static const char *names[] = {
         "null","int","float","string","bool","tuple","variant",
-        "function","pat_inst","scope","builtin_fn","optional","type","module"
+        "function","pat_inst","scope","builtin_fn","optional","type","module","channel",
+        "generator","range"
     };
     if ((int)args[0]->type < (int)(sizeof(names)/sizeof(names[0])))
         return value_new_string(names[args[0]->type]);
     return value_new_string("unknown");
 }
 
+/* ------------------------------------------------------------------ freezing */
+
+/* freeze(v) -> v, deep-frozen (see value_freeze) */
+static Value *builtin_freeze(Value **args, int argc) {
+    (void)argc;
+    const char *why;
+    if (value_freeze(args[0], &why) != 0) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "freeze: cannot freeze this %s: %s", value_kind_name(args[0]->type), why);
+        interp_raise(msg);
+        return NULL;
+    }
+    value_incref(args[0]);
+    return args[0];
+}
+
+static Value *builtin_is_frozen(Value **args, int argc) {
+    (void)argc;
+    return value_new_bool(args[0]->frozen);
+}
+
+/* ------------------------------------------------------------------ ranges */
+
+/* range(stop), range(start, stop) or range(start, stop, step): the integers
+   from start (0) up to but not including stop, step (1) apart, counting down
+   for a negative step.  A range holds those three numbers, never its
+   elements. */
+static Value *builtin_range(Value **args, int argc) {
+    long long start = argc > 1 ? args[0]->int_val : 0;
+    long long stop  = argc > 1 ? args[1]->int_val : args[0]->int_val;
+    long long step  = argc > 2 ? args[2]->int_val : 1;
+    if (step == 0) {
+        interp_raise("range: step must not be 0");
+        return NULL;
+    }
+    unsigned long long len = 0;
+    if (step > 0 && start < stop)
+        len = ((unsigned long long)stop - (unsigned long long)start - 1) / (unsigned long long)step + 1;
+    else if (step < 0 && start > stop)
+        len = ((unsigned long long)start - (unsigned long long)stop - 1) / (0ULL - (unsigned long long)step) + 1;
+    if (len > LLONG_MAX) {
+        interp_raise("range: too many elements");
+        return NULL;
+    }
+    return value_new_range(start, step, (long long)len);
+}
+
+/* count elements of tuple t from first on, dir (1 or -1) apart, names kept */
+static Value *tuple_part(Value *t, long long first, long long count, int dir) {
+    Value *c = value_new_tuple((int)count);
+    if (t->tuple.names) c->tuple.names = mem_calloc((size_t)count, sizeof(char *));
+    for (long long k = 0; k < count; k++) {
+        long long i = first + k * dir;
+        c->tuple.elems[k] = t->tuple.elems[i];
+        value_incref(t->tuple.elems[i]);
+        if (t->tuple.names && t->tuple.names[i]) c->tuple.names[k] = mem_strdup(t->tuple.names[i]);
+    }
+    return c;
+}
+
+/* A slice bound: negative counts from the end, and it is clamped to 0..len. */
+static long long slice_bound(long long i, long long len) {
+    if (i < 0 && (i += len) < 0) i = 0;
+    return i < len ? i : len;
+}
+
+/* slice(seq, start[, stop]) -> the elements start .. stop-1 of a tuple or
+   range; a range's slice is another range. */
+static Value *builtin_slice(Value **args, int argc) {
+    Value *seq = args[0];
+    long long len = seq->type == VAL_RANGE ? seq->range.len : seq->tuple.count;
+    long long lo = slice_bound(args[1]->int_val, len);
+    long long hi = argc > 2 ? slice_bound(args[2]->int_val, len) : len;
+    if (hi < lo) hi = lo;
+    if (seq->type == VAL_TUPLE) return tuple_part(seq, lo, hi - lo, 1);
+    long long first = hi > lo ? range_elem(seq->range.start, seq->range.step, lo) : seq->range.start;
+    return value_new_range(first, seq->range.step, hi - lo);
+}
+
+/* reversed(seq) -> a tuple or range with the elements of seq last to first */
+static Value *builtin_reversed(Value **args, int argc) {
+    (void)argc;
+    Value *seq = args[0];
+    if (seq->type == VAL_TUPLE) return tuple_part(seq, seq->tuple.count - 1, seq->tuple.count, -1);
+    long long n = seq->range.len;
+    if (n < 2) {
+        value_incref(seq);
+        return seq;
+    }
+    if (seq->range.step == LLONG_MIN) {   /* -step does not fit, and n is 2 */
+        Value *t = value_new_tuple(2);
+        t->tuple.elems[0] = value_new_int(range_elem(seq->range.start, seq->range.step, 1));
+        t->tuple.elems[1] = value_new_int(seq->range.start);
+        return t;
+    }
+    return value_new_range(range_elem(seq->range.start, seq->range.step, n - 1), -seq->range.step, n);
+}
+
 /* ------------------------------------------------------------------ math */
 
 static Value *builtin_abs(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "abs")) return value_new_null();
+    (void)argc;
     if (args[0]->type == VAL_INT)   return value_new_int(llabs(args[0]->int_val));
     if (args[0]->type == VAL_FLOAT) return value_new_float(fabs(args[0]->float_val));
     return value_new_null();
 }
 
 static Value *builtin_sqrt(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "sqrt")) return value_new_null();
+    (void)argc;
     double v = (args[0]->type == VAL_INT) ? (double)args[0]->int_val : args[0]->float_val;
     return value_new_float(sqrt(v));
 }
 
 static Value *builtin_pow(Value **args, int argc) {
-    if (!check_argc(args, argc, 2, "pow")) return value_new_null();
+    (void)argc;
     double b = (args[0]->type == VAL_INT) ? (double)args[0]->int_val : args[0]->float_val;
     double e = (args[1]->type == VAL_INT) ? (double)args[1]->int_val : args[1]->float_val;
     return value_new_float(pow(b, e));
 }
 
 static Value *builtin_floor(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "floor")) return value_new_null();
+    (void)argc;
     double v = (args[0]->type == VAL_INT) ? (double)args[0]->int_val : args[0]->float_val;
     return value_new_int((long long)floor(v));
 }
 
 static Value *builtin_ceil(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "ceil")) return value_new_null();
+    (void)argc;
     double v = (args[0]->type == VAL_INT) ? (double)args[0]->int_val : args[0]->float_val;
     return value_new_int((long long)ceil(v));
 }
 
 static Value *builtin_min(Value **args, int argc) {
-    if (!check_argc(args, argc, 2, "min")) return value_new_null();
+    (void)argc;
     if (args[0]->type == VAL_INT && args[1]->type == VAL_INT)
         return value_new_int(args[0]->int_val < args[1]->int_val ? args[0]->int_val : args[1]->int_val);
     double a = (args[0]->type == VAL_INT) ? (double)args[0]->int_val : args[0]->float_val;
@@ -159,7 +270,7 @@ static Value *builtin_min(Value **args, int argc) {
 }
 
 static Value *builtin_max(Value **args, int argc) {
-    if (!check_argc(args, argc, 2, "max")) return value_new_null();
+    (void)argc;
     if (args[0]->type == VAL_INT && args[1]->type == VAL_INT)
         return value_new_int(args[0]->int_val > args[1]->int_val ? args[0]->int_val : args[1]->int_val);
     double a = (args[0]->type == VAL_INT) ? (double)args[0]->int_val : args[0]->float_val;
@@ -170,14 +281,15 @@ static Value *builtin_max(Value **args, int argc) {
 /* ------------------------------------------------------------------ string ops */
 
 static Value *builtin_len(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "len")) return value_new_null();
+    (void)argc;
     if (args[0]->type == VAL_STRING) return value_new_int((long long)strlen(args[0]->str_val));
     if (args[0]->type == VAL_TUPLE)  return value_new_int(args[0]->tuple.count);
+    if (args[0]->type == VAL_RANGE)  return value_new_int(args[0]->range.len);
     return value_new_null();
 }
 
 static Value *builtin_substr(Value **args, int argc) {
-    if (!check_argc(args, argc, 3, "substr")) return value_new_null();
+    (void)argc;
     if (args[0]->type != VAL_STRING) return value_new_null();
     const char *s = args[0]->str_val;
     long long start = args[1]->int_val;
@@ -187,11 +299,11 @@ static Value *builtin_substr(Value **args, int argc) {
     if (start > slen) start = slen;
     if (length < 0) length = 0;
     if (start + length > slen) length = slen - start;
-    char *buf = malloc((size_t)length + 1);
+    char *buf = mem_alloc((size_t)length + 1);
     memcpy(buf, s + start, (size_t)length);
     buf[length] = '\0';
     Value *r = value_new_string(buf);
-    free(buf);
+    mem_free(buf);
     return r;
 }
 
@@ -200,65 +312,283 @@ static Value *builtin_concat(Value **args, int argc) {
     for (int i = 0; i < argc; i++) {
         if (args[i]->type == VAL_STRING) total += strlen(args[i]->str_val);
     }
-    char *buf = malloc(total + 1);
+    char *buf = mem_alloc(total + 1);
     buf[0] = '\0';
     for (int i = 0; i < argc; i++) {
         if (args[i]->type == VAL_STRING) strcat(buf, args[i]->str_val);
     }
     Value *r = value_new_string(buf);
-    free(buf);
+    mem_free(buf);
     return r;
 }
 
 /* ------------------------------------------------------------------ type reflection */
 
 static Value *builtin_type(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "type")) return value_new_null();
+    (void)argc;
     return value_type_of(args[0]);
 }
 
 /* ------------------------------------------------------------------ assert */
 
 static Value *builtin_assert(Value **args, int argc) {
-    if (!check_argc(args, argc, 1, "assert")) return value_new_null();
     if (!value_is_truthy(args[0])) {
-        if (argc >= 2 && args[1]->type == VAL_STRING) {
-            fprintf(stderr, "Assertion failed: %s\n", args[1]->str_val);
-        } else {
-            fprintf(stderr, "Assertion failed\n");
-        }
-        exit(1);
+        char msg[256];
+        if (argc >= 2 && args[1]->type == VAL_STRING)
+            snprintf(msg, sizeof(msg), "Assertion failed: %s", args[1]->str_val);
+        else
+            snprintf(msg, sizeof(msg), "Assertion failed");
+        interp_raise(msg);
     }
     return value_new_null();
 }
 
+/* ------------------------------------------------------------------ memory */
+
+static Value *builtin_gc_collect(Value **args, int argc) {
+    (void)args; (void)argc;
+    return value_new_int(gc_collect());
+}
+
+static Value *named_tuple(int count, const char **names) {
+    Value *t = value_new_tuple(count);
+    t->tuple.names = mem_calloc((size_t)count, sizeof(char *));
+    for (int i = 0; i < count; i++) t->tuple.names[i] = mem_strdup(names[i]);
+    return t;
+}
+
+/* mem_stats() -> (current, peak, limit, allocs) for the running interpreter */
+static Value *builtin_mem_stats(Value **args, int argc) {
+    (void)args; (void)argc;
+    static const char *names[] = { "current", "peak", "limit", "allocs" };
+    MemStats *ms = mem_current();
+    long long vals[4] = {
+        ms ? (long long)ms->current : 0, ms ? (long long)mem_peak(ms) : 0,
+        ms ? (long long)ms->limit : 0,   ms ? ms->allocs : 0,
+    };
+    Value *t = named_tuple(4, names);
+    for (int i = 0; i < 4; i++) t->tuple.elems[i] = value_new_int(vals[i]);
+    return t;
+}
+
+/* call_stats() -> tuple of (name, calls, incl_ns, excl_ns, allocs), most
+   exclusive time first; empty unless call instrumentation is on */
+static Value *builtin_call_stats(Value **args, int argc) {
+    (void)args; (void)argc;
+    static const char *names[] = { "name", "calls", "incl_ns", "excl_ns", "allocs" };
+    const InstrEntry *es;
+    int n = instr_active ? instr_entries(&es) : 0;
+    Value *t = value_new_tuple(n);
+    for (int i = 0; i < n; i++) {
+        Value *row = named_tuple(5, names);
+        row->tuple.elems[0] = value_new_string(es[i].name);
+        row->tuple.elems[1] = value_new_int(es[i].calls);
+        row->tuple.elems[2] = value_new_int(es[i].incl_ns);
+        row->tuple.elems[3] = value_new_int(es[i].excl_ns);
+        row->tuple.elems[4] = value_new_int(es[i].allocs);
+        t->tuple.elems[i] = row;
+    }
+    return t;
+}
+
+/* __stats() -> runtime counters of the running interpreter (see stats.h);
+   all zero unless stats are enabled */
+static Value *builtin_stats(Value **args, int argc) {
+    (void)args; (void)argc;
+    static const char *names[] = {
+        "allocs", "env_new", "env_get", "env_get_avg_depth",
+        "increfs", "decrefs", "string_bytes", "live", "peak_live",
+    };
+    RuntimeStats zero = {0};
+    const RuntimeStats *s = stats_current ? stats_current : &zero;
+
+    const char *type_names[VAL_TYPE_COUNT];
+    for (int i = 0; i < VAL_TYPE_COUNT; i++) type_names[i] = stats_type_name(i);
+    Value *allocs = named_tuple(VAL_TYPE_COUNT, type_names);
+    for (int i = 0; i < VAL_TYPE_COUNT; i++) allocs->tuple.elems[i] = value_new_int(s->value_allocs[i]);
+
+    Value *t = named_tuple(9, names);
+    t->tuple.elems[0] = allocs;
+    t->tuple.elems[1] = value_new_int(s->env_new);
+    t->tuple.elems[2] = value_new_int(s->env_get);
+    t->tuple.elems[3] = value_new_float(s->env_get ? (double)s->env_get_depth / (double)s->env_get : 0.0);
+    t->tuple.elems[4] = value_new_int(s->increfs);
+    t->tuple.elems[5] = value_new_int(s->decrefs);
+    t->tuple.elems[6] = value_new_int(s->string_bytes);
+    t->tuple.elems[7] = value_new_int(s->live);
+    t->tuple.elems[8] = value_new_int(s->peak_live);
+    return t;
+}
+
+/* heap_profile() -> (sites, retained): live sampled bytes per allocation site
+   as (where, line, samples, objects, bytes) rows, where being the function or
+   module path the line is in (null in the main script), and (name, objects, bytes) rows
+   retained by each global binding; sites is empty unless heap profiling is on */
+static Value *builtin_heap_profile(Value **args, int argc) {
+    (void)args; (void)argc;
+    static const char *names[]      = { "sites", "retained" };
+    static const char *site_names[] = { "where", "line", "samples", "objects", "bytes" };
+    static const char *ret_names[]  = { "name", "objects", "bytes" };
+
+    const HeapSite *s;
+    int n = heapprof_active ? heapprof_sites(&s) : 0;
+    Value *sites = value_new_tuple(n);
+    for (int i = 0; i < n; i++) {
+        Value *row = named_tuple(5, site_names);
+        row->tuple.elems[0] = s[i].where ? value_new_string(s[i].where) : value_new_null();
+        row->tuple.elems[1] = value_new_int(s[i].line);
+        row->tuple.elems[2] = value_new_int(s[i].samples);
+        row->tuple.elems[3] = value_new_int(s[i].objects);
+        row->tuple.elems[4] = value_new_int(s[i].bytes);
+        sites->tuple.elems[i] = row;
+    }
+
+    Interpreter *in = interp_current();
+    const HeapRetained *r;
+    int m = in ? heapprof_retained(in->global, &r) : 0;
+    Value *retained = value_new_tuple(m);
+    for (int i = 0; i < m; i++) {
+        Value *row = named_tuple(3, ret_names);
+        row->tuple.elems[0] = value_new_string(r[i].name);
+        row->tuple.elems[1] = value_new_int(r[i].objects);
+        row->tuple.elems[2] = value_new_int(r[i].bytes);
+        retained->tuple.elems[i] = row;
+    }
+
+    Value *t = named_tuple(2, names);
+    t->tuple.elems[0] = sites;
+    t->tuple.elems[1] = retained;
+    return t;
+}
+
+/* ------------------------------------------------------------------ timing */
+
+static long long clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* now_ns() -> monotonic wall-clock nanoseconds */
+static Value *builtin_now_ns(Value **args, int argc) {
+    (void)args; (void)argc;
+    return value_new_int(clock_ns(CLOCK_MONOTONIC));
+}
+
+/* cpu_ns() -> CPU time used by the process, in nanoseconds */
+static Value *builtin_cpu_ns(Value **args, int argc) {
+    (void)args; (void)argc;
+    return value_new_int(clock_ns(CLOCK_PROCESS_CPUTIME_ID));
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/* bench(fn, iterations, args...) -> (iterations, min_ns, median_ns, mean_ns,
+   stddev_ns, allocs): calls fn(args...) iterations times after a warmup of
+   about a tenth as many calls and reports the time of one call and the
+   allocations it made on average */
+static Value *builtin_bench(Value **args, int argc) {
+    static const char *names[] = { "iterations", "min_ns", "median_ns", "mean_ns", "stddev_ns", "allocs" };
+    if (args[1]->int_val <= 0) {
+        interp_raise("bench: iteration count must be a positive integer");
+        return NULL;
+    }
+    long long n = args[1]->int_val;
+    long long warmup = n / 10 + 1;
+    long long *ns = malloc(sizeof(long long) * (size_t)n);
+    if (!ns) { interp_raise("bench: too many iterations"); return NULL; }
+    Value **fargs = args + 2;
+    int fargc = argc - 2;
+
+    MemStats *ms = mem_current();
+    long long allocs = 0;
+    for (long long i = -warmup; i < n; i++) {
+        if (i == 0 && ms) allocs = ms->allocs;
+        long long start = clock_ns(CLOCK_MONOTONIC);
+        EvalResult r = interp_call(args[0], fargs, fargc);
+        long long t = clock_ns(CLOCK_MONOTONIC) - start;
+        if (r.sig == SIG_ERROR) {
+            free(ns);
+            interp_propagate(&r);
+            return NULL;
+        }
+        if (r.val) value_decref(r.val);
+        if (i >= 0) ns[i] = t;
+    }
+    if (ms) allocs = ms->allocs - allocs;
+
+    double mean = 0, var = 0;
+    for (long long i = 0; i < n; i++) mean += (double)ns[i];
+    mean /= (double)n;
+    for (long long i = 0; i < n; i++) var += ((double)ns[i] - mean) * ((double)ns[i] - mean);
+    qsort(ns, (size_t)n, sizeof(long long), cmp_ll);
+
+    Value *t = named_tuple(6, names);
+    t->tuple.elems[0] = value_new_int(n);
+    t->tuple.elems[1] = value_new_int(ns[0]);
+    t->tuple.elems[2] = value_new_int(n % 2 ? ns[n / 2] : (ns[n / 2 - 1] + ns[n / 2]) / 2);
+    t->tuple.elems[3] = value_new_float(mean);
+    t->tuple.elems[4] = value_new_float(n > 1 ? sqrt(var / (double)(n - 1)) : 0.0);
+    t->tuple.elems[5] = value_new_float((double)allocs / (double)n);
+    free(ns);
+    return t;
+}
+
 /* ------------------------------------------------------------------ register */
 
+/* Arities are minimums: extra arguments are ignored, as they always were. */
+static const NativeSig any_args   = { 0, -1, 0, { 0 } };
+static const NativeSig one_arg    = { 1, -1, 0, { 0 } };
+static const NativeSig two_args   = { 2, -1, 0, { 0 } };
+static const NativeSig three_args = { 3, -1, 0, { 0 } };
+static const NativeSig bench_args = { 2, -1, 2, {
+    1u << VAL_FUNCTION | 1u << VAL_BUILTIN_FN | 1u << VAL_SCOPE, 1u << VAL_INT } };
+static const NativeSig range_args    = { 1, 3, 3, { 1u << VAL_INT, 1u << VAL_INT, 1u << VAL_INT } };
+static const NativeSig slice_args    = { 2, 3, 3, { 1u << VAL_TUPLE | 1u << VAL_RANGE, 1u << VAL_INT, 1u << VAL_INT } };
+static const NativeSig reversed_args = { 1, 1, 1, { 1u << VAL_TUPLE | 1u << VAL_RANGE } };
+
 void builtins_register(Env *env) {
-#define REG(name, fn) do { Value *_v = value_new_builtin(fn, name); env_def(env, name, _v); value_decref(_v); } while(0)
-    REG("print",    builtin_print);
-    REG("println",  builtin_println);
-    REG("input",    builtin_input);
-    REG("int",      builtin_int);
-    REG("float",    builtin_float);
-    REG("string",   builtin_string);
-    REG("bool",     builtin_bool);
-    REG("is_null",  builtin_is_null);
-    REG("is_int",   builtin_is_int);
-    REG("is_float", builtin_is_float);
-    REG("is_string",builtin_is_string);
-    REG("type_of",  builtin_type_of);
-    REG("type",     builtin_type);
-    REG("abs",      builtin_abs);
-    REG("sqrt",     builtin_sqrt);
-    REG("pow",      builtin_pow);
-    REG("floor",    builtin_floor);
-    REG("ceil",     builtin_ceil);
-    REG("min",      builtin_min);
-    REG("max",      builtin_max);
-    REG("len",      builtin_len);
-    REG("substr",   builtin_substr);
-    REG("concat",   builtin_concat);
-    REG("assert",   builtin_assert);
+#define REG(name, fn, sig) do { Value *_v = value_new_builtin(fn, sig, name); env_def(env, name, _v); value_decref(_v); } while(0)
+    REG("print",        builtin_print,     &any_args);
+    REG("println",      builtin_println,   &any_args);
+    REG("input",        builtin_input,     &any_args);
+    REG("int",          builtin_int,       &one_arg);
+    REG("float",        builtin_float,     &one_arg);
+    REG("string",       builtin_string,    &one_arg);
+    REG("bool",         builtin_bool,      &one_arg);
+    REG("is_null",      builtin_is_null,   &one_arg);
+    REG("is_int",       builtin_is_int,    &one_arg);
+    REG("is_float",     builtin_is_float,  &one_arg);
+    REG("is_string",    builtin_is_string, &one_arg);
+    REG("type_of",      builtin_type_of,   &one_arg);
+    REG("type",         builtin_type,      &one_arg);
+    REG("freeze",       builtin_freeze,    &one_arg);
+    REG("is_frozen",    builtin_is_frozen, &one_arg);
+    REG("abs",          builtin_abs,       &one_arg);
+    REG("sqrt",         builtin_sqrt,      &one_arg);
+    REG("pow",          builtin_pow,       &two_args);
+    REG("floor",        builtin_floor,     &one_arg);
+    REG("ceil",         builtin_ceil,      &one_arg);
+    REG("min",          builtin_min,       &two_args);
+    REG("max",          builtin_max,       &two_args);
+    REG("len",          builtin_len,       &one_arg);
+    REG("range",        builtin_range,     &range_args);
+    REG("slice",        builtin_slice,     &slice_args);
+    REG("reversed",     builtin_reversed,  &reversed_args);
+    REG("substr",       builtin_substr,    &three_args);
+    REG("concat",       builtin_concat,    &any_args);
+    REG("assert",       builtin_assert,    &one_arg);
+    REG("gc_collect",   builtin_gc_collect, &any_args);
+    REG("mem_stats",    builtin_mem_stats, &any_args);
+    REG("call_stats",   builtin_call_stats, &any_args);
+    REG("__stats",      builtin_stats,     &any_args);
+    REG("heap_profile", builtin_heap_profile, &any_args);
+    REG("now_ns",       builtin_now_ns,    &any_args);
+    REG("cpu_ns",       builtin_cpu_ns,    &any_args);
+    REG("bench",        builtin_bench,     &bench_args);
 #undef REG
+    actor_register(env);
 }
@@ -0,0 +1,289 @@
+#include "gc.h"
+#include "interpreter.h"  /* for Env definition */
+#include "generator.h"
+#include "mem.h"
+#include <stdlib.h>
+
+/* ------------------------------------------------------------------ tracked set */
+
+typedef enum { GC_VALUE, GC_ENV, GC_ENTRY } GcKind;
+
+typedef struct {
+    void         *obj;
+    GcKind        kind;
+    int           refs;       /* scratch: references not explained by tracked objects */
+    unsigned char reachable;  /* scratch: reachable from an external reference */
+} GcSlot;
+
+/* One per interpreter (see MemStats.gc): objects are tracked in the heap of
+   the MemStats they are charged to, so interpreters on different threads
+   never touch each other's tables.  obj->gc_slot holds index+1 into slots[],
+   0 when untracked. */
+struct GcHeap {
+    GcSlot   *slots;
+    int       slot_count, slot_cap;
+    int       allocs_since_collect;
+    int       threshold;
+    int       collecting;
+    long long collections, reclaimed;
+    int      *mark_stack;
+    int       mark_top, mark_cap;
+};
+
+GcHeap *gc_heap_new(void) {
+    GcHeap *h = calloc(1, sizeof(GcHeap));
+    if (h) h->threshold = GC_MIN_THRESHOLD;
+    return h;
+}
+
+static void slot_set(GcSlot *s, int slot);
+
+void gc_heap_free(GcHeap *h) {
+    if (!h) return;
+    /* survivors (values a host still holds) just stop being tracked */
+    for (int i = 0; i < h->slot_count; i++) slot_set(&h->slots[i], 0);
+    free(h->slots);
+    free(h->mark_stack);
+    free(h);
+}
+
+static GcHeap *heap_of(const void *obj) {
+    MemStats *owner = mem_owner(obj);
+    return owner ? owner->gc : NULL;
+}
+
+static GcHeap *current_heap(void) {
+    MemStats *ms = mem_current();
+    return ms ? ms->gc : NULL;
+}
+
+static int track(GcHeap *h, void *obj, GcKind kind) {
+    if (h->slot_count >= h->slot_cap) {
+        h->slot_cap = h->slot_cap ? h->slot_cap * 2 : 256;
+        h->slots = realloc(h->slots, sizeof(GcSlot) * (size_t)h->slot_cap);
+    }
+    h->slots[h->slot_count].obj  = obj;
+    h->slots[h->slot_count].kind = kind;
+    h->slot_count++;
+    h->allocs_since_collect++;
+    return h->slot_count;
+}
+
+static void slot_set(GcSlot *s, int slot) {
+    switch (s->kind) {
+        case GC_VALUE: ((Value *)s->obj)->gc_slot    = slot; break;
+        case GC_ENV:   ((Env *)s->obj)->gc_slot      = slot; break;
+        case GC_ENTRY: ((EnvEntry *)s->obj)->gc_slot = slot; break;
+    }
+}
+
+static void untrack(GcHeap *h, int slot) {
+    int idx = slot - 1;
+    h->slot_count--;
+    if (idx != h->slot_count) {
+        h->slots[idx] = h->slots[h->slot_count];
+        slot_set(&h->slots[idx], slot);
+    }
+}
+
+/* Arena objects are never tracked: cycles among them are reclaimed with the
+   arena, and the slot table must not point into an arena once it is reset.
+   Nor are objects charged to no interpreter, nor pinned ones, whose heap
+   belongs to a thread blocked in a parallel loop. */
+#define TRACK(obj, kind) do { \
+        GcHeap *h_; \
+        if ((obj) && !(obj)->gc_slot && !(obj)->pinned && !mem_in_arena(obj) && (h_ = heap_of(obj))) \
+            (obj)->gc_slot = track(h_, (obj), (kind)); \
+    } while (0)
+#define UNTRACK(obj) do { \
+        if ((obj) && (obj)->gc_slot) { untrack(heap_of(obj), (obj)->gc_slot); (obj)->gc_slot = 0; } \
+    } while (0)
+
+void gc_track_value(Value *v)     { TRACK(v, GC_VALUE); }
+void gc_track_env(Env *e)         { TRACK(e, GC_ENV); }
+void gc_track_entry(EnvEntry *en) { TRACK(en, GC_ENTRY); }
+
+void gc_untrack_value(Value *v)     { UNTRACK(v); }
+void gc_untrack_env(Env *e)         { UNTRACK(e); }
+void gc_untrack_entry(EnvEntry *en) { UNTRACK(en); }
+
+/* ------------------------------------------------------------------ traversal */
+
+typedef void (*GcVisit)(int slot);
+
+static _Thread_local GcHeap *scan;   /* heap being collected on this thread */
+
+/* References into another interpreter's heap (a value a host passed from one
+   to the other) count as external, like those from untracked objects. */
+#define VISIT(obj, visit) do { if ((obj) && (obj)->gc_slot && heap_of(obj) == scan) visit((obj)->gc_slot); } while (0)
+
+static void visit_value(Value *v, GcVisit visit)     { VISIT(v, visit); }
+static void visit_env(Env *e, GcVisit visit)         { VISIT(e, visit); }
+static void visit_entry(EnvEntry *en, GcVisit visit) { VISIT(en, visit); }
+
+/* Call visit for every tracked object directly referenced by s->obj.  Shared
+   entries are objects of their own; unshared ones belong to their Env. */
+static void traverse(GcSlot *s, GcVisit visit) {
+    if (s->kind == GC_ENV) {
+        Env *e = s->obj;
+        for (EnvEntry *en = e->entries; en; en = en->next) {
+            if (en->gc_slot) visit_entry(en, visit);
+            else             visit_value(en->val, visit);
+        }
+        visit_env(e->parent, visit);
+        visit_value(e->fn, visit);
+        return;
+    }
+    if (s->kind == GC_ENTRY) {
+        visit_value(((EnvEntry *)s->obj)->val, visit);
+        return;
+    }
+    Value *v = s->obj;
+    switch (v->type) {
+        case VAL_TUPLE:
+            for (int i = 0; i < v->tuple.count; i++) visit_value(v->tuple.elems[i], visit);
+            break;
+        case VAL_PAT_INST:
+            for (int i = 0; i < v->pat_inst.count; i++) visit_value(v->pat_inst.fields[i], visit);
+            break;
+        case VAL_VARIANT:  visit_value(v->variant.val, visit);  break;
+        case VAL_OPTIONAL: visit_value(v->optional.val, visit); break;
+        case VAL_FUNCTION:
+            visit_env(v->fn.closure, visit);
+            if (v->fn.captures)
+                for (int i = 0; i < v->fn.captures->count; i++) visit_entry(v->fn.captures->entries[i], visit);
+            break;
+        case VAL_SCOPE:    visit_env(v->scope.env, visit);      break;
+        case VAL_MODULE:   visit_env(v->module.env, visit);     break;
+        case VAL_GENERATOR: {   /* a started body's frame counts as external */
+            Value *fn, *const *args;
+            int argc = gen_pending_call(v->gen, &fn, &args);
+            visit_value(fn, visit);
+            for (int i = 0; i < argc; i++) visit_value(args[i], visit);
+            break;
+        }
+        default: break;
+    }
+}
+
+static int ref_count_of(GcSlot *s) {
+    switch (s->kind) {
+        case GC_VALUE: return ((Value *)s->obj)->ref_count;
+        case GC_ENV:   return ((Env *)s->obj)->ref_count;
+        case GC_ENTRY: return ((EnvEntry *)s->obj)->ref_count;
+    }
+    return 0;
+}
+
+static void hold(GcSlot *s) {
+    switch (s->kind) {
+        case GC_VALUE: value_incref(s->obj); break;
+        case GC_ENV:   env_incref(s->obj);   break;
+        case GC_ENTRY: entry_incref(s->obj); break;
+    }
+}
+
+static void clear(GcSlot *s) {
+    switch (s->kind) {
+        case GC_VALUE: value_clear(s->obj); break;
+        case GC_ENV:   env_clear(s->obj);   break;
+        case GC_ENTRY: {
+            EnvEntry *en = s->obj;
+            Value *val = en->val;
+            en->val = NULL;
+            value_decref(val);
+            break;
+        }
+    }
+}
+
+static void release(GcSlot *s) {
+    switch (s->kind) {
+        case GC_VALUE: value_decref(s->obj); break;
+        case GC_ENV:   env_decref(s->obj);   break;
+        case GC_ENTRY: entry_decref(s->obj); break;
+    }
+}
+
+static void subtract_internal(int slot) { scan->slots[slot - 1].refs--; }
+
+static void mark_push(int slot) {
+    GcHeap *h = scan;
+    GcSlot *s = &h->slots[slot - 1];
+    if (s->reachable) return;
+    s->reachable = 1;
+    if (h->mark_top >= h->mark_cap) {
+        h->mark_cap = h->mark_cap ? h->mark_cap * 2 : 256;
+        h->mark_stack = realloc(h->mark_stack, sizeof(int) * (size_t)h->mark_cap);
+    }
+    h->mark_stack[h->mark_top++] = slot;
+}
+
+/* ------------------------------------------------------------------ collection */
+
+int gc_heap_collect(GcHeap *h) {
+    if (!h || h->collecting) return 0;
+    h->collecting = 1;
+    GcHeap *outer = scan;
+    scan = h;
+
+    /* 1. start from the real reference counts */
+    for (int i = 0; i < h->slot_count; i++) {
+        h->slots[i].refs = ref_count_of(&h->slots[i]);
+        h->slots[i].reachable = 0;
+    }
+    /* 2. subtract references held by other tracked objects */
+    for (int i = 0; i < h->slot_count; i++) traverse(&h->slots[i], subtract_internal);
+
+    /* 3. anything still referenced is held from outside; mark what it reaches */
+    h->mark_top = 0;
+    for (int i = 0; i < h->slot_count; i++) {
+        if (h->slots[i].refs > 0) mark_push(i + 1);
+    }
+    while (h->mark_top > 0) {
+        int slot = h->mark_stack[--h->mark_top];
+        traverse(&h->slots[slot - 1], mark_push);
+    }
+
+    /* 4. the rest is cyclic garbage */
+    int n = 0;
+    for (int i = 0; i < h->slot_count; i++) if (!h->slots[i].reachable) n++;
+    scan = outer;
+    if (n > 0) {
+        GcSlot *garbage = malloc(sizeof(GcSlot) * (size_t)n);
+        int gi = 0;
+        for (int i = 0; i < h->slot_count; i++) if (!h->slots[i].reachable) garbage[gi++] = h->slots[i];
+
+        /* Hold an extra reference to each object so none is freed while the
+           others are still dropping their references to it, then break every
+           reference the garbage holds and release the extra references. */
+        for (int i = 0; i < n; i++) hold(&garbage[i]);
+        for (int i = 0; i < n; i++) clear(&garbage[i]);
+        for (int i = 0; i < n; i++) release(&garbage[i]);
+        free(garbage);
+    }
+
+    h->collections++;
+    h->reclaimed += n;
+    h->allocs_since_collect = 0;
+    h->threshold = h->slot_count > GC_MIN_THRESHOLD ? h->slot_count : GC_MIN_THRESHOLD;
+    h->collecting = 0;
+    return n;
+}
+
+int gc_collect(void) {
+    return gc_heap_collect(current_heap());
+}
+
+void gc_maybe_collect(void) {
+    GcHeap *h = current_heap();
+    if (h && h->allocs_since_collect >= h->threshold) gc_heap_collect(h);
+}
+
+void gc_get_stats(GcStats *out) {
+    GcHeap *h = current_heap();
+    out->collections = h ? h->collections : 0;
+    out->reclaimed   = h ? h->reclaimed : 0;
+    out->tracked     = h ? h->slot_count : 0;
+    out->threshold   = h ? h->threshold : GC_MIN_THRESHOLD;
+}
@@ -0,0 +1,48 @@
+#ifndef GC_H
+#define GC_H
+
+#include "value.h"
+
+/* Backup cycle collector.
+ *
+ * Reference counting frees acyclic garbage as soon as the last reference goes
+ * away.  Envs and aggregate Values (tuples, pattern instances, scopes, modules,
+ * functions, optionals) can however keep each other alive — e.g. a scope value
+ * stored in a variable of its own environment.  Those objects, and variables
+ * shared between a scope and the closures that captured them, are tracked here
+ * and periodically scanned with trial deletion: every reference that comes from
+ * another tracked object is subtracted, whatever still has references left is
+ * reachable from the outside, and everything not reachable from those roots is
+ * an unreferenced cycle and gets reclaimed.
+ *
+ * Each interpreter has a heap of its own, hung off its MemStats; an object is
+ * tracked in the heap of the MemStats it is charged to, and gc_collect() and
+ * friends work on the heap of the current one (see mem_set_current). */
+
+#define GC_MIN_THRESHOLD 1000   /* tracked allocations between automatic collections */
+
+typedef struct {
+    long long collections;   /* number of completed collections */
+    long long reclaimed;     /* objects reclaimed over all collections */
+    int       tracked;       /* objects currently tracked */
+    int       threshold;     /* allocations until the next automatic collection */
+} GcStats;
+
+typedef struct GcHeap GcHeap;
+
+GcHeap *gc_heap_new(void);
+void    gc_heap_free(GcHeap *h);   /* objects still alive become untracked */
+int     gc_heap_collect(GcHeap *h);
+
+void gc_track_value(Value *v);
+void gc_untrack_value(Value *v);
+void gc_track_env(Env *e);
+void gc_untrack_env(Env *e);
+void gc_track_entry(EnvEntry *en);
+void gc_untrack_entry(EnvEntry *en);
+
+int  gc_collect(void);        /* run a full collection of the current heap; returns objects reclaimed */
+void gc_maybe_collect(void);  /* collect if enough tracked allocations happened */
+void gc_get_stats(GcStats *out);
+
+#endif /* GC_H */
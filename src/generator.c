@@ -0,0 +1,372 @@
+#define _GNU_SOURCE
+#include "generator.h"
+#include "mem.h"
+#include "profile.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/* The sanitizers follow a thread across stacks only when told about each
+   switch. */
+#if defined(__has_feature)
+#  if __has_feature(address_sanitizer) && !defined(__SANITIZE_ADDRESS__)
+#    define __SANITIZE_ADDRESS__ 1
+#  endif
+#  if __has_feature(thread_sanitizer) && !defined(__SANITIZE_THREAD__)
+#    define __SANITIZE_THREAD__ 1
+#  endif
+#endif
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/asan_interface.h>
+#include <sanitizer/common_interface_defs.h>
+#endif
+#ifdef __SANITIZE_THREAD__
+#include <sanitizer/tsan_interface.h>
+#endif
+
+/* A body gets as much stack as the main thread may grow to (RLIMIT_STACK),
+   within these bounds: the evaluator takes a few KB per call it nests, and
+   the mapping is only reserved, its pages committed as the body touches them. */
+#define GEN_STACK_MIN (1024 * 1024)
+#define GEN_STACK_MAX (64 * 1024 * 1024)
+
+/* swapcontext saves and restores the signal mask, a system call each way,
+   which would cost more than the body usually runs between two yields.  On
+   x86-64 a switch saves the callee-saved registers on the stack it leaves and
+   moves the stack pointer; elsewhere ucontext does the job. */
+#if defined(__x86_64__)
+#define GEN_FAST_SWITCH 1
+/* Store the stack pointer in *save and continue on the stack at load. */
+void gen_switch(void **save, void *load);
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    ".type gen_switch, @function\n"
+    "gen_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size gen_switch, .-gen_switch\n");
+#else
+#include <ucontext.h>
+#endif
+
+typedef enum { GEN_NEW, GEN_SUSPENDED, GEN_RUNNING, GEN_DONE } GenState;
+
+struct Generator {
+    Value       *fn;            /* the call, until the body has run */
+    Value      **args;
+    int          argc;
+    int          line, col;     /* call site */
+    GenState     state;
+    int          closing;       /* resumed only to unwind, see gen_free */
+    Interpreter *owner;
+#ifdef GEN_FAST_SWITCH
+    void        *sp;            /* the body's stack pointer, while suspended */
+    void        *caller_sp;     /* whoever resumed it, while it runs */
+#else
+    ucontext_t   ctx;
+    ucontext_t   caller;
+#endif
+    char        *map;           /* mmap'd stack with a guard page, or NULL */
+    size_t       map_size;
+    char        *stack;         /* usable part of map */
+    size_t       stack_size;
+    Value       *out;           /* what the last yield handed over */
+    int          failed;
+    char         error[256];
+    int          prof_depth;    /* profiler frames the body had open when it yielded */
+    Generator   *resumer;       /* generator running when this one was resumed */
+    Generator   *prev, *next;   /* owner's generators with a stack, see gen_close_all */
+#ifdef __SANITIZE_ADDRESS__
+    const void  *caller_bottom; /* stack of whoever resumed it */
+    size_t       caller_size;
+#endif
+#ifdef __SANITIZE_THREAD__
+    void        *fiber, *caller_fiber;
+#endif
+};
+
+/* Innermost generator running on this thread, the one a yield suspends. */
+static _Thread_local Generator *running;
+
+static size_t         stack_size;
+static pthread_once_t stack_size_once = PTHREAD_ONCE_INIT;
+
+static void find_stack_size(void) {
+    struct rlimit rl;
+    size_t size = GEN_STACK_MAX;
+    if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < GEN_STACK_MAX)
+        size = rl.rlim_cur < GEN_STACK_MIN ? GEN_STACK_MIN : (size_t)rl.rlim_cur;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    stack_size = (size + page - 1) / page * page;
+}
+
+Value *gen_new(Value *fn, Value **args, int argc, int line, int col) {
+    Generator *g = mem_calloc(1, sizeof(Generator));
+    g->fn = fn;
+    value_incref(fn);
+    if (argc > 0) {
+        g->args = mem_calloc((size_t)argc, sizeof(Value *));
+        for (int i = 0; i < argc; i++) {
+            g->args[i] = args[i];
+            value_incref(args[i]);
+        }
+    }
+    g->argc = argc;
+    g->line = line;
+    g->col = col;
+    g->owner = interp_current();
+    return value_new_generator(g);
+}
+
+int gen_pending_call(const Generator *g, Value **fn, Value *const **args) {
+    if (g->state != GEN_NEW) {
+        *fn = NULL;
+        *args = NULL;
+        return 0;
+    }
+    *fn = g->fn;
+    *args = g->args;
+    return g->argc;
+}
+
+static void release_call(Generator *g) {
+    for (int i = 0; i < g->argc; i++) value_decref(g->args[i]);
+    mem_free(g->args);
+    value_decref(g->fn);
+    g->args = NULL;
+    g->argc = 0;
+    g->fn = NULL;
+}
+
+/* ------------------------------------------------------------------ switching */
+
+/* From whoever resumes g into its body, and back once it yields or ends. */
+static void enter_body(Generator *g) {
+#ifdef __SANITIZE_ADDRESS__
+    void *fake_stack = NULL;
+    __sanitizer_start_switch_fiber(&fake_stack, g->stack, g->stack_size);
+#endif
+#ifdef __SANITIZE_THREAD__
+    g->caller_fiber = __tsan_get_current_fiber();
+    __tsan_switch_to_fiber(g->fiber, 0);
+#endif
+#ifdef GEN_FAST_SWITCH
+    gen_switch(&g->caller_sp, g->sp);
+#else
+    swapcontext(&g->caller, &g->ctx);
+#endif
+#ifdef __SANITIZE_ADDRESS__
+    __sanitizer_finish_switch_fiber(fake_stack, NULL, NULL);
+#endif
+}
+
+/* From g's body back to whoever resumed it; returns when resumed again,
+   which a finished body never is. */
+static void leave_body(Generator *g) {
+#ifdef __SANITIZE_ADDRESS__
+    void *fake_stack = NULL;
+    __sanitizer_start_switch_fiber(g->state == GEN_DONE ? NULL : &fake_stack, g->caller_bottom, g->caller_size);
+#endif
+#ifdef __SANITIZE_THREAD__
+    __tsan_switch_to_fiber(g->caller_fiber, 0);
+#endif
+#ifdef GEN_FAST_SWITCH
+    gen_switch(&g->sp, g->caller_sp);
+#else
+    swapcontext(&g->ctx, &g->caller);
+#endif
+#ifdef __SANITIZE_ADDRESS__
+    __sanitizer_finish_switch_fiber(fake_stack, &g->caller_bottom, &g->caller_size);
+#endif
+}
+
+static void gen_main(void) {
+    Generator *g = running;
+#ifdef __SANITIZE_ADDRESS__
+    __sanitizer_finish_switch_fiber(NULL, &g->caller_bottom, &g->caller_size);
+#endif
+    EvalResult r = interp_call_body(g->fn, g->args, g->argc, g->line, g->col);
+    if (r.sig == SIG_ERROR && !g->closing) {
+        g->failed = 1;
+        memcpy(g->error, r.error_msg, sizeof(g->error));
+    }
+    value_decref(r.val);
+    release_call(g);
+    g->state = GEN_DONE;
+    leave_body(g);
+}
+
+static void stack_free(Generator *g) {
+    if (!g->stack) return;
+    if (g->next) g->next->prev = g->prev;
+    if (g->prev) g->prev->next = g->next;
+    else         g->owner->generators = g->next;
+    g->prev = g->next = NULL;
+    munmap(g->map, g->map_size);
+#ifdef __SANITIZE_THREAD__
+    __tsan_destroy_fiber(g->fiber);
+#endif
+    g->map = g->stack = NULL;
+}
+
+static void stack_release(void *g) { stack_free(g); }
+
+/* A stack for g's body: a mapping of its own, so that running off its end
+   faults on the guard page, and uncharged like the main thread's stack.  An
+   arena generator dropped with its arena unwalked has it unmapped by the
+   reset. */
+static int stack_new(Generator *g) {
+    pthread_once(&stack_size_once, find_stack_size);
+    g->stack_size = stack_size;
+    size_t guard = (size_t)sysconf(_SC_PAGESIZE);
+    g->map_size = g->stack_size + guard;
+    g->map = mmap(NULL, g->map_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+    if (g->map == MAP_FAILED) { g->map = NULL; return -1; }
+    if (mem_in_arena(g) && mem_arena_on_reset(stack_release, g) != 0) {
+        munmap(g->map, g->map_size);
+        g->map = NULL;
+        return -1;
+    }
+    mprotect(g->map, guard, PROT_NONE);
+    g->stack = g->map + guard;
+#ifdef __SANITIZE_ADDRESS__
+    /* the frames of an earlier stack at the same address left poison behind */
+    __asan_unpoison_memory_region(g->stack, g->stack_size);
+#endif
+#ifdef GEN_FAST_SWITCH
+    /* What gen_switch pops: control words, six registers, and the address
+       it returns to, gen_main, entered as if called (it never returns). */
+    void **sp = (void **)(g->stack + g->stack_size);
+    *--sp = NULL;
+    *--sp = (void *)(uintptr_t)gen_main;
+    for (int i = 0; i < 6; i++) *--sp = NULL;
+    unsigned int csr[2] = { 0, 0 };
+    __asm__ volatile("stmxcsr %0" : "=m"(csr[0]));
+    __asm__ volatile("fnstcw %0" : "=m"(csr[1]));
+    *--sp = NULL;
+    memcpy(sp, csr, sizeof(void *));
+    g->sp = sp;
+#else
+    getcontext(&g->ctx);
+    g->ctx.uc_stack.ss_sp = g->stack;
+    g->ctx.uc_stack.ss_size = g->stack_size;
+    g->ctx.uc_link = NULL;
+    makecontext(&g->ctx, gen_main, 0);
+#endif
+#ifdef __SANITIZE_THREAD__
+    g->fiber = __tsan_create_fiber(0);
+#endif
+    g->next = g->owner->generators;
+    if (g->next) g->next->prev = g;
+    g->owner->generators = g;
+    return 0;
+}
+
+/* Run g's body until it yields or ends.  Profiler frames the body has open
+   when it yields are set aside, so the resumer's shadow stack is its own. */
+static void resume(Generator *g) {
+    int depth = prof_stack.depth;
+    prof_stack.depth = depth + g->prof_depth;
+    g->resumer = running;
+    running = g;
+    g->state = GEN_RUNNING;
+    enter_body(g);
+    running = g->resumer;
+    g->prof_depth = prof_stack.depth - depth;
+    prof_stack.depth = depth;
+    if (g->state == GEN_DONE) stack_free(g);
+}
+
+/* ------------------------------------------------------------------ API */
+
+const char *gen_cannot_resume(const Generator *g) {
+    if (g->state == GEN_RUNNING) return "cannot resume a generator that is already running";
+    if (g->owner != interp_current()) return "cannot resume a generator made by another interpreter";
+    return NULL;
+}
+
+int gen_next(Generator *g, Value **out, EvalResult *fail) {
+    if (g->state == GEN_DONE) return 0;
+    if (g->state == GEN_NEW && stack_new(g) != 0) {
+        g->state = GEN_DONE;
+        release_call(g);
+        fail->sig = SIG_ERROR;
+        fail->val = NULL;
+        snprintf(fail->error_msg, sizeof(fail->error_msg),
+                 "Runtime error at line %d col %d: out of memory for a generator stack", g->line, g->col);
+        return -1;
+    }
+    resume(g);
+    if (g->state == GEN_DONE) {
+        if (!g->failed) return 0;
+        g->failed = 0;
+        fail->sig = SIG_ERROR;
+        fail->val = NULL;
+        memcpy(fail->error_msg, g->error, sizeof(fail->error_msg));
+        return -1;
+    }
+    *out = g->out;
+    g->out = NULL;
+    return 1;
+}
+
+int gen_yield(Value *v) {
+    Generator *g = running;
+    if (!g || g->closing) {
+        value_decref(v);
+        return g ? 1 : -1;
+    }
+    g->out = v;
+    g->state = GEN_SUSPENDED;
+    leave_body(g);
+    return g->closing;
+}
+
+/* Resume a suspended g only to unwind its body, which then finishes. */
+static void close_body(Generator *g) {
+    g->closing = 1;
+    resume(g);
+}
+
+void gen_close_all(Interpreter *interp) {
+    Generator *g = interp->generators;
+    while (g) {
+        if (g->state != GEN_SUSPENDED) { g = g->next; continue; }
+        close_body(g);
+        g = interp->generators;   /* unwinding may have freed others */
+    }
+}
+
+void gen_free(Generator *g) {
+    if (!g) return;
+    if (g->state == GEN_SUSPENDED) close_body(g);
+    value_decref(g->out);
+    if (g->fn) release_call(g);
+    stack_free(g);
+    mem_free(g);
+}
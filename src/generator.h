@@ -0,0 +1,58 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+/* Generators.
+ *
+ * Calling a function declared with the generator attribute
+ * (fn name(...) :: generator { ... }) does not run its body: it returns a
+ * generator, and a for loop over that generator runs the body a piece at a
+ * time.  Each yield in the body hands one value to the loop and suspends the
+ * body right there, its frame intact, until the loop asks for the next one;
+ * the generator is finished when the body returns.  So a pipeline of
+ * generators holds one value per stage at a time, however long the sequence.
+ *
+ * The body runs as a stackful coroutine on a stack of its own, reserved as
+ * large as the main thread's may grow (RLIMIT_STACK, 1 to 64 MiB), since the
+ * tree-walking evaluator keeps the state of a suspended frame on the C
+ * stack.  A generator belongs to the interpreter that called the function
+ * and is resumed only on that interpreter's thread; functions, generators
+ * and what they hold are never shared with other threads.  A suspended
+ * generator dropped before it finished is unwound: its yield fails once more
+ * so that everything the body holds is released.
+ *
+ * An arena generator still gets a stack of its own; one dropped with its
+ * arena unwalked has its suspended body discarded rather than unwound, and
+ * the reset unmaps the stack.  The cycle collector sees the call of a
+ * generator not yet started but not into a suspended frame, so what a
+ * suspended generator holds stays alive until the generator itself is
+ * dropped or its interpreter freed. */
+
+#include "interpreter.h"
+
+Value *gen_new(Value *fn, Value **args, int argc, int line, int col);
+void   gen_free(Generator *g);
+
+/* Unwind every suspended generator of interp, as when it is dropped, so
+   their frames release what they hold; interp_free does this first. */
+void   gen_close_all(Interpreter *interp);
+
+/* The call a generator has not started yet, for the cycle collector: its
+   argument count, with *fn and *args set; 0 and NULL once the body runs. */
+int    gen_pending_call(const Generator *g, Value **fn, Value *const **args);
+
+/* Why g cannot be resumed here and now, NULL if it can. */
+const char *gen_cannot_resume(const Generator *g);
+
+/* Run g up to its next yield.  Returns 1 with a new reference to the value in
+   *out, 0 once g has finished, -1 when its body failed, with the error in
+   *fail. */
+int gen_next(Generator *g, Value **out, EvalResult *fail);
+
+/* For a yield in a generator body: hand v (a reference the generator takes)
+   to whoever resumed the running generator and suspend until the next
+   resume.  Returns 0 when resumed for more, nonzero when the generator is
+   being dropped and the body must unwind; -1 at once with no generator
+   running on this thread. */
+int gen_yield(Value *v);
+
+#endif /* GENERATOR_H */
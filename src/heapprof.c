@@ -0,0 +1,324 @@
+#include "heapprof.h"
+#include "mem.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+int heapprof_active;
+_Thread_local int heapprof_line;
+_Thread_local const char *heapprof_where;
+
+/* ------------------------------------------------------------------ live samples */
+
+/* Bookkeeping uses plain malloc so the profiler does not sample itself. */
+typedef struct Sample {
+    void          *p;
+    const char    *where;   /* interned */
+    int            line;
+    size_t         size, weight;
+    struct Sample *next;
+} Sample;
+
+#define SAMPLE_BUCKETS 4096
+
+static Sample     *buckets[SAMPLE_BUCKETS];
+static atomic_flag lock = ATOMIC_FLAG_INIT;
+
+static void lock_samples(void)   { while (atomic_flag_test_and_set_explicit(&lock, memory_order_acquire)) ; }
+static void unlock_samples(void) { atomic_flag_clear_explicit(&lock, memory_order_release); }
+
+/* Names of functions and modules outlive neither, so samples keep a copy,
+   one per distinct name.  Called with the samples locked. */
+typedef struct Name {
+    struct Name *next;
+    char         text[];
+} Name;
+
+#define NAME_BUCKETS 256
+
+static Name *names[NAME_BUCKETS];
+
+static const char *intern(const char *s) {
+    if (!s) return NULL;
+    unsigned h = 2166136261u;
+    for (const char *c = s; *c; c++) h = (h ^ (unsigned char)*c) * 16777619u;
+    Name **b = &names[h % NAME_BUCKETS];
+    for (Name *n = *b; n; n = n->next)
+        if (strcmp(n->text, s) == 0) return n->text;
+    size_t len = strlen(s) + 1;
+    Name *n = malloc(sizeof(Name) + len);
+    if (!n) return "?";
+    memcpy(n->text, s, len);
+    n->next = *b;
+    *b = n;
+    return n->text;
+}
+
+static unsigned bucket_of(const void *p) {
+    unsigned long long x = (unsigned long long)(size_t)p >> 4;
+    return (unsigned)((x ^ (x >> 13) ^ (x >> 29)) % SAMPLE_BUCKETS);
+}
+
+static void on_alloc(void *p, size_t size, size_t weight) {
+    Sample *s = malloc(sizeof(Sample));
+    if (!s) return;
+    s->p = p;
+    s->line = heapprof_line;
+    s->size = size ? size : 1;
+    s->weight = weight;
+    unsigned b = bucket_of(p);
+    lock_samples();
+    s->where = intern(heapprof_where);
+    s->next = buckets[b];
+    buckets[b] = s;
+    unlock_samples();
+}
+
+static void on_free(void *p) {
+    unsigned b = bucket_of(p);
+    lock_samples();
+    for (Sample **sp = &buckets[b]; *sp; sp = &(*sp)->next) {
+        if ((*sp)->p == p) {
+            Sample *s = *sp;
+            *sp = s->next;
+            free(s);
+            break;
+        }
+    }
+    unlock_samples();
+}
+
+void heapprof_start(size_t interval) {
+    heapprof_active = 1;
+    mem_set_sampling(interval ? interval : HEAPPROF_DEFAULT_INTERVAL, on_alloc, on_free);
+}
+
+/* Sampled blocks may still be freed later, so the hooks stay installed. */
+void heapprof_stop(void) {
+    mem_set_sampling(0, on_alloc, on_free);
+    heapprof_active = 0;
+}
+
+/* ------------------------------------------------------------------ sites */
+
+static HeapSite *sites;
+
+/* Interned, so equal names are equal pointers; NULL (the main script) first. */
+static int by_where(const char *x, const char *y) {
+    if (x == y) return 0;
+    if (!x || !y) return x ? 1 : -1;
+    return strcmp(x, y);
+}
+
+static int by_site(const void *a, const void *b) {
+    const HeapSite *x = a, *y = b;
+    int c = by_where(x->where, y->where);
+    return c ? c : x->line - y->line;
+}
+
+static int by_bytes(const void *a, const void *b) {
+    const HeapSite *x = a, *y = b;
+    if (x->bytes != y->bytes) return x->bytes < y->bytes ? 1 : -1;
+    return by_site(a, b);
+}
+
+int heapprof_sites(const HeapSite **out) {
+    int n = 0, cap = 64;
+    free(sites);
+    sites = malloc(sizeof(HeapSite) * (size_t)cap);
+    lock_samples();
+    for (int b = 0; b < SAMPLE_BUCKETS; b++) {
+        for (Sample *s = buckets[b]; s; s = s->next) {
+            if (n >= cap) { cap *= 2; sites = realloc(sites, sizeof(HeapSite) * (size_t)cap); }
+            long long objs = (long long)(s->weight / s->size);
+            sites[n].where   = s->where;
+            sites[n].line    = s->line;
+            sites[n].samples = 1;
+            sites[n].objects = objs ? objs : 1;
+            sites[n].bytes   = (long long)s->weight;
+            n++;
+        }
+    }
+    unlock_samples();
+
+    /* merge samples of the same site */
+    qsort(sites, (size_t)n, sizeof(HeapSite), by_site);
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (m > 0 && by_site(&sites[m - 1], &sites[i]) == 0) {
+            sites[m - 1].samples += sites[i].samples;
+            sites[m - 1].objects += sites[i].objects;
+            sites[m - 1].bytes   += sites[i].bytes;
+        } else {
+            sites[m++] = sites[i];
+        }
+    }
+    qsort(sites, (size_t)m, sizeof(HeapSite), by_bytes);
+    *out = sites;
+    return m;
+}
+
+/* ------------------------------------------------------------------ retained */
+
+typedef enum { OBJ_VALUE, OBJ_ENV, OBJ_ENTRY } ObjKind;
+
+typedef struct { const void *p; ObjKind kind; } Obj;
+
+static const void **seen;            /* open-addressed pointer set */
+static size_t       seen_cap, seen_count;
+static Obj         *stack;
+static size_t       stack_len, stack_cap;
+static HeapRetained *retained;
+
+static size_t hash_ptr(const void *p) {
+    unsigned long long x = (unsigned long long)(size_t)p;
+    x ^= x >> 33; x *= 0xff51afd7ed558ccdULL; x ^= x >> 33;
+    return (size_t)x;
+}
+
+static void seen_insert_raw(const void *p) {
+    size_t j = hash_ptr(p) & (seen_cap - 1);
+    while (seen[j]) j = (j + 1) & (seen_cap - 1);
+    seen[j] = p;
+}
+
+/* Returns 1 if p was not seen before. */
+static int mark(const void *p) {
+    if (seen_cap) {
+        size_t j = hash_ptr(p) & (seen_cap - 1);
+        for (; seen[j]; j = (j + 1) & (seen_cap - 1))
+            if (seen[j] == p) return 0;
+    }
+    if ((seen_count + 1) * 2 > seen_cap) {
+        const void **old = seen;
+        size_t old_cap = seen_cap;
+        seen_cap = seen_cap ? seen_cap * 2 : 1024;
+        seen = calloc(seen_cap, sizeof(void *));
+        for (size_t i = 0; i < old_cap; i++) if (old[i]) seen_insert_raw(old[i]);
+        free(old);
+    }
+    seen_insert_raw(p);
+    seen_count++;
+    return 1;
+}
+
+static void push(const void *p, ObjKind kind) {
+    if (!p || !mark(p)) return;
+    if (stack_len >= stack_cap) {
+        stack_cap = stack_cap ? stack_cap * 2 : 256;
+        stack = realloc(stack, sizeof(Obj) * stack_cap);
+    }
+    stack[stack_len].p = p;
+    stack[stack_len].kind = kind;
+    stack_len++;
+}
+
+/* Bytes owned by one object, pushing the objects it references. */
+static size_t visit(Obj o, const Env *global) {
+    size_t bytes = mem_block_size(o.p);
+    if (o.kind == OBJ_ENTRY) {
+        const EnvEntry *en = o.p;
+        push(en->val, OBJ_VALUE);
+        return bytes + mem_block_size(en->name);
+    }
+    if (o.kind == OBJ_ENV) {
+        const Env *e = o.p;
+        for (EnvEntry *en = e->entries; en; en = en->next) {
+            bytes += mem_block_size(en) + mem_block_size(en->name);
+            push(en->val, OBJ_VALUE);
+        }
+        if (e->parent != global) push(e->parent, OBJ_ENV);
+        push(e->fn, OBJ_VALUE);
+        return bytes;
+    }
+    const Value *v = o.p;
+    switch (v->type) {
+        case VAL_STRING: bytes += mem_block_size(v->str_val); break;
+        case VAL_TUPLE:
+            bytes += mem_block_size(v->tuple.elems) + mem_block_size(v->tuple.names);
+            for (int i = 0; i < v->tuple.count; i++) {
+                if (v->tuple.names) bytes += mem_block_size(v->tuple.names[i]);
+                push(v->tuple.elems[i], OBJ_VALUE);
+            }
+            break;
+        case VAL_PAT_INST:
+            bytes += mem_block_size(v->pat_inst.fields);
+            for (int i = 0; i < v->pat_inst.count; i++) push(v->pat_inst.fields[i], OBJ_VALUE);
+            break;
+        case VAL_VARIANT:  push(v->variant.val, OBJ_VALUE);  break;
+        case VAL_OPTIONAL: push(v->optional.val, OBJ_VALUE); break;
+        case VAL_FUNCTION:
+            bytes += mem_block_size(v->fn.name) + mem_block_size(v->fn.captures);
+            if (v->fn.closure != global) push(v->fn.closure, OBJ_ENV);
+            if (v->fn.captures)
+                for (int i = 0; i < v->fn.captures->count; i++) push(v->fn.captures->entries[i], OBJ_ENTRY);
+            break;
+        case VAL_SCOPE:
+            if (v->scope.env != global) push(v->scope.env, OBJ_ENV);
+            break;
+        case VAL_MODULE:
+            bytes += mem_block_size(v->module.name);
+            if (v->module.env != global) push(v->module.env, OBJ_ENV);
+            break;
+        case VAL_TYPE:       bytes += mem_block_size(v->type_val.type_name); break;
+        case VAL_BUILTIN_FN: bytes += mem_block_size(v->builtin.name);      break;
+        default: break;
+    }
+    return bytes;
+}
+
+static int by_retained(const void *a, const void *b) {
+    const HeapRetained *x = a, *y = b;
+    if (x->bytes != y->bytes) return x->bytes < y->bytes ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+int heapprof_retained(Env *global, const HeapRetained **out) {
+    int n = 0, cap = 64;
+    free(retained);
+    retained = malloc(sizeof(HeapRetained) * (size_t)cap);
+    seen_count = 0;
+    if (seen) memset(seen, 0, sizeof(void *) * seen_cap);
+    mark(global);
+
+    for (EnvEntry *en = global ? global->entries : NULL; en; en = en->next) {
+        if (!en->val || en->val->type == VAL_BUILTIN_FN) continue;
+        long long objects = 0, bytes = 0;
+        push(en->val, OBJ_VALUE);
+        while (stack_len > 0) {
+            Obj o = stack[--stack_len];
+            bytes += (long long)visit(o, global);
+            objects++;
+        }
+        if (!objects) continue;   /* everything already charged to an earlier binding */
+        if (n >= cap) { cap *= 2; retained = realloc(retained, sizeof(HeapRetained) * (size_t)cap); }
+        retained[n].name    = en->name;
+        retained[n].objects = objects;
+        retained[n].bytes   = bytes;
+        n++;
+    }
+    qsort(retained, (size_t)n, sizeof(HeapRetained), by_retained);
+    *out = retained;
+    return n;
+}
+
+void heapprof_report(Env *global, FILE *f) {
+    const HeapSite *s;
+    int n = heapprof_sites(&s);
+    fprintf(f, "live heap by allocation site (sampled)\n");
+    fprintf(f, "%-24s %10s %12s %14s\n", "site", "samples", "objects", "bytes");
+    for (int i = 0; i < n; i++) {
+        char site[128];
+        if (!s[i].line)    snprintf(site, sizeof(site), "<startup>");
+        else if (s[i].where) snprintf(site, sizeof(site), "%s:%d", s[i].where, s[i].line);
+        else               snprintf(site, sizeof(site), "line %d", s[i].line);
+        fprintf(f, "%-24s %10lld %12lld %14lld\n", site, s[i].samples, s[i].objects, s[i].bytes);
+    }
+
+    const HeapRetained *r;
+    int m = heapprof_retained(global, &r);
+    fprintf(f, "\nretained from the global environment\n");
+    fprintf(f, "%-24s %12s %14s\n", "binding", "objects", "bytes");
+    for (int i = 0; i < m; i++)
+        fprintf(f, "%-24s %12lld %14lld\n", r[i].name, r[i].objects, r[i].bytes);
+}
@@ -0,0 +1,56 @@
+#ifndef HEAPPROF_H
+#define HEAPPROF_H
+
+#include "interpreter.h"
+#include <stdio.h>
+
+/* Heap profiler.
+ *
+ * Samples allocations through mem_set_sampling (one per interval bytes on
+ * average) and tags each sample with the script line whose statement was
+ * being evaluated, and with where that line is: the script function being
+ * called, the path of the module whose body is running, or neither in the
+ * main script's own top level.  Samples leave the profile when their block is freed, so
+ * the per-site report shows what is still live: estimated objects and bytes,
+ * scaled up by the bytes each sample stands for.  The retained breakdown
+ * walks every value reachable from the global environment and charges each
+ * object to the first global binding through which it is reached. */
+
+#define HEAPPROF_DEFAULT_INTERVAL (512 * 1024)
+
+extern int heapprof_active;
+extern _Thread_local int heapprof_line;   /* line of the statement being evaluated */
+extern _Thread_local const char *heapprof_where;   /* function or module it is in, NULL = main script */
+
+/* Record the statement about to be evaluated as the allocation site. */
+static inline void heapprof_at(int line) {
+    if (heapprof_active) heapprof_line = line;
+}
+
+typedef struct {
+    const char *where;   /* see heapprof_where; valid as long as the profiler */
+    int       line;
+    long long samples;
+    long long objects;   /* estimated live blocks */
+    long long bytes;     /* estimated live bytes */
+} HeapSite;
+
+typedef struct {
+    const char *name;    /* global binding */
+    long long   objects;
+    long long   bytes;
+} HeapRetained;
+
+void heapprof_start(size_t interval);   /* 0 = HEAPPROF_DEFAULT_INTERVAL; 1 = every allocation */
+void heapprof_stop(void);
+
+/* Live sites sorted by bytes, largest first; valid until the next call. */
+int heapprof_sites(const HeapSite **out);
+
+/* Retained size per binding of global, largest first; valid until the next
+   call. */
+int heapprof_retained(Env *global, const HeapRetained **out);
+
+void heapprof_report(Env *global, FILE *f);
+
+#endif /* HEAPPROF_H */
@@ -0,0 +1,214 @@
+#define _POSIX_C_SOURCE 200809L
+#include "instrument.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int instr_active;
+
+/* Bookkeeping uses plain malloc so it is not charged to the interpreter. */
+typedef struct {
+    InstrEntry  e;
+    const void *key;
+    int         active;   /* activations currently on the stack */
+} Entry;
+
+typedef struct {
+    int       entry;
+    long long start_ns;
+    long long child_ns;      /* inclusive time of direct callees */
+    long long start_allocs;
+    long long child_allocs;  /* allocations made under direct callees */
+} Frame;
+
+static _Thread_local Entry      *entries;
+static _Thread_local int         entry_count, entry_cap;
+static _Thread_local int        *index_of;     /* open-addressed key -> entry, -1 = empty */
+static _Thread_local int         index_cap;
+static _Thread_local Frame      *frames;
+static _Thread_local int         depth, frame_cap;
+static _Thread_local InstrEntry *sorted;
+
+void instr_enable(int on) { instr_active = on; }
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long allocs_now(void) {
+    MemStats *ms = mem_current();
+    return ms ? ms->allocs : 0;
+}
+
+static unsigned hash_ptr(const void *p) {
+    unsigned long long x = (unsigned long long)(size_t)p;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (unsigned)x;
+}
+
+static unsigned hash_str(const char *s) {
+    unsigned h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+/* Entries without a key are builtins, told apart by name. */
+static unsigned hash_key(const void *key, const char *name) {
+    return key ? hash_ptr(key) : hash_str(name);
+}
+
+static int same_callee(const Entry *en, const void *key, const char *name) {
+    return en->key == key && (key || strcmp(en->e.name, name) == 0);
+}
+
+static void index_insert(int idx) {
+    int j = (int)(hash_key(entries[idx].key, entries[idx].e.name) & (unsigned)(index_cap - 1));
+    while (index_of[j] >= 0) j = (j + 1) & (index_cap - 1);
+    index_of[j] = idx;
+}
+
+static int lookup(const void *key, InstrKind kind, const char *name, int line) {
+    if (index_cap) {
+        int j = (int)(hash_key(key, name) & (unsigned)(index_cap - 1));
+        while (index_of[j] >= 0) {
+            if (same_callee(&entries[index_of[j]], key, name)) return index_of[j];
+            j = (j + 1) & (index_cap - 1);
+        }
+    }
+    if (entry_count >= entry_cap) {
+        entry_cap = entry_cap ? entry_cap * 2 : 64;
+        entries = realloc(entries, sizeof(Entry) * (size_t)entry_cap);
+    }
+    Entry *en = &entries[entry_count];
+    memset(en, 0, sizeof(*en));
+    en->key    = key;
+    en->e.kind = kind;
+    en->e.line = line;
+    en->e.name = strcpy(malloc(strlen(name) + 1), name);
+    int idx = entry_count++;
+
+    if (entry_count * 2 > index_cap) {
+        free(index_of);
+        index_cap = index_cap ? index_cap * 2 : 128;
+        index_of = malloc(sizeof(int) * (size_t)index_cap);
+        memset(index_of, -1, sizeof(int) * (size_t)index_cap);
+        for (int i = 0; i < entry_count; i++) index_insert(i);
+    } else {
+        index_insert(idx);
+    }
+    return idx;
+}
+
+void instr_enter(const void *key, InstrKind kind, const char *name, int line) {
+    int idx = lookup(key, kind, name, line);
+    if (depth >= frame_cap) {
+        frame_cap = frame_cap ? frame_cap * 2 : 64;
+        frames = realloc(frames, sizeof(Frame) * (size_t)frame_cap);
+    }
+    Frame *f = &frames[depth++];
+    f->entry        = idx;
+    f->child_ns     = 0;
+    f->child_allocs = 0;
+    entries[idx].active++;
+    entries[idx].e.calls++;
+    f->start_allocs = allocs_now();
+    f->start_ns     = now_ns();
+}
+
+void instr_leave(void) {
+    long long end = now_ns();
+    if (depth == 0) return;
+    Frame *f = &frames[--depth];
+    Entry *en = &entries[f->entry];
+    long long incl   = end - f->start_ns;
+    long long allocs = allocs_now() - f->start_allocs;
+
+    en->e.excl_ns += incl - f->child_ns;
+    en->e.allocs  += allocs - f->child_allocs;
+    if (--en->active == 0) en->e.incl_ns += incl;
+    if (depth > 0) {
+        frames[depth - 1].child_ns     += incl;
+        frames[depth - 1].child_allocs += allocs;
+    }
+}
+
+static int by_exclusive(const void *a, const void *b) {
+    const InstrEntry *x = a, *y = b;
+    if (x->excl_ns != y->excl_ns) return x->excl_ns < y->excl_ns ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+int instr_entries(const InstrEntry **out) {
+    free(sorted);
+    sorted = malloc(sizeof(InstrEntry) * (size_t)(entry_count ? entry_count : 1));
+    for (int i = 0; i < entry_count; i++) sorted[i] = entries[i].e;
+    qsort(sorted, (size_t)entry_count, sizeof(InstrEntry), by_exclusive);
+    *out = sorted;
+    return entry_count;
+}
+
+static const char *kind_name(InstrKind k) {
+    switch (k) {
+        case INSTR_FUNCTION: return "function";
+        case INSTR_BUILTIN:  return "builtin";
+        case INSTR_PATTERN:  return "pattern";
+    }
+    return "?";
+}
+
+void instr_print_table(FILE *f) {
+    const InstrEntry *es;
+    int n = instr_entries(&es);
+    fprintf(f, "%-24s %-8s %10s %12s %12s %10s\n",
+            "function", "kind", "calls", "incl ms", "excl ms", "allocs");
+    for (int i = 0; i < n; i++) {
+        char name[64];
+        if (es[i].line) snprintf(name, sizeof(name), "%s:%d", es[i].name, es[i].line);
+        else            snprintf(name, sizeof(name), "%s", es[i].name);
+        fprintf(f, "%-24s %-8s %10lld %12.3f %12.3f %10lld\n", name, kind_name(es[i].kind),
+                es[i].calls, es[i].incl_ns / 1e6, es[i].excl_ns / 1e6, es[i].allocs);
+    }
+}
+
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        if ((unsigned char)*s < 0x20) fprintf(f, "\\u%04x", *s);
+        else fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+int instr_write_json(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) { perror(path); return -1; }
+    const InstrEntry *es;
+    int n = instr_entries(&es);
+    fprintf(f, "{\"functions\": [");
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "%s\n  {\"name\": ", i ? "," : "");
+        json_string(f, es[i].name);
+        fprintf(f, ", \"kind\": \"%s\", \"line\": %d, \"calls\": %lld, \"inclusive_ns\": %lld,"
+                   " \"exclusive_ns\": %lld, \"allocs\": %lld}",
+                kind_name(es[i].kind), es[i].line, es[i].calls, es[i].incl_ns, es[i].excl_ns, es[i].allocs);
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return 0;
+}
+
+void instr_reset(void) {
+    for (int i = 0; i < entry_count; i++) free((char *)entries[i].e.name);
+    free(entries);
+    free(index_of);
+    free(frames);
+    free(sorted);
+    entries = NULL; index_of = NULL; frames = NULL; sorted = NULL;
+    entry_count = entry_cap = index_cap = depth = frame_cap = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdio.h>
+
+/* Deterministic call instrumentation.
+ *
+ * When enabled, eval_fn_call brackets every call of a script function, builtin
+ * or pattern constructor with instr_enter/instr_leave, which count calls and
+ * measure inclusive and exclusive time on the monotonic clock together with the
+ * allocations made by the callee itself.  Recursive calls add their inclusive
+ * time only at the outermost activation, so a recursive function's inclusive
+ * time is never larger than the run.  Counters are kept per thread; when
+ * instrumentation is off the only cost is the branch on instr_active. */
+
+typedef enum { INSTR_FUNCTION, INSTR_BUILTIN, INSTR_PATTERN } InstrKind;
+
+typedef struct {
+    const char *name;
+    InstrKind   kind;
+    int         line;          /* declaration line for script functions and patterns, else 0 */
+    long long   calls;
+    long long   incl_ns;
+    long long   excl_ns;
+    long long   allocs;        /* allocations made by the callee itself */
+} InstrEntry;
+
+extern int instr_active;
+
+void instr_enable(int on);
+
+/* key identifies the callee by the AST node declaring it (a function or a
+   pat), which stays put while the function or pattern value comes and goes;
+   builtins pass NULL and are told apart by name.  name is copied the first
+   time the callee is seen. */
+void instr_enter(const void *key, InstrKind kind, const char *name, int line);
+void instr_leave(void);
+
+/* Entries of the calling thread sorted by exclusive time, most expensive
+   first; the array is owned by the instrumentation and valid until the next
+   instr_* call.  Returns the entry count. */
+int  instr_entries(const InstrEntry **out);
+void instr_print_table(FILE *f);
+int  instr_write_json(const char *path);   /* 0 on success */
+void instr_reset(void);
+
+#endif /* INSTRUMENT_H */
@@ -1,84 +1,213 @@
 #define _POSIX_C_SOURCE 200809L
 #include "interpreter.h"
 #include "builtins.h"
+#include "module.h"
+#include "gc.h"
+#include "mem.h"
+#include "profile.h"
+#include "instrument.h"
+#include "stats.h"
+#include "trace.h"
+#include "heapprof.h"
+#include "perfctr.h"
+#include "probes.h"
+#include "parallel.h"
+#include "actor.h"
+#include "generator.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <time.h>
 
 /* ------------------------------------------------------------------ Env */
 
 Env *env_new(Env *parent) {
-    Env *e = calloc(1, sizeof(Env));
+    Env *e = mem_calloc(1, sizeof(Env));
     e->parent = parent;
     e->ref_count = 1;
     if (parent) env_incref(parent);
+    gc_track_env(e);
+    LANG_PROBE2(env__new, e, parent);
+    STAT_INC(env_new);
+    stat_born();
     return e;
 }
 
-void env_incref(Env *e) { if (e) e->ref_count++; }
+void env_incref(Env *e) { if (e && !e->pinned) e->ref_count++; }
 
 void env_decref(Env *e) {
-    if (!e) return;
+    if (!e || e->pinned) return;
     e->ref_count--;
     if (e->ref_count > 0) return;
+    stat_died();
+    if (mem_in_arena(e) && !mem_arena_current()) return;   /* discarded with its arena */
+    gc_untrack_env(e);
+    env_clear(e);
+    mem_free(e);
+}
+
+void env_clear(Env *e) {
     EnvEntry *en = e->entries;
+    Env *parent = e->parent;
+    Value *fn = e->fn;
+    e->entries = NULL;
+    e->parent  = NULL;
+    e->fn      = NULL;
     while (en) {
         EnvEntry *next = en->next;
-        free(en->name);
-        value_decref(en->val);
-        free(en);
+        en->next = NULL;
+        entry_decref(en);
         en = next;
     }
-    env_decref(e->parent);
-    free(e);
+    env_decref(parent);
+    value_decref(fn);
 }
 
-Value *env_get(Env *e, const char *name) {
+void entry_incref(EnvEntry *en) { if (en && !en->pinned) en->ref_count++; }
+
+void entry_decref(EnvEntry *en) {
+    if (!en || en->pinned) return;
+    en->ref_count--;
+    if (en->ref_count > 0) return;
+    if (mem_in_arena(en) && !mem_arena_current()) return;   /* discarded with its arena */
+    gc_untrack_entry(en);
+    mem_free(en->name);
+    value_decref(en->val);
+    mem_free(en);
+}
+
+/* Find the entry bound to name, searching each frame's own entries, then the
+   variables its function captured, then the parent.  *owner is set to the Env
+   whose list or captures held it; *depth, when given, counts the scopes
+   searched. */
+static EnvEntry *env_lookup(Env *e, const char *name, Env **owner, int *depth) {
     for (Env *cur = e; cur; cur = cur->parent) {
+        if (depth) ++*depth;
         for (EnvEntry *en = cur->entries; en; en = en->next) {
-            if (strcmp(en->name, name) == 0) return en->val;
+            if (strcmp(en->name, name) == 0) { if (owner) *owner = cur; return en; }
+        }
+        if (cur->fn && cur->fn->fn.captures) {
+            CaptureSet *cs = cur->fn->fn.captures;
+            for (int i = 0; i < cs->count; i++) {
+                if (strcmp(cs->entries[i]->name, name) == 0) { if (owner) *owner = cur; return cs->entries[i]; }
+            }
         }
     }
     return NULL;
 }
 
-static EnvEntry *env_find_entry(Env *e, const char *name) {
-    for (Env *cur = e; cur; cur = cur->parent) {
-        for (EnvEntry *en = cur->entries; en; en = en->next) {
-            if (strcmp(en->name, name) == 0) return en;
-        }
+Value *env_get(Env *e, const char *name) {
+    RuntimeStats *s = stats_current;
+    if (!s) {
+        EnvEntry *en = env_lookup(e, name, NULL, NULL);
+        return en ? en->val : NULL;
     }
-    return NULL;
+    int depth = 0;
+    EnvEntry *en = env_lookup(e, name, NULL, &depth);
+    s->env_get++;
+    s->env_get_depth += depth;
+    return en ? en->val : NULL;
+}
+
+/* Code run in an arena (a --serve request, lang_run_scoped) may store into
+   variables and fields that outlive it, such as the prelude's globals.  What
+   it stores there is copied out of the arena first, the way value_deep_copy
+   carries a result out.  Returns a new reference for holder to keep. */
+static Value *escape_arena(const void *holder, Value *val) {
+    MemArena *arena = mem_arena_current();
+    if (!arena || !val || mem_in_arena(holder) || !mem_in_arena(val)) {
+        value_incref(val);
+        return val;
+    }
+    mem_arena_enter(NULL);
+    Value *copy = value_deep_copy(val);
+    mem_arena_enter(arena);
+    return copy;
 }
 
 void env_def(Env *e, const char *name, Value *val) {
     /* Check if already in this scope */
     for (EnvEntry *en = e->entries; en; en = en->next) {
         if (strcmp(en->name, name) == 0) {
+            Value *keep = escape_arena(en, val);
             value_decref(en->val);
-            en->val = val;
-            if (val) value_incref(val);
+            en->val = keep;
             return;
         }
     }
-    EnvEntry *en = calloc(1, sizeof(EnvEntry));
-    en->name = strdup(name);
-    en->val  = val;
-    if (val) value_incref(val);
+    /* an entry of an env outside the arena lives outside it too */
+    MemArena *arena = mem_arena_current();
+    if (arena && mem_in_arena(e)) arena = NULL;
+    if (arena) mem_arena_enter(NULL);
+    EnvEntry *en = mem_calloc(1, sizeof(EnvEntry));
+    en->name = mem_strdup(name);
+    en->ref_count = 1;
+    if (arena) mem_arena_enter(arena);
+    en->val  = escape_arena(en, val);
     en->next = e->entries;
     e->entries = en;
 }
 
-void env_set(Env *e, const char *name, Value *val) {
-    EnvEntry *en = env_find_entry(e, name);
+/* env_set, except that a variable pinned by a running parallel loop (one
+   declared outside the loop body, see eval_parallel_for) is left alone: -1. */
+static int env_assign(Env *e, const char *name, Value *val) {
+    EnvEntry *en = env_lookup(e, name, NULL, NULL);
     if (en) {
+        if (en->pinned) return -1;
+        Value *keep = escape_arena(en, val);
         value_decref(en->val);
-        en->val = val;
-        if (val) value_incref(val);
+        en->val = keep;
     } else {
+        if (e->pinned) return -1;
         env_def(e, name, val);
     }
+    return 0;
+}
+
+void env_set(Env *e, const char *name, Value *val) {
+    env_assign(e, name, val);
+}
+
+/* Create the function value for decl defined in env.
+ *
+ * Functions defined at the outermost level simply close over that env.  Nested
+ * functions are flattened: the variables they use from enclosing non-global
+ * scopes are captured as shared entries and the closure itself only keeps the
+ * outermost env, so a small lambda neither retains its whole defining chain nor
+ * walks it on every lookup.  A name that cannot be resolved yet and is not
+ * declared inside the function may still be defined later in an enclosing
+ * scope, and one an enclosing scope declares after the function
+ * (decl->binds_late) will be shadowed once that declaration runs, so in those
+ * cases the full defining env is kept as before. */
+static Value *make_closure(AstNode *decl, Env *env) {
+    Env *root = env;
+    while (root->parent) root = root->parent;
+    if (root == env || decl->binds_late) return value_new_function(decl, env, decl->name);
+
+    CaptureSet *cs = mem_alloc(sizeof(CaptureSet) + sizeof(EnvEntry *) * (size_t)decl->free_var_count);
+    cs->count = 0;
+    for (int i = 0; i < decl->free_var_count; i++) {
+        Env *owner = NULL;
+        EnvEntry *en = env_lookup(env, decl->free_vars[i], &owner, NULL);
+        if (!en) {
+            if (decl->free_var_local[i]) continue;
+            for (int j = 0; j < cs->count; j++) entry_decref(cs->entries[j]);
+            mem_free(cs);
+            return value_new_function(decl, env, decl->name);
+        }
+        if (owner == root) continue;   /* reachable through the closure's parent */
+        entry_incref(en);
+        gc_track_entry(en);
+        cs->entries[cs->count++] = en;
+    }
+
+    Value *fn = value_new_function(decl, root, decl->name);
+    if (cs->count > 0) fn->fn.captures = cs;
+    else               mem_free(cs);
+    return fn;
 }
 
 /* ------------------------------------------------------------------ EvalResult helpers */
@@ -99,9 +228,86 @@ static EvalResult err(const char *msg, int line, int col) {
     EvalResult r;
     r.sig = SIG_ERROR;
     r.val = NULL;
-    snprintf(r.error_msg, sizeof(r.error_msg), "Runtime error at line %d col %d: %s", line, col, msg);
+    /* the prefix takes at most 51 bytes, so a message is cut at 200 */
+    snprintf(r.error_msg, sizeof(r.error_msg), "Runtime error at line %d col %d: %.200s", line, col, msg);
     return r;
 }
+static EvalResult err_mem_limit(int line, int col) {
+    MemStats *ms = mem_current();
+    char buf[128];
+    snprintf(buf, sizeof(buf), "memory limit exceeded (%zu bytes in use, limit %zu)",
+             ms ? ms->current : 0, ms ? ms->limit : 0);
+    return err(buf, line, col);
+}
+
+/* Assignment to something a parallel loop shares between its iterations. */
+static EvalResult err_shared_write(const AstNode *target) {
+    char buf[200];
+    snprintf(buf, sizeof(buf), "cannot assign to %s'%s' in a parallel loop: it is shared by all iterations "
+             "(yield the value instead)", target->type == AST_MEMBER ? "member " : "", target->name);
+    return err(buf, target->line, target->col);
+}
+
+/* ------------------------------------------------------------------ evaluation budget */
+
+/* Interpreter whose budget the current thread is spending; see interp_run. */
+static _Thread_local Interpreter *cur_interp;
+
+/* Set while this thread runs iterations of a parallel loop. */
+static _Thread_local int in_parallel;
+
+/* Limits are only examined every BUDGET_CHECK_INTERVAL steps, so the common
+   case costs one increment and one compare. */
+#define BUDGET_CHECK_INTERVAL 1024
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Step count at which budget_exhausted next has to look at the limits. */
+static long long budget_next_check(Interpreter *in) {
+    long long next = in->deadline_ns ? in->steps + BUDGET_CHECK_INTERVAL : LLONG_MAX;
+    if (in->step_limit && in->step_limit < next) next = in->step_limit + 1;
+    return next;
+}
+
+/* Arm the budget for a new run. */
+static void budget_reset(Interpreter *in) {
+    in->steps = 0;
+    in->deadline_ns = in->timeout_ns ? monotonic_ns() + in->timeout_ns : 0;
+    in->next_check = budget_next_check(in);
+}
+
+/* Slow path of budget_step.  Once exhausted, next_check stays at 0 so every
+   later check fails too and the whole evaluation unwinds. */
+static int budget_exhausted(Interpreter *in) {
+    if (in->next_check == 0) return 1;
+    if ((in->step_limit && in->steps > in->step_limit)
+        || (in->deadline_ns && monotonic_ns() >= in->deadline_ns)) {
+        in->next_check = 0;
+        return 1;
+    }
+    in->next_check = budget_next_check(in);
+    return 0;
+}
+
+/* Count one step; nonzero when the budget is spent. */
+static inline int budget_step(void) {
+    Interpreter *in = cur_interp;
+    return in && ++in->steps >= in->next_check && budget_exhausted(in);
+}
+
+static EvalResult err_budget(int line, int col) {
+    Interpreter *in = cur_interp;
+    char buf[128];
+    if (in && in->step_limit && in->steps > in->step_limit)
+        snprintf(buf, sizeof(buf), "step limit exceeded (%lld steps)", in->step_limit);
+    else
+        snprintf(buf, sizeof(buf), "deadline exceeded (%lld ms)", in ? in->timeout_ns / 1000000 : 0);
+    return err(buf, line, col);
+}
 
 static int is_int_type_name(const char *t) {
     return t && (!strcmp(t, "i8") || !strcmp(t, "i16") || !strcmp(t, "i32") || !strcmp(t, "i64")
@@ -143,12 +349,101 @@ static int tuple_value_matches_decl(Value *v, AstNode *decl_tuple) {
 
 /* ------------------------------------------------------------------ forward */
 static EvalResult eval_call(AstNode *node, Env *env);
+static EvalResult eval_parallel_for(AstNode *node, Env *env, Value *range);
+static EvalResult eval_for_ints(AstNode *node, Env *env, long long start, long long step, long long count);
 static EvalResult eval_fn_call(Value *fn, Value **args, int argc, int line, int col);
+static RuntimeStats *stats_target(Interpreter *interp);
 
 /* ------------------------------------------------------------------ eval */
 
+/* Top-level statement under the tracer and/or the perf counters. */
+static EvalResult eval_observed(AstNode *stmt, Env *env) {
+    long long t0 = trace_active ? trace_now() : 0;
+    PerfSample ps;
+    if (perfctr_active) perfctr_read(&ps);
+    EvalResult r = eval(stmt, env);
+    if (perfctr_active) perfctr_attribute(NULL, stmt->line, &ps);
+    if (t0) {
+        char name[32];
+        snprintf(name, sizeof(name), "line %d", stmt->line);
+        trace_span(name, "stmt", t0, stmt->name);
+    }
+    return r;
+}
+
+/* l op r for the built-in binary operators; consumes l and r. */
+static EvalResult binop(const char *op, Value *l, Value *r, int line, int col) {
+#define ARITH(sym, intop, floatop) \
+    if (strcmp(op, sym) == 0) { \
+        if (l->type == VAL_INT && r->type == VAL_INT) { \
+            Value *res = value_new_int(l->int_val intop r->int_val); \
+            value_decref(l); value_decref(r); return ok(res); \
+        } \
+        double lf = (l->type == VAL_FLOAT) ? l->float_val : (double)l->int_val; \
+        double rf = (r->type == VAL_FLOAT) ? r->float_val : (double)r->int_val; \
+        Value *res = value_new_float(lf floatop rf); \
+        value_decref(l); value_decref(r); return ok(res); \
+    }
+#define CMP(sym, cop) \
+    if (strcmp(op, sym) == 0) { \
+        int res; \
+        if (l->type == VAL_INT && r->type == VAL_INT) res = l->int_val cop r->int_val; \
+        else { \
+            double lf = (l->type == VAL_FLOAT) ? l->float_val : (double)l->int_val; \
+            double rf = (r->type == VAL_FLOAT) ? r->float_val : (double)r->int_val; \
+            res = lf cop rf; \
+        } \
+        value_decref(l); value_decref(r); return ok(value_new_bool(res)); \
+    }
+
+    /* String concatenation */
+    if (strcmp(op, "+") == 0 && l->type == VAL_STRING && r->type == VAL_STRING) {
+        size_t n = strlen(l->str_val) + strlen(r->str_val) + 1;
+        if (mem_would_exceed(2 * n)) { value_decref(l); value_decref(r); return err_mem_limit(line, col); }
+        char *s = mem_alloc(n);
+        strcpy(s, l->str_val); strcat(s, r->str_val);
+        Value *res = value_new_string(s); mem_free(s);
+        value_decref(l); value_decref(r); return ok(res);
+    }
+    ARITH("+", +, +)
+    ARITH("-", -, -)
+    ARITH("*", *, *)
+    if (strcmp(op, "/") == 0) {
+        if (l->type == VAL_INT && r->type == VAL_INT) {
+            if (r->int_val == 0) { value_decref(l); value_decref(r); return err("division by zero", line, col); }
+            Value *res = value_new_int(l->int_val / r->int_val);
+            value_decref(l); value_decref(r); return ok(res);
+        }
+        double lf = (l->type == VAL_FLOAT) ? l->float_val : (double)l->int_val;
+        double rf = (r->type == VAL_FLOAT) ? r->float_val : (double)r->int_val;
+        Value *res = value_new_float(lf / rf);
+        value_decref(l); value_decref(r); return ok(res);
+    }
+    if (strcmp(op, "%") == 0) {
+        if (l->type == VAL_INT && r->type == VAL_INT) {
+            if (r->int_val == 0) { value_decref(l); value_decref(r); return err("modulo by zero", line, col); }
+            Value *res = value_new_int(l->int_val % r->int_val);
+            value_decref(l); value_decref(r); return ok(res);
+        }
+    }
+    CMP("<", <) CMP(">", >) CMP("<=", <=) CMP(">=", >=)
+    if (strcmp(op, "==") == 0) { int eq = value_equals(l, r); value_decref(l); value_decref(r); return ok(value_new_bool(eq)); }
+    if (strcmp(op, "!=") == 0) { int eq = value_equals(l, r); value_decref(l); value_decref(r); return ok(value_new_bool(!eq)); }
+    if (strcmp(op, "&&") == 0) { int tv = value_is_truthy(l) && value_is_truthy(r); value_decref(l); value_decref(r); return ok(value_new_bool(tv)); }
+    if (strcmp(op, "||") == 0) { int tv = value_is_truthy(l) || value_is_truthy(r); value_decref(l); value_decref(r); return ok(value_new_bool(tv)); }
+    /* Bitwise */
+    if (strcmp(op, "&") == 0 && l->type == VAL_INT && r->type == VAL_INT) { Value *res = value_new_int(l->int_val & r->int_val); value_decref(l); value_decref(r); return ok(res); }
+    if (strcmp(op, "|") == 0 && l->type == VAL_INT && r->type == VAL_INT) { Value *res = value_new_int(l->int_val | r->int_val); value_decref(l); value_decref(r); return ok(res); }
+    if (strcmp(op, "^") == 0 && l->type == VAL_INT && r->type == VAL_INT) { Value *res = value_new_int(l->int_val ^ r->int_val); value_decref(l); value_decref(r); return ok(res); }
+    if (strcmp(op, "<<") == 0 && l->type == VAL_INT && r->type == VAL_INT) { Value *res = value_new_int(l->int_val << r->int_val); value_decref(l); value_decref(r); return ok(res); }
+    if (strcmp(op, ">>") == 0 && l->type == VAL_INT && r->type == VAL_INT) { Value *res = value_new_int(l->int_val >> r->int_val); value_decref(l); value_decref(r); return ok(res); }
+    value_decref(l); value_decref(r);
+    return err("unsupported binary operation", line, col);
+}
+
 EvalResult eval(AstNode *node, Env *env) {
     if (!node) return ok(value_new_null());
+    perfctr_node();
 
     switch (node->type) {
 
@@ -178,7 +473,7 @@ EvalResult eval(AstNode *node, Env *env) {
         AstNode *lhs = node->init;
         if (!lhs) return err("invalid assignment target", node->line, node->col);
         if (lhs->type == AST_IDENT) {
-            env_set(env, lhs->name, rhs.val);
+            if (env_assign(env, lhs->name, rhs.val) != 0) { value_decref(rhs.val); return err_shared_write(lhs); }
             Value *ret = rhs.val; value_incref(ret);
             value_decref(rhs.val);
             return ok(ret);
@@ -186,13 +481,21 @@ EvalResult eval(AstNode *node, Env *env) {
             EvalResult obj_r = eval(lhs->init, env);
             if (obj_r.sig != SIG_NONE) { value_decref(rhs.val); return obj_r; }
             Value *obj = obj_r.val;
+            if (obj->frozen) {
+                char buf[160];
+                snprintf(buf, sizeof(buf), "cannot assign to member '%s' of a frozen value", lhs->name);
+                value_decref(rhs.val);
+                value_decref(obj);
+                return err(buf, lhs->line, lhs->col);
+            }
+            if (obj->pinned) { value_decref(rhs.val); value_decref(obj); return err_shared_write(lhs); }
             if (obj->type == VAL_PAT_INST && obj->pat_inst.def) {
                 PatDef *def = obj->pat_inst.def;
                 for (int i = 0; i < def->field_count; i++) {
                     if (def->field_names[i] && strcmp(def->field_names[i], lhs->name) == 0) {
+                        Value *keep = escape_arena(obj, rhs.val);
                         value_decref(obj->pat_inst.fields[i]);
-                        obj->pat_inst.fields[i] = rhs.val;
-                        value_incref(rhs.val);
+                        obj->pat_inst.fields[i] = keep;
                         Value *ret = rhs.val; value_incref(ret);
                         value_decref(rhs.val);
                         value_decref(obj);
@@ -200,7 +503,11 @@ EvalResult eval(AstNode *node, Env *env) {
                     }
                 }
             } else if (obj->type == VAL_SCOPE && obj->scope.env) {
-                env_set(obj->scope.env, lhs->name, rhs.val);
+                if (env_assign(obj->scope.env, lhs->name, rhs.val) != 0) {
+                    value_decref(rhs.val);
+                    value_decref(obj);
+                    return err_shared_write(lhs);
+                }
                 Value *ret = rhs.val; value_incref(ret);
                 value_decref(rhs.val);
                 value_decref(obj);
@@ -246,74 +553,7 @@ EvalResult eval(AstNode *node, Env *env) {
         if (lr.sig != SIG_NONE) return lr;
         EvalResult rr = eval(node->children[1], env);
         if (rr.sig != SIG_NONE) { value_decref(lr.val); return rr; }
-        Value *l = lr.val, *r = rr.val;
-        const char *op = node->op;
-
-#define ARITH(sym, intop, floatop) \
-    if (strcmp(op, sym) == 0) { \
-        if (l->type == VAL_INT && r->type == VAL_INT) { \
-            Value *res = value_new_int(l->int_val intop r->int_val); \
-            value_decref(l); value_decref(r); return ok(res); \
-        } \
-        double lf = (l->type == VAL_FLOAT) ? l->float_val : (double)l->int_val; \
-        double rf = (r->type == VAL_FLOAT) ? r->float_val : (double)r->int_val; \
-        Value *res = value_new_float(lf floatop rf); \
-        value_decref(l); value_decref(r); return ok(res); \
-    }
-#define CMP(sym, cop) \
-    if (strcmp(op, sym) == 0) { \
-        int res; \
-        if (l->type == VAL_INT && r->type == VAL_INT) res = l->int_val cop r->int_val; \
-        else { \
-            double lf = (l->type == VAL_FLOAT) ? l->float_val : (double)l->int_val; \
-            double rf = (r->type == VAL_FLOAT) ? r->float_val : (double)r->int_val; \
-            res = lf cop rf; \
-        } \
-        value_decref(l); value_decref(r); return ok(value_new_bool(res)); \
-    }
-
-        ARITH("+", +, +)
-        ARITH("-", -, -)
-        ARITH("*", *, *)
-        if (strcmp(op, "/") == 0) {
-            if (l->type == VAL_INT && r->type == VAL_INT) {
-                if (r->int_val == 0) { value_decref(l); value_decref(r); return err("division by zero", node->line, node->col); }
-                Value *res = value_new_int(l->int_val / r->int_val);
-                value_decref(l); value_decref(r); return ok(res);
-            }
-            double lf = (l->type == VAL_FLOAT) ? l->float_val : (double)l->int_val;
-            double rf = (r->type == VAL_FLOAT) ? r->float_val : (double)r->int_val;
-            Value *res = value_new_float(lf / rf);
-            value_decref(l); value_decref(r); return ok(res);
-        }
-        if (strcmp(op, "%") == 0) {
-            if (l->type == VAL_INT && r->type == VAL_INT) {
-                if (r->int_val == 0) { value_decref(l); value_decref(r); return err("modulo by zero", node->line, node->col); }
-                Value *res = value_new_int(l->int_val % r->int_val);
-                value_decref(l); value_decref(r); return ok(res);
-            }
-        }
-        CMP("<", <) CMP(">", >) CMP("<=", <=) CMP(">=", >=)
-        if (strcmp(op, "==") == 0) { int eq = value_equals(l, r); value_decref(l); value_decref(r); return ok(value_new_bool(eq)); }
-        if (strcmp(op, "!=") == 0) { int eq = value_equals(l, r); value_decref(l); value_decref(r); return ok(value_new_bool(!eq)); }
-        if (strcmp(op, "&&") == 0) { int tv = value_is_truthy(l) && value_is_truthy(r); value_decref(l); value_decref(r); return ok(value_new_bool(tv)); }
-        if (strcmp(op, "||") == 0) { int tv = value_is_truthy(l) || value_is_truthy(r); value_decref(l); value_decref(r); return ok(value_new_bool(tv)); }
-        /* Bitwise */
-        if (strcmp(op, "&") == 0 && l->type == VAL_INT && r->type == VAL_INT) { Value *res = value_new_int(l->int_val & r->int_val); value_decref(l); value_decref(r); return ok(res); }
-        if (strcmp(op, "|") == 0 && l->type == VAL_INT && r->type == VAL_INT) { Value *res = value_new_int(l->int_val | r->int_val); value_decref(l); value_decref(r); return ok(res); }
-        if (strcmp(op, "^") == 0 && l->type == VAL_INT && r->type == VAL_INT) { Value *res = value_new_int(l->int_val ^ r->int_val); value_decref(l); value_decref(r); return ok(res); }
-        if (strcmp(op, "<<") == 0 && l->type == VAL_INT && r->type == VAL_INT) { Value *res = value_new_int(l->int_val << r->int_val); value_decref(l); value_decref(r); return ok(res); }
-        if (strcmp(op, ">>") == 0 && l->type == VAL_INT && r->type == VAL_INT) { Value *res = value_new_int(l->int_val >> r->int_val); value_decref(l); value_decref(r); return ok(res); }
-        /* String concatenation */
-        if (strcmp(op, "+") == 0 && l->type == VAL_STRING && r->type == VAL_STRING) {
-            size_t n = strlen(l->str_val) + strlen(r->str_val) + 1;
-            char *s = malloc(n);
-            strcpy(s, l->str_val); strcat(s, r->str_val);
-            Value *res = value_new_string(s); free(s);
-            value_decref(l); value_decref(r); return ok(res);
-        }
-        value_decref(l); value_decref(r);
-        return err("unsupported binary operation", node->line, node->col);
+        return binop(node->op, lr.val, rr.val, node->line, node->col);
     }
 
     /* ---- optional ?: ---- */
@@ -371,11 +611,11 @@ EvalResult eval(AstNode *node, Env *env) {
                 int n = def ? def->field_count : 0;
                 Value *fields = value_new_tuple(n);
                 if (n > 0) {
-                    fields->tuple.names = calloc((size_t)n, sizeof(char *));
+                    fields->tuple.names = mem_calloc((size_t)n, sizeof(char *));
                     for (int i = 0; i < n; i++) {
                         const char *fn = def->field_names[i] ? def->field_names[i] : "";
                         fields->tuple.elems[i] = value_new_string(fn);
-                        fields->tuple.names[i] = strdup(fn);
+                        fields->tuple.names[i] = mem_strdup(fn);
                     }
                 }
                 value_decref(obj);
@@ -431,6 +671,14 @@ EvalResult eval(AstNode *node, Env *env) {
             value_decref(obj); value_decref(idx);
             return err("tuple index out of range", node->line, node->col);
         }
+        if (obj->type == VAL_RANGE && idx->type == VAL_INT) {
+            long long i = idx->int_val;
+            if (i < 0) i += obj->range.len;
+            int in_range = i >= 0 && i < obj->range.len;
+            Value *ev = in_range ? value_new_int(range_elem(obj->range.start, obj->range.step, i)) : NULL;
+            value_decref(obj); value_decref(idx);
+            return ev ? ok(ev) : err("range index out of range", node->line, node->col);
+        }
         value_decref(obj); value_decref(idx);
         return err("index not supported for this type", node->line, node->col);
     }
@@ -447,18 +695,18 @@ EvalResult eval(AstNode *node, Env *env) {
             if (child && child->type == AST_ASSIGN && child->init && child->init->type == AST_IDENT) {
                 /* named: name = expr */
                 if (!t->tuple.names) {
-                    t->tuple.names = calloc((size_t)node->child_count, sizeof(char *));
+                    t->tuple.names = mem_calloc((size_t)node->child_count, sizeof(char *));
                 }
-                t->tuple.names[i] = strdup(child->init->name);
+                t->tuple.names[i] = mem_strdup(child->init->name);
                 EvalResult r = eval(child->body, env);
                 if (r.sig != SIG_NONE) { value_decref(t); return r; }
                 t->tuple.elems[i] = r.val;
             } else if (child && child->type == AST_PARAM && child->init) {
                 if (child->name) {
                     if (!t->tuple.names) {
-                        t->tuple.names = calloc((size_t)node->child_count, sizeof(char *));
+                        t->tuple.names = mem_calloc((size_t)node->child_count, sizeof(char *));
                     }
-                    t->tuple.names[i] = strdup(child->name);
+                    t->tuple.names[i] = mem_strdup(child->name);
                 }
                 EvalResult r = eval(child->init, env);
                 if (r.sig != SIG_NONE) { value_decref(t); return r; }
@@ -466,9 +714,9 @@ EvalResult eval(AstNode *node, Env *env) {
             } else if (child && child->type == AST_TYPE_ANN && child->name) {
                 /* named: name:type = expr — for return tuples */
                 if (!t->tuple.names) {
-                    t->tuple.names = calloc((size_t)node->child_count, sizeof(char *));
+                    t->tuple.names = mem_calloc((size_t)node->child_count, sizeof(char *));
                 }
-                t->tuple.names[i] = strdup(child->name);
+                t->tuple.names[i] = mem_strdup(child->name);
                 EvalResult r = eval(child->init ? child->init : child, env);
                 if (r.sig != SIG_NONE) { value_decref(t); return r; }
                 t->tuple.elems[i] = r.val;
@@ -494,7 +742,12 @@ EvalResult eval(AstNode *node, Env *env) {
         EvalResult r = ok(value_new_null());
         for (int i = 0; i < node->child_count; i++) {
             value_decref(r.val);
-            r = eval(node->children[i], env);
+            gc_maybe_collect();
+            if (mem_over_limit()) return err_mem_limit(node->children[i]->line, node->children[i]->col);
+            prof_line(node->children[i]->line);
+            heapprof_at(node->children[i]->line);
+            if (trace_active | perfctr_active) r = eval_observed(node->children[i], env);
+            else r = eval(node->children[i], env);
             if (r.sig == SIG_ERROR) return r;
             if (r.sig == SIG_RETURN || r.sig == SIG_BREAK || r.sig == SIG_YIELD) {
                 /* propagate signals from top level */
@@ -508,7 +761,9 @@ EvalResult eval(AstNode *node, Env *env) {
 
     /* ---- function declaration ---- */
     case AST_FN_DECL: {
-        Value *fn = value_new_function(node, env, node->name);
+        /* bind the name first so a nested recursive function captures itself */
+        if (env->parent) env_def(env, node->name, NULL);
+        Value *fn = make_closure(node, env);
         env_def(env, node->name, fn);
         value_decref(fn);
         return ok(value_new_null());
@@ -548,12 +803,13 @@ EvalResult eval(AstNode *node, Env *env) {
             }
         }
         PatDef *def = patdef_new(node->name, field_count);
+        def->decl = node;
         int fi = 0;
         if (node->body && node->body->type == AST_SCOPE) {
             for (int i = 0; i < node->body->child_count; i++) {
                 AstNode *ch = node->body->children[i];
                 if (ch && ch->type == AST_VAR_DECL) {
-                    def->field_names[fi++] = strdup(ch->name);
+                    def->field_names[fi++] = mem_strdup(ch->name);
                 }
             }
         }
@@ -589,7 +845,10 @@ EvalResult eval(AstNode *node, Env *env) {
 
     /* ---- import ---- */
     case AST_IMPORT_DECL: {
-        /* TODO: real module loading via module.c */
+        char msg[256];
+        if (!cur_interp) return err("import outside a running interpreter", node->line, node->col);
+        if (in_parallel) return err("import inside a parallel loop", node->line, node->col);
+        if (resolve_import(node, env, cur_interp, msg, sizeof(msg)) != 0) return err(msg, node->line, node->col);
         return ok(value_new_null());
     }
 
@@ -599,6 +858,7 @@ EvalResult eval(AstNode *node, Env *env) {
         EvalResult range_r = eval(node->cond, env);
         if (range_r.sig != SIG_NONE) return range_r;
         Value *range = range_r.val;
+        if (node->is_parallel) return eval_parallel_for(node, env, range);
 
         /* iterate over tuple elements or integer range */
         const char *var_name = node->init ? node->init->name : "_";
@@ -606,6 +866,7 @@ EvalResult eval(AstNode *node, Env *env) {
 
         if (range->type == VAL_TUPLE) {
             for (int i = 0; i < range->tuple.count; i++) {
+                if (budget_step()) { value_decref(range); value_decref(result); return err_budget(node->line, node->col); }
                 Env *loop_env = env_new(env);
                 value_incref(range->tuple.elems[i]);
                 env_def(loop_env, var_name, range->tuple.elems[i]);
@@ -617,11 +878,28 @@ EvalResult eval(AstNode *node, Env *env) {
                 if (r.sig == SIG_RETURN || r.sig == SIG_ERROR) { value_decref(range); value_decref(result); return r; }
                 value_decref(r.val);
             }
-        } else if (range->type == VAL_INT) {
+        } else if (range->type == VAL_INT || range->type == VAL_RANGE) {
             /* for i : N  →  0..N-1 */
-            for (long long i = 0; i < range->int_val; i++) {
+            long long start = range->type == VAL_RANGE ? range->range.start : 0;
+            long long step  = range->type == VAL_RANGE ? range->range.step : 1;
+            long long count = range->type == VAL_RANGE ? range->range.len : range->int_val;
+            value_decref(range);
+            value_decref(result);
+            return eval_for_ints(node, env, start, step, count);
+        } else if (range->type == VAL_GENERATOR) {
+            /* pulled one value at a time; the generator runs to its next yield */
+            const char *why = gen_cannot_resume(range->gen);
+            if (why) { value_decref(range); value_decref(result); return err(why, node->line, node->col); }
+            for (;;) {
+                if (budget_step()) { value_decref(range); value_decref(result); return err_budget(node->line, node->col); }
+                Value *item;
+                EvalResult fail;
+                int got = gen_next(range->gen, &item, &fail);
+                if (got < 0) { value_decref(range); value_decref(result); return fail; }
+                if (!got) break;
                 Env *loop_env = env_new(env);
-                env_def(loop_env, var_name, value_new_int(i));
+                env_def(loop_env, var_name, item);
+                value_decref(item);
                 EvalResult r = eval_block(node->body, loop_env);
                 env_decref(loop_env);
                 if (r.sig == SIG_BREAK) { value_decref(r.val); break; }
@@ -638,6 +916,7 @@ EvalResult eval(AstNode *node, Env *env) {
     case AST_WHILE: {
         Value *result = value_new_null();
         for (;;) {
+            if (budget_step()) { value_decref(result); return err_budget(node->line, node->col); }
             if (node->cond) {
                 EvalResult cr = eval(node->cond, env);
                 if (cr.sig != SIG_NONE) { value_decref(result); return cr; }
@@ -700,12 +979,20 @@ EvalResult eval(AstNode *node, Env *env) {
     /* ---- break / yield / return ---- */
     case AST_BREAK:  return sig_break();
     case AST_YIELD: {
+        Value *v;
         if (node->init) {
             EvalResult r = eval(node->init, env);
             if (r.sig != SIG_NONE) return r;
-            return sig_yield(r.val);
+            v = r.val;
+        } else {
+            v = value_new_null();
         }
-        return sig_yield(value_new_null());
+        if (!node->is_generator) return sig_yield(v);
+        /* in a generator: suspend until the next value is wanted */
+        int rc = gen_yield(v);
+        if (rc < 0) return err("yield outside a running generator", node->line, node->col);
+        if (rc > 0) return err("generator dropped", node->line, node->col);
+        return ok(value_new_null());
     }
     case AST_RETURN: {
         if (node->init) {
@@ -718,12 +1005,12 @@ EvalResult eval(AstNode *node, Env *env) {
 
     /* ---- template instantiation used as type prefix: <Pat>(...) ---- */
     case AST_TEMPLATE_INST: {
-        /* If used as a call base (postfix handles it), here it is just a type node */
-        /* Return a type value */
-        if (node->child_count > 0 && node->children[0] && node->children[0]->type == AST_TYPE_ANN) {
-            const char *tname = node->children[0]->data.str_val;
-            if (tname) return ok(value_new_type(tname));
-        }
+        /* f<T>(...) calls f, its type arguments unchecked; <T>(...) calls
+           what T names: the pattern (or whatever else) bound to it, else a
+           type value, which converts */
+        if (node->init) return eval(node->init, env);
+        if (node->child_count > 0 && node->children[0] && node->children[0]->type == AST_TYPE_ANN)
+            return eval(node->children[0], env);
         return ok(value_new_null());
     }
 
@@ -745,33 +1032,401 @@ EvalResult eval(AstNode *node, Env *env) {
 /* ------------------------------------------------------------------ eval_block (defined after eval) */
 
 EvalResult eval_block(AstNode *block, Env *env) {
-    if (!block) return ok(value_new_null());
-    EvalResult r = ok(value_new_null());
+    if (!block || block->child_count == 0) return ok(value_new_null());
+    EvalResult r = ok(NULL);
     for (int i = 0; i < block->child_count; i++) {
         value_decref(r.val);
         r.val = NULL;
+        gc_maybe_collect();
+        if (mem_over_limit()) return err_mem_limit(block->children[i]->line, block->children[i]->col);
+        prof_line(block->children[i]->line);
+        heapprof_at(block->children[i]->line);
         r = eval(block->children[i], env);
         if (r.sig != SIG_NONE) return r;
     }
     return r;
 }
 
+/* ------------------------------------------------------------------ integer loops */
+
+/* for over start, start + step, ... (count of them): an integer or a range.
+ * Each iteration gets a scope of its own as usual, but when the body kept no
+ * reference to the previous iteration's scope, to its variables or to the
+ * loop variable's value, the next iteration reuses them instead: the body's
+ * own declarations are dropped and the value is overwritten in place.  A body
+ * that allocates nothing then runs without allocating. */
+static EvalResult eval_for_ints(AstNode *node, Env *env, long long start, long long step, long long count) {
+    const char *var_name = node->init ? node->init->name : "_";
+    Value *result = value_new_null();
+    Env *loop_env = NULL;
+    EnvEntry *var = NULL;   /* the loop variable's entry in loop_env */
+    int empty = !node->body || node->body->child_count == 0;
+    for (long long k = 0; k < count; k++) {
+        if (budget_step()) { env_decref(loop_env); value_decref(result); return err_budget(node->line, node->col); }
+        long long i = range_elem(start, step, k);
+        int reuse = loop_env && loop_env->ref_count == 1 && !loop_env->fn && var->ref_count == 1;
+        for (EnvEntry *en = reuse ? loop_env->entries : var; en != var; en = en->next)
+            if (en->ref_count != 1) reuse = 0;
+        if (reuse) {
+            while (loop_env->entries != var) {
+                EnvEntry *en = loop_env->entries;
+                loop_env->entries = en->next;
+                en->next = NULL;
+                entry_decref(en);
+            }
+            Value *iv = var->val;
+            if (iv && iv->type == VAL_INT && iv->ref_count == 1 && !(iv->pinned | iv->frozen | iv->shared)) {
+                iv->int_val = i;
+            } else {
+                value_decref(iv);
+                var->val = value_new_int(i);
+            }
+        } else {
+            env_decref(loop_env);
+            loop_env = env_new(env);
+            Value *iv = value_new_int(i);
+            env_def(loop_env, var_name, iv);
+            value_decref(iv);
+            var = loop_env->entries;
+        }
+        if (empty) continue;
+        EvalResult r = eval_block(node->body, loop_env);
+        if (r.sig == SIG_BREAK) { value_decref(r.val); break; }
+        if (r.sig == SIG_YIELD) { value_decref(result); result = r.val; continue; }
+        if (r.sig == SIG_RETURN || r.sig == SIG_ERROR) { env_decref(loop_env); value_decref(result); return r; }
+        value_decref(r.val);
+    }
+    env_decref(loop_env);
+    return ok(result);
+}
+
+/* ------------------------------------------------------------------ parallel loops */
+
+/* for (x : range) :: parallel runs its iterations on the thread pool of
+ * parallel.h.  The iterations are cut into chunks, a few per thread, and each
+ * thread runs its chunks as an Interpreter of its own (budget, output) with a
+ * MemStats and cycle collector heap of its own, so nothing it allocates is
+ * shared.  What the body can reach from outside, i.e. the loop's environment
+ * chain, everything reachable from it and the range, is pinned meanwhile:
+ * refcount operations on pinned objects do nothing, so all threads can use
+ * them without synchronisation, and assignments to them are runtime errors.
+ *
+ * The values a chunk's iterations yield are folded with the loop's reduction
+ * operator (parallel(+), parallel(min), ...; without one, a later value
+ * replaces an earlier one, as in a sequential loop).  The loop's own thread
+ * then copies each chunk's result into its own heap and folds them in
+ * iteration order, so an associative operator gives the sequential result,
+ * and adds the workers' runtime counters (stats.h) to its own. */
+
+#define PAR_CHUNKS_PER_THREAD 8
+
+typedef enum { PIN_VALUE, PIN_ENV, PIN_ENTRY, PIN_PATDEF } PinKind;
+
+typedef struct {
+    void    *obj;
+    PinKind  kind;
+} PinItem;
+
+typedef struct {
+    PinItem *items;
+    size_t   len, cap;
+} PinStack;
+
+static void pin_push(PinStack *s, void *obj, PinKind kind) {
+    if (!obj) return;
+    if (s->len == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 256;
+        s->items = realloc(s->items, sizeof(PinItem) * s->cap);
+    }
+    s->items[s->len].obj = obj;
+    s->items[s->len].kind = kind;
+    s->len++;
+}
+
+/* Set (on = 1) or clear the pinned flag of env, v and everything reachable
+   from them; the flag doubles as the visited mark. */
+static void pin_reachable(Env *env, Value *v, unsigned on) {
+    PinStack s = { 0 };
+    pin_push(&s, env, PIN_ENV);
+    pin_push(&s, v, PIN_VALUE);
+    while (s.len) {
+        PinItem it = s.items[--s.len];
+        switch (it.kind) {
+        case PIN_ENV: {
+            Env *e = it.obj;
+            if (e->pinned == on) break;
+            e->pinned = on;
+            for (EnvEntry *en = e->entries; en; en = en->next) pin_push(&s, en, PIN_ENTRY);
+            pin_push(&s, e->parent, PIN_ENV);
+            pin_push(&s, e->fn, PIN_VALUE);
+            break;
+        }
+        case PIN_ENTRY: {
+            EnvEntry *en = it.obj;
+            if (en->pinned == on) break;
+            en->pinned = on;
+            pin_push(&s, en->val, PIN_VALUE);
+            break;
+        }
+        case PIN_PATDEF: {
+            PatDef *p = it.obj;
+            if (p->pinned == (int)on) break;
+            p->pinned = (int)on;
+            pin_push(&s, p->methods, PIN_ENV);
+            break;
+        }
+        case PIN_VALUE: {
+            Value *x = it.obj;
+            if (x->type == VAL_CHANNEL && on) chan_release(x->chan);
+            if (x->shared || x->pinned == on) break;   /* shared values are thread-safe already */
+            x->pinned = on;
+            switch (x->type) {
+            case VAL_TUPLE:
+                for (int i = 0; i < x->tuple.count; i++) pin_push(&s, x->tuple.elems[i], PIN_VALUE);
+                break;
+            case VAL_PAT_INST:
+                for (int i = 0; i < x->pat_inst.count; i++) pin_push(&s, x->pat_inst.fields[i], PIN_VALUE);
+                pin_push(&s, x->pat_inst.def, PIN_PATDEF);
+                break;
+            case VAL_VARIANT:  pin_push(&s, x->variant.val, PIN_VALUE);  break;
+            case VAL_OPTIONAL: pin_push(&s, x->optional.val, PIN_VALUE); break;
+            case VAL_FUNCTION:
+                pin_push(&s, x->fn.closure, PIN_ENV);
+                if (x->fn.captures)
+                    for (int i = 0; i < x->fn.captures->count; i++) pin_push(&s, x->fn.captures->entries[i], PIN_ENTRY);
+                break;
+            case VAL_SCOPE:    pin_push(&s, x->scope.env, PIN_ENV);        break;
+            case VAL_TYPE:     pin_push(&s, x->type_val.patdef, PIN_PATDEF); break;
+            case VAL_MODULE:
+                pin_push(&s, x->module.env, PIN_ENV);
+                pin_push(&s, x->module.patdef, PIN_PATDEF);
+                break;
+            default: break;
+            }
+            break;
+        }
+        }
+    }
+    free(s.items);
+}
+
+/* Fold b into a with a parallel loop's reduction operator (NULL: b replaces
+   a); consumes both. */
+static EvalResult par_combine(const char *op, Value *a, Value *b, int line, int col) {
+    if (!op) { value_decref(a); return ok(b); }
+    if (strcmp(op, "min") == 0 || strcmp(op, "max") == 0) {
+        if ((a->type != VAL_INT && a->type != VAL_FLOAT) || (b->type != VAL_INT && b->type != VAL_FLOAT)) {
+            value_decref(a); value_decref(b);
+            return err("parallel(min) and parallel(max) reduce numbers", line, col);
+        }
+        int take_b, want_less = op[1] == 'i';
+        if (a->type == VAL_INT && b->type == VAL_INT) {
+            take_b = want_less ? b->int_val < a->int_val : b->int_val > a->int_val;
+        } else {
+            double da = a->type == VAL_FLOAT ? a->float_val : (double)a->int_val;
+            double db = b->type == VAL_FLOAT ? b->float_val : (double)b->int_val;
+            take_b = want_less ? db < da : db > da;
+        }
+        value_decref(take_b ? a : b);
+        return ok(take_b ? b : a);
+    }
+    return binop(op, a, b, line, col);
+}
+
+typedef struct {
+    AstNode     *node;
+    Env         *env;
+    Value       *range;
+    long long    count, chunk_size;
+    Interpreter *workers;    /* one per pool worker */
+    Value      **partials;   /* per chunk: its yields folded, NULL if none */
+    char       **errors;     /* per chunk: message of the error it stopped at */
+    atomic_int   failed;     /* set once a chunk failed: skip the rest */
+} ParLoop;
+
+/* Iterations [lo, hi) of pl's loop, folding what they yield into *acc. */
+static EvalResult par_iterations(ParLoop *pl, long long lo, long long hi, Value **acc) {
+    AstNode *node = pl->node;
+    const char *var_name = node->init ? node->init->name : "_";
+    for (long long i = lo; i < hi; i++) {
+        if (budget_step()) return err_budget(node->line, node->col);
+        Env *loop_env = env_new(pl->env);
+        if (pl->range->type == VAL_TUPLE) {
+            env_def(loop_env, var_name, pl->range->tuple.elems[i]);
+        } else {
+            Value *iv = value_new_int(pl->range->type == VAL_RANGE ? range_elem(pl->range->range.start, pl->range->range.step, i) : i);
+            env_def(loop_env, var_name, iv);
+            value_decref(iv);
+        }
+        EvalResult r = eval_block(node->body, loop_env);
+        env_decref(loop_env);
+        if (r.sig == SIG_YIELD) {
+            if (!*acc) { *acc = r.val; continue; }
+            EvalResult c = par_combine(node->op, *acc, r.val, node->line, node->col);
+            *acc = c.val;
+            if (c.sig != SIG_NONE) return c;
+            continue;
+        }
+        if (r.sig == SIG_BREAK || r.sig == SIG_RETURN) {
+            value_decref(r.val);
+            return err("break and return cannot leave a parallel loop", node->line, node->col);
+        }
+        if (r.sig == SIG_ERROR) return r;
+        value_decref(r.val);
+    }
+    return ok(NULL);
+}
+
+/* par_for callback: one chunk, run as pl->workers[worker]. */
+static void par_chunk(void *ctx, int worker, long long chunk) {
+    ParLoop *pl = ctx;
+    if (atomic_load_explicit(&pl->failed, memory_order_relaxed)) return;
+    Interpreter *w = &pl->workers[worker];
+    MemStats *prev_mem = mem_set_current(&w->mem);
+    Interpreter *prev_interp = cur_interp;
+    RuntimeStats *prev_stats = stats_current;
+    int prev_in = in_parallel;
+    cur_interp = w;
+    stats_current = stats_target(w);
+    in_parallel = 1;
+
+    long long lo = chunk * pl->chunk_size;
+    long long hi = lo + pl->chunk_size < pl->count ? lo + pl->chunk_size : pl->count;
+    Value *acc = NULL;
+    EvalResult r = par_iterations(pl, lo, hi, &acc);
+    if (r.sig == SIG_ERROR) {
+        value_decref(acc);
+        acc = NULL;
+        pl->errors[chunk] = strdup(r.error_msg);
+        atomic_store_explicit(&pl->failed, 1, memory_order_relaxed);
+    }
+    pl->partials[chunk] = acc;
+
+    in_parallel = prev_in;
+    cur_interp = prev_interp;
+    stats_current = prev_stats;
+    mem_set_current(prev_mem);
+}
+
+/* A worker starts from the loop's interpreter, with what is left of its
+   budget and memory limit, and with a heap of its own. */
+static void par_worker_init(Interpreter *w, const Interpreter *parent) {
+    if (parent) *w = *parent;
+    else memset(w, 0, sizeof(*w));
+    MemStats *ms = mem_current();
+    memset(&w->mem, 0, sizeof(w->mem));
+    w->mem.gc = gc_heap_new();
+    if (ms && ms->limit) w->mem.limit = ms->limit > ms->current ? ms->limit - ms->current : 1;
+    memset(&w->stats, 0, sizeof(w->stats));
+    w->generators = NULL;
+    memset(&w->frozen, 0, sizeof(w->frozen));
+    w->steps = 0;
+    if (w->step_limit) w->step_limit = parent->steps < parent->step_limit ? parent->step_limit - parent->steps : 1;
+    w->next_check = budget_next_check(w);
+}
+
+static EvalResult eval_parallel_for(AstNode *node, Env *env, Value *range) {
+    if (range->type == VAL_GENERATOR) {
+        value_decref(range);
+        return err("a parallel loop cannot iterate a generator: its values come one at a time", node->line, node->col);
+    }
+    ParLoop pl;
+    memset(&pl, 0, sizeof(pl));
+    pl.node = node;
+    pl.env = env;
+    pl.range = range;
+    pl.count = range->type == VAL_TUPLE ? range->tuple.count : range->type == VAL_INT ? range->int_val
+             : range->type == VAL_RANGE ? range->range.len : 0;
+    if (pl.count < 0) pl.count = 0;
+
+    /* Nested in another parallel loop: this thread's share of the outer one. */
+    if (in_parallel) {
+        Value *acc = NULL;
+        EvalResult r = par_iterations(&pl, 0, pl.count, &acc);
+        value_decref(range);
+        if (r.sig == SIG_ERROR) { value_decref(acc); return r; }
+        return ok(acc ? acc : value_new_null());
+    }
+    if (pl.count == 0) { value_decref(range); return ok(value_new_null()); }
+
+    /* the profilers and arenas keep per-thread state of the loop's thread */
+    int threads = (prof_active | instr_active | perfctr_active) || mem_arena_current() ? 1 : par_threads();
+    long long per_chunk = (long long)threads * PAR_CHUNKS_PER_THREAD;
+    pl.chunk_size = (pl.count + per_chunk - 1) / per_chunk;
+    long long chunks = (pl.count + pl.chunk_size - 1) / pl.chunk_size;
+    int workers = chunks < threads ? (int)chunks : threads;
+
+    Interpreter *parent = cur_interp;
+    pl.workers = malloc(sizeof(Interpreter) * (size_t)workers);
+    for (int i = 0; i < workers; i++) par_worker_init(&pl.workers[i], parent);
+    pl.partials = calloc((size_t)chunks, sizeof(Value *));
+    pl.errors = calloc((size_t)chunks, sizeof(char *));
+
+    pin_reachable(env, range, 1);
+    par_for(chunks, workers, par_chunk, &pl);
+    if (stats_current)
+        for (int i = 0; i < workers; i++) stats_add(stats_current, &pl.workers[i].stats);
+
+    /* Fold the chunks in order; the first failed chunk's error wins. */
+    EvalResult res = ok(NULL);
+    Value *acc = NULL;
+    for (long long c = 0; c < chunks; c++) {
+        if (pl.errors[c] && res.sig != SIG_ERROR) {
+            res.sig = SIG_ERROR;
+            snprintf(res.error_msg, sizeof(res.error_msg), "%s", pl.errors[c]);
+        }
+        free(pl.errors[c]);
+        Value *part = pl.partials[c];
+        if (!part) continue;
+        Value *copy = res.sig == SIG_ERROR ? NULL : value_deep_copy(part);
+        value_decref(part);
+        if (!copy) continue;
+        if (!acc) { acc = copy; continue; }
+        EvalResult cr = par_combine(node->op, acc, copy, node->line, node->col);
+        acc = cr.val;
+        if (cr.sig == SIG_ERROR) res = cr;
+    }
+
+    long long steps = 0;
+    for (int i = 0; i < workers; i++) {
+        steps += pl.workers[i].steps;
+        gc_heap_collect(pl.workers[i].mem.gc);
+        value_free_frozen(&pl.workers[i].frozen);   /* the partials were copied */
+        gc_heap_free(pl.workers[i].mem.gc);
+    }
+    pin_reachable(env, range, 0);
+    free(pl.workers);
+    free(pl.partials);
+    free(pl.errors);
+    value_decref(range);
+
+    if (parent && res.sig != SIG_ERROR) {
+        parent->steps += steps;
+        if (budget_exhausted(parent)) res = err_budget(node->line, node->col);
+    }
+    if (res.sig == SIG_ERROR) { value_decref(acc); return res; }
+    return ok(acc ? acc : value_new_null());
+}
+
 /* ------------------------------------------------------------------ function call */
 
+#define CALL_STACK_ARGS 8
+
 static EvalResult eval_call(AstNode *node, Env *env) {
     /* evaluate callee */
     EvalResult fn_r = eval(node->init, env);
     if (fn_r.sig != SIG_NONE) return fn_r;
     Value *fn = fn_r.val;
 
-    /* evaluate arguments */
+    /* evaluate arguments; short lists (nearly all) stay on the stack */
     int argc = node->child_count;
-    Value **args = calloc((size_t)(argc ? argc : 1), sizeof(Value *));
+    Value *small[CALL_STACK_ARGS];
+    Value **args = argc <= CALL_STACK_ARGS ? small : mem_calloc((size_t)argc, sizeof(Value *));
     for (int i = 0; i < argc; i++) {
         EvalResult ar = eval(node->children[i], env);
         if (ar.sig != SIG_NONE) {
             for (int j = 0; j < i; j++) value_decref(args[j]);
-            free(args);
+            if (args != small) mem_free(args);
             value_decref(fn);
             return ar;
         }
@@ -780,115 +1435,258 @@ static EvalResult eval_call(AstNode *node, Env *env) {
 
     EvalResult result = eval_fn_call(fn, args, argc, node->line, node->col);
     for (int i = 0; i < argc; i++) value_decref(args[i]);
-    free(args);
+    if (args != small) mem_free(args);
     value_decref(fn);
     return result;
 }
 
+static EvalResult call_value(Value *fn, Value **args, int argc, int line, int col);
+
+/* Name a callee is reported under by the profiler; must outlive the run. */
+static const char *callee_name(Value *fn) {
+    switch (fn->type) {
+        case VAL_FUNCTION:   return fn->fn.ast && fn->fn.ast->name ? fn->fn.ast->name : "<fn>";
+        case VAL_BUILTIN_FN: return fn->builtin.name;
+        case VAL_SCOPE:      return "<scope>";
+        case VAL_MODULE:     return fn->module.patdef ? fn->module.patdef->name : "<module>";
+        default:             return "<call>";
+    }
+}
+
+/* Call with the profiler, call instrumentation, tracer and/or heap profiler
+   observing it. */
+static EvalResult call_hooked(Value *fn, Value **args, int argc, int line, int col) {
+    int profiled = prof_active;
+    const char *heap_where = heapprof_where;
+    int heap_line = heapprof_line;
+    if (heapprof_active && fn->type == VAL_FUNCTION) heapprof_where = callee_name(fn);
+    int instrumented = 0;
+    long long traced = trace_calls ? trace_now() : 0;
+    if (profiled) prof_push(callee_name(fn), line);
+    if (instr_active) {
+        instrumented = 1;
+        if (fn->type == VAL_FUNCTION)
+            instr_enter(fn->fn.ast, INSTR_FUNCTION, callee_name(fn), fn->fn.ast ? fn->fn.ast->line : 0);
+        else if (fn->type == VAL_BUILTIN_FN)
+            instr_enter(NULL, INSTR_BUILTIN, fn->builtin.name, 0);
+        else if (fn->type == VAL_MODULE && fn->module.patdef) {
+            const PatDef *def = fn->module.patdef;
+            instr_enter(def->decl ? (const void *)def->decl : def, INSTR_PATTERN, def->name,
+                        def->decl ? def->decl->line : 0);
+        }
+        else
+            instrumented = 0;
+    }
+    EvalResult r = call_value(fn, args, argc, line, col);
+    if (instrumented) instr_leave();
+    heapprof_where = heap_where;
+    heapprof_line = heap_line;
+    if (profiled) prof_pop();
+    if (traced) trace_call(callee_name(fn), traced);
+    return r;
+}
+
 static EvalResult eval_fn_call(Value *fn, Value **args, int argc, int line, int col) {
     if (!fn) return err("called null value", line, col);
+    if (mem_over_limit()) return err_mem_limit(line, col);
+    if (budget_step()) return err_budget(line, col);
+    LANG_PROBE2(fn__entry, callee_name(fn), line);
+    EvalResult r;
+    if (!(prof_active | instr_active | trace_calls | heapprof_active)) r = call_value(fn, args, argc, line, col);
+    else r = call_hooked(fn, args, argc, line, col);
+    LANG_PROBE3(fn__return, callee_name(fn), line, r.sig == SIG_ERROR);
+    return r;
+}
 
-    if (fn->type == VAL_BUILTIN_FN) {
-        Value *r = fn->builtin.fn(args, argc);
-        return ok(r ? r : value_new_null());
+/* ------------------------------------------------------------------ builtin support */
+
+/* Failure reported by the builtin being called, see interp_raise(). */
+static _Thread_local int  builtin_failed;       /* 1 = message without position, 2 = complete message */
+static _Thread_local char builtin_error[256];
+static _Thread_local int  builtin_line, builtin_col;   /* call site of the innermost builtin */
+
+void interp_raise(const char *msg) {
+    snprintf(builtin_error, sizeof(builtin_error), "%s", msg);
+    builtin_failed = 1;
+}
+
+void interp_propagate(const EvalResult *r) {
+    snprintf(builtin_error, sizeof(builtin_error), "%s", r->error_msg);
+    builtin_failed = 2;
+}
+
+EvalResult interp_call(Value *fn, Value **args, int argc) {
+    int line = builtin_line, col = builtin_col;
+    EvalResult r = eval_fn_call(fn, args, argc, line, col);
+    builtin_line = line;
+    builtin_col = col;
+    return r;
+}
+
+static EvalResult builtin_failure(Value *r, int line, int col) {
+    if (r) value_decref(r);
+    int kind = builtin_failed;
+    builtin_failed = 0;
+    if (kind == 1) return err(builtin_error, line, col);
+    EvalResult e;
+    e.sig = SIG_ERROR;
+    e.val = NULL;
+    memcpy(e.error_msg, builtin_error, sizeof(e.error_msg));
+    return e;
+}
+
+static void describe_types(char *buf, size_t size, unsigned mask) {
+    size_t n = 0;
+    buf[0] = '\0';
+    for (int t = 0; t <= VAL_RANGE && n < size; t++) {
+        if (!(mask & (1u << t))) continue;
+        n += (size_t)snprintf(buf + n, size - n, "%s%s", n ? " or " : "", value_kind_name((ValueType)t));
     }
+}
 
-    if (fn->type == VAL_FUNCTION) {
-        AstNode *decl = fn->fn.ast;
-        Env *call_env = env_new(fn->fn.closure);
-
-        /* bind parameters */
-        int param_idx = 0;
-        for (int i = 0; i < decl->child_count; i++) {
-            AstNode *param = decl->children[i];
-            if (!param || param->type != AST_PARAM) continue;
-            Value *arg;
-            if (param_idx < argc) {
-                arg = args[param_idx];
-            } else if (param->init) {
-                /* evaluate the default value expression in the call environment */
-                EvalResult def_r = eval(param->init, call_env);
-                if (def_r.sig != SIG_NONE) {
-                    env_decref(call_env);
-                    return def_r;
-                }
-                arg = def_r.val;
-                env_def(call_env, param->name ? param->name : "_", arg);
-                value_decref(arg);
-                param_idx++;
-                continue;
-            } else {
-                arg = value_new_null();
-                env_def(call_env, param->name ? param->name : "_", arg);
-                value_decref(arg);
-                param_idx++;
-                continue;
+/* Check args against a builtin's declared signature, leaving the complaint in
+   builtin_error.  Nothing is allocated unless the check fails. */
+static int sig_mismatch(const Value *fn, Value **args, int argc) {
+    const NativeSig *s = fn->builtin.sig;
+    const char *name = fn->builtin.name;
+    if (argc < s->min_args || (s->max_args >= 0 && argc > s->max_args)) {
+        if (s->max_args == s->min_args)
+            snprintf(builtin_error, sizeof(builtin_error), "%s: expected %d argument%s, got %d",
+                     name, s->min_args, s->min_args == 1 ? "" : "s", argc);
+        else if (s->max_args < 0)
+            snprintf(builtin_error, sizeof(builtin_error), "%s: expected at least %d argument%s, got %d",
+                     name, s->min_args, s->min_args == 1 ? "" : "s", argc);
+        else
+            snprintf(builtin_error, sizeof(builtin_error), "%s: expected %d to %d arguments, got %d",
+                     name, s->min_args, s->max_args, argc);
+        return 1;
+    }
+    int n = s->type_count < argc ? s->type_count : argc;
+    for (int i = 0; i < n; i++) {
+        unsigned m = s->arg_types[i];
+        if (!m || !args[i] || (m & (1u << args[i]->type))) continue;
+        char want[96];
+        describe_types(want, sizeof(want), m);
+        snprintf(builtin_error, sizeof(builtin_error), "%s: argument %d must be %s, got %s",
+                 name, i + 1, want, value_kind_name(args[i]->type));
+        return 1;
+    }
+    return 0;
+}
+
+EvalResult interp_call_body(Value *fn, Value **args, int argc, int line, int col) {
+    AstNode *decl = fn->fn.ast;
+    Env *call_env = env_new(fn->fn.closure);
+    if (fn->fn.captures) { call_env->fn = fn; value_incref(fn); }
+
+    /* bind parameters */
+    int param_idx = 0;
+    for (int i = 0; i < decl->child_count; i++) {
+        AstNode *param = decl->children[i];
+        if (!param || param->type != AST_PARAM) continue;
+        Value *arg;
+        if (param_idx < argc) {
+            arg = args[param_idx];
+        } else if (param->init) {
+            /* evaluate the default value expression in the call environment */
+            EvalResult def_r = eval(param->init, call_env);
+            if (def_r.sig != SIG_NONE) {
+                env_decref(call_env);
+                return def_r;
             }
+            arg = def_r.val;
             env_def(call_env, param->name ? param->name : "_", arg);
+            value_decref(arg);
             param_idx++;
+            continue;
+        } else {
+            arg = value_new_null();
+            env_def(call_env, param->name ? param->name : "_", arg);
+            value_decref(arg);
+            param_idx++;
+            continue;
         }
+        env_def(call_env, param->name ? param->name : "_", arg);
+        param_idx++;
+    }
 
-        /* define named return variables in function scope (initialised to null) */
-        AstNode *ret_type = decl->type_ann;
-        int named_ret_count = 0;
-        if (ret_type && ret_type->type == AST_TUPLE) {
-            for (int i = 0; i < ret_type->child_count; i++) {
-                AstNode *rta = ret_type->children[i];
-                if (rta && rta->name) {
-                    Value *init = value_new_null();
-                    env_def(call_env, rta->name, init);
-                    value_decref(init);
-                    named_ret_count++;
-                }
+    /* define named return variables in function scope (initialised to null) */
+    AstNode *ret_type = decl->type_ann;
+    int named_ret_count = 0;
+    if (ret_type && ret_type->type == AST_TUPLE) {
+        for (int i = 0; i < ret_type->child_count; i++) {
+            AstNode *rta = ret_type->children[i];
+            if (rta && rta->name) {
+                Value *init = value_new_null();
+                env_def(call_env, rta->name, init);
+                value_decref(init);
+                named_ret_count++;
             }
         }
+    }
 
-        /* execute body */
-        EvalResult r;
-        if (decl->body) {
-            r = eval_block(decl->body, call_env);
-        } else {
-            r = ok(value_new_null());
-        }
+    /* execute body */
+    EvalResult r;
+    if (decl->body) {
+        r = eval_block(decl->body, call_env);
+    } else {
+        r = ok(value_new_null());
+    }
 
-        /* on implicit fall-through or bare `return`, collect named return vars */
-        if (named_ret_count > 0 &&
-            (r.sig == SIG_NONE ||
-             (r.sig == SIG_RETURN && r.val && r.val->type == VAL_NULL))) {
-            Value *ret_tuple = value_new_tuple(named_ret_count);
-            ret_tuple->tuple.names = calloc((size_t)named_ret_count, sizeof(char *));
-            if (!ret_tuple->tuple.names) {
-                value_decref(ret_tuple);
-                if (r.val) value_decref(r.val);
-                env_decref(call_env);
-                return err("out of memory collecting return values", line, col);
-            }
-            int ti = 0;
-            for (int i = 0; i < ret_type->child_count; i++) {
-                AstNode *rta = ret_type->children[i];
-                if (!rta || !rta->name) continue;
-                ret_tuple->tuple.names[ti] = strdup(rta->name);
-                Value *v = env_get(call_env, rta->name);
-                if (v) { value_incref(v); ret_tuple->tuple.elems[ti] = v; }
-                else   { ret_tuple->tuple.elems[ti] = value_new_null(); }
-                ti++;
-            }
+    /* on implicit fall-through or bare `return`, collect named return vars */
+    if (named_ret_count > 0 &&
+        (r.sig == SIG_NONE ||
+         (r.sig == SIG_RETURN && r.val && r.val->type == VAL_NULL))) {
+        Value *ret_tuple = value_new_tuple(named_ret_count);
+        ret_tuple->tuple.names = mem_calloc((size_t)named_ret_count, sizeof(char *));
+        if (!ret_tuple->tuple.names) {
+            value_decref(ret_tuple);
             if (r.val) value_decref(r.val);
             env_decref(call_env);
-            return ok(ret_tuple);
+            return err("out of memory collecting return values", line, col);
         }
-
+        int ti = 0;
+        for (int i = 0; i < ret_type->child_count; i++) {
+            AstNode *rta = ret_type->children[i];
+            if (!rta || !rta->name) continue;
+            ret_tuple->tuple.names[ti] = mem_strdup(rta->name);
+            Value *v = env_get(call_env, rta->name);
+            if (v) { value_incref(v); ret_tuple->tuple.elems[ti] = v; }
+            else   { ret_tuple->tuple.elems[ti] = value_new_null(); }
+            ti++;
+        }
+        if (r.val) value_decref(r.val);
         env_decref(call_env);
+        return ok(ret_tuple);
+    }
 
-        if (r.sig == SIG_RETURN && ret_type && ret_type->type == AST_TUPLE &&
-                r.val && r.val->type != VAL_NULL &&
-                !tuple_value_matches_decl(r.val, ret_type)) {
-            value_decref(r.val);
-            return err("return tuple mismatch: expected declared tuple field names/types", line, col);
-        }
-        if (r.sig == SIG_RETURN) { r.sig = SIG_NONE; return r; }
-        if (r.sig == SIG_ERROR)  return r;
-        return r;
+    env_decref(call_env);
+
+    if (r.sig == SIG_RETURN && ret_type && ret_type->type == AST_TUPLE &&
+            r.val && r.val->type != VAL_NULL &&
+            !tuple_value_matches_decl(r.val, ret_type)) {
+        value_decref(r.val);
+        return err("return tuple mismatch: expected declared tuple field names/types", line, col);
+    }
+    if (r.sig == SIG_RETURN) { r.sig = SIG_NONE; return r; }
+    if (r.sig == SIG_ERROR)  return r;
+    return r;
+}
+
+static EvalResult call_value(Value *fn, Value **args, int argc, int line, int col) {
+    if (fn->type == VAL_BUILTIN_FN) {
+        if (fn->builtin.sig && sig_mismatch(fn, args, argc)) return err(builtin_error, line, col);
+        builtin_line = line;
+        builtin_col = col;
+        Value *r = fn->builtin.native ? fn->builtin.native(fn->builtin.ctx, args, argc)
+                                      : fn->builtin.fn(args, argc);
+        if (builtin_failed) return builtin_failure(r, line, col);
+        return ok(r ? r : value_new_null());
+    }
+
+    if (fn->type == VAL_FUNCTION) {
+        if (fn->fn.ast->is_generator) return ok(gen_new(fn, args, argc, line, col));
+        return interp_call_body(fn, args, argc, line, col);
     }
 
     if (fn->type == VAL_SCOPE) {
@@ -913,12 +1711,12 @@ static EvalResult eval_fn_call(Value *fn, Value **args, int argc, int line, int
             (r.sig == SIG_NONE ||
              (r.sig == SIG_RETURN && r.val && r.val->type == VAL_NULL))) {
             Value *ret_tuple = value_new_tuple(named_ret_count);
-            ret_tuple->tuple.names = calloc((size_t)named_ret_count, sizeof(char *));
+            ret_tuple->tuple.names = mem_calloc((size_t)named_ret_count, sizeof(char *));
             int ti = 0;
             for (int i = 0; i < ret_type->child_count; i++) {
                 AstNode *rta = ret_type->children[i];
                 if (!rta || !rta->name) continue;
-                ret_tuple->tuple.names[ti] = strdup(rta->name);
+                ret_tuple->tuple.names[ti] = mem_strdup(rta->name);
                 Value *v = env_get(call_env, rta->name);
                 if (v) { value_incref(v); ret_tuple->tuple.elems[ti] = v; }
                 else   { ret_tuple->tuple.elems[ti] = value_new_null(); }
@@ -973,7 +1771,7 @@ static EvalResult eval_fn_call(Value *fn, Value **args, int argc, int line, int
             }
             if (strcmp(tname, "string") == 0) {
                 char *s = value_to_string(arg);
-                Value *r = value_new_string(s); free(s);
+                Value *r = value_new_string(s); mem_free(s);
                 return ok(r);
             }
         }
@@ -985,23 +1783,139 @@ static EvalResult eval_fn_call(Value *fn, Value **args, int argc, int line, int
 
 /* ------------------------------------------------------------------ Interpreter */
 
+/* Where the counters of a run of interp go, if anywhere. */
+static RuntimeStats *stats_target(Interpreter *interp) {
+    if (!interp->stats_enabled) return NULL;
+    return stats_per_thread() ? stats_thread() : &interp->stats;
+}
+
 void interp_init(Interpreter *interp) {
+    memset(&interp->mem, 0, sizeof(interp->mem));
+    interp->mem.gc = gc_heap_new();
+    mem_set_current(&interp->mem);
+    interp->step_limit = 0;
+    interp->timeout_ns = 0;
+    interp->running = 0;
+    budget_reset(interp);
+    cur_interp = interp;
+    memset(&interp->stats, 0, sizeof(interp->stats));
+    interp->stats_enabled = 0;
+    stats_current = NULL;
     interp->global = env_new(NULL);
+    interp->modules = mem_alloc(sizeof(ModuleSystem));
+    module_system_init(interp->modules);
+    interp->module_root = NULL;
+    interp->generators = NULL;
+    memset(&interp->frozen, 0, sizeof(interp->frozen));
+    interp->out = NULL;
     interp->had_error = 0;
     interp->error_msg[0] = '\0';
     builtins_register(interp->global);
 }
 
-void interp_run(Interpreter *interp, AstNode *program) {
-    EvalResult r = eval(program, interp->global);
+/* Thread state a run makes current, and what it restores afterwards. */
+typedef struct {
+    MemStats     *mem;
+    Interpreter  *interp;
+    RuntimeStats *stats;
+} RunState;
+
+static RunState run_enter(Interpreter *interp) {
+    RunState prev = { mem_set_current(&interp->mem), cur_interp, stats_current };
+    cur_interp = interp;
+    stats_current = stats_target(interp);
+    if (interp->running++ == 0) budget_reset(interp);
+    return prev;
+}
+
+static Value *run_leave(Interpreter *interp, const RunState *prev, EvalResult r) {
     if (r.sig == SIG_ERROR) {
+        LANG_PROBE1(error, (const char *)r.error_msg);
         interp->had_error = 1;
-        strncpy(interp->error_msg, r.error_msg, sizeof(interp->error_msg) - 1);
+        snprintf(interp->error_msg, sizeof(interp->error_msg), "%s", r.error_msg);
+        value_decref(r.val);
+        r.val = NULL;
     }
-    value_decref(r.val);
+    interp->running--;
+    cur_interp = prev->interp;
+    stats_current = prev->stats;
+    mem_set_current(prev->mem);
+    return r.val;
+}
+
+Value *interp_run_in(Interpreter *interp, AstNode *program, Env *env) {
+    RunState prev = run_enter(interp);
+    int profiled = prof_active;
+    if (profiled) prof_push("main", program ? program->line : 0);
+    EvalResult r = eval(program, env);
+    if (profiled) { prof_pop(); prof_drain(); }
+    return run_leave(interp, &prev, r);
+}
+
+Value *interp_run_value(Interpreter *interp, AstNode *program) {
+    return interp_run_in(interp, program, interp->global);
+}
+
+Value *interp_call_value(Interpreter *interp, Value *fn, Value **args, int argc) {
+    RunState prev = run_enter(interp);
+    EvalResult r = eval_fn_call(fn, args, argc, 0, 0);
+    return run_leave(interp, &prev, r);
+}
+
+void interp_run(Interpreter *interp, AstNode *program) {
+    value_decref(interp_run_value(interp, program));
 }
 
 void interp_free(Interpreter *interp) {
+    /* a suspended generator body holds its frame until unwound */
+    RunState prev = run_enter(interp);
+    gen_close_all(interp);
+    run_leave(interp, &prev, ok(NULL));
+    module_system_free(interp->modules);
+    mem_free(interp->modules);
+    interp->modules = NULL;
     env_decref(interp->global);
     interp->global = NULL;
+    /* functions keep their defining env alive, so the global env usually
+       survives the decref above as part of a cycle */
+    gc_heap_collect(interp->mem.gc);
+    value_free_frozen(&interp->frozen);
+    gc_heap_free(interp->mem.gc);
+    interp->mem.gc = NULL;
+    if (mem_current() == &interp->mem) mem_set_current(NULL);
+    if (cur_interp == interp) cur_interp = NULL;
+    if (stats_current == &interp->stats) stats_current = NULL;
+}
+
+void interp_discard(Interpreter *interp) {
+    interp->global = NULL;
+    interp->modules = NULL;
+    interp->generators = NULL;
+    value_free_frozen(&interp->frozen);
+    gc_heap_free(interp->mem.gc);
+    interp->mem.gc = NULL;
+    if (mem_current() == &interp->mem) mem_set_current(NULL);
+    if (cur_interp == interp) cur_interp = NULL;
+    if (stats_current == &interp->stats) stats_current = NULL;
 }
+
+void interp_set_mem_limit(Interpreter *interp, size_t bytes) {
+    interp->mem.limit = bytes;
+}
+
+void interp_set_step_limit(Interpreter *interp, long long steps) {
+    interp->step_limit = steps > 0 ? steps : 0;
+    budget_reset(interp);
+}
+
+void interp_set_timeout(Interpreter *interp, long long ms) {
+    interp->timeout_ns = ms > 0 ? ms * 1000000LL : 0;
+    budget_reset(interp);
+}
+
+void interp_enable_stats(Interpreter *interp, int on) {
+    interp->stats_enabled = on;
+    if (cur_interp == interp) stats_current = stats_target(interp);
+}
+
+Interpreter *interp_current(void) { return cur_interp; }
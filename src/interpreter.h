@@ -3,27 +3,40 @@
 
 #include "ast.h"
 #include "value.h"
+#include "mem.h"
+#include "stats.h"
+#include <stdio.h>
 
-/* Symbol table entry */
-typedef struct EnvEntry {
+/* Symbol table entry.  Entries are owned by their Env's list; closures that
+   capture one take an extra ref and keep it alive past the Env. */
+struct EnvEntry {
     char  *name;
     Value *val;
     struct EnvEntry *next;
-} EnvEntry;
+    int    ref_count;
+    int    gc_slot : 31;     /* tracked by the cycle collector once shared */
+    unsigned pinned : 1;     /* see Value.pinned */
+};
 
 /* Environment (linked list of scopes) */
 struct Env {
     EnvEntry *entries;
     struct Env *parent;
+    Value    *fn;        /* function called in this frame; its captures are searched before parent */
     int       ref_count;
+    int       gc_slot : 31;   /* cycle collector slot, see gc.h */
+    unsigned  pinned : 1;     /* see Value.pinned */
 };
 
 Env   *env_new(Env *parent);
 void   env_incref(Env *e);
 void   env_decref(Env *e);
+void   env_clear(Env *e);                               /* drop all bindings and the parent */
 Value *env_get(Env *e, const char *name);
 void   env_set(Env *e, const char *name, Value *val);   /* sets in nearest scope that has it, or current */
 void   env_def(Env *e, const char *name, Value *val);   /* defines in current scope */
+void   entry_incref(EnvEntry *en);
+void   entry_decref(EnvEntry *en);
 
 /* Control flow signals */
 typedef enum {
@@ -48,10 +61,62 @@ typedef struct {
     Env *global;
     char error_msg[256];
     int  had_error;
+    MemStats mem;     /* everything allocated on behalf of this interpreter */
+
+    /* Evaluation budget, checked at loop back-edges and function entry.  Both
+       limits apply afresh to each outermost run; a run nested in one of the
+       same interpreter (a native calling back in) counts against it.  0 means
+       unlimited. */
+    long long step_limit;    /* loop iterations + calls allowed per run */
+    long long timeout_ns;    /* wall-clock time allowed per run (monotonic clock) */
+    long long steps;         /* steps taken in the current run */
+    long long next_check;    /* step count at which the limits are next examined */
+    long long deadline_ns;   /* absolute monotonic deadline of the current run, 0 = none */
+    int       running;       /* runs of this interpreter in progress */
+    RuntimeStats stats;      /* runtime counters, collected while stats_enabled */
+    int          stats_enabled;
+
+    struct ModuleSystem *modules;   /* modules imported so far, see module.h */
+    Generator   *generators;        /* started and unfinished, see generator.h */
+    FrozenSet    frozen;            /* see value_freeze */
+    const char  *module_root;       /* directory imports resolve against; NULL = current */
+    FILE        *out;               /* where print writes; NULL = stdout */
 } Interpreter;
 
+/* interp_init makes the new interpreter (and its MemStats) current on this
+   thread, so parsing done afterwards is charged to it as well; interp_run
+   makes it current for the duration of the run. */
 void interp_init(Interpreter *interp);
 void interp_run(Interpreter *interp, AstNode *program);
+Value *interp_run_value(Interpreter *interp, AstNode *program);  /* value of the last statement, NULL on error */
+Value *interp_run_in(Interpreter *interp, AstNode *program, Env *env);   /* same, in env (a child of global) */
+/* Call fn(args) as a run of its own (limits, current interpreter); new ref to
+   the result, NULL on error. */
+Value *interp_call_value(Interpreter *interp, Value *fn, Value **args, int argc);
 void interp_free(Interpreter *interp);
 
+/* Arena mode: an interpreter created while a MemArena is entered (see mem.h)
+   lives entirely in that arena along with everything it parses and evaluates.
+   Instead of interp_free, leave the arena, copy out what must survive with
+   value_deep_copy, then call interp_discard and reset the arena. */
+void interp_discard(Interpreter *interp);
+void interp_set_mem_limit(Interpreter *interp, size_t bytes);   /* 0 = unlimited */
+void interp_set_step_limit(Interpreter *interp, long long steps); /* 0 = unlimited */
+void interp_set_timeout(Interpreter *interp, long long ms);       /* 0 = unlimited */
+void interp_enable_stats(Interpreter *interp, int on);            /* see stats.h */
+Interpreter *interp_current(void);   /* interpreter running (or last initialised) on this thread */
+
+/* For builtins.  interp_call calls fn the way a call expression at the
+   builtin's own call site would (budget, limits and profiling hooks
+   included); the result's value is a new reference.  interp_raise makes the
+   running builtin fail with a runtime error at its call site once it returns,
+   interp_propagate with an error an interp_call returned. */
+EvalResult interp_call(Value *fn, Value **args, int argc);
+void interp_raise(const char *msg);
+void interp_propagate(const EvalResult *r);
+
+/* For generators (see generator.h): run the body of function fn, called at
+   line:col, as a plain call would, even though fn is a generator function. */
+EvalResult interp_call_body(Value *fn, Value **args, int argc, int line, int col);
+
 #endif /* INTERPRETER_H */
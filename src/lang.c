@@ -0,0 +1,316 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lang.h"
+#include "lexer.h"
+#include "parser.h"
+#include "interpreter.h"
+#include "mem.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char        *name;
+    LangNativeFn fn;
+    void        *ctx;
+    NativeSig   *sig;   /* own allocation: values point at it */
+} Native;
+
+struct LangInterp {
+    Interpreter interp;
+    Native     *natives;
+    int         native_count, native_cap;
+    MemArena   *arena;   /* for lang_run_scoped, made on first use */
+    char        error[256];
+};
+
+struct LangProgram {
+    AstNode *ast;
+};
+
+/* ------------------------------------------------------------------ interpreters */
+
+static void define_native(LangInterp *L, const Native *n) {
+    MemStats *prev = mem_set_current(&L->interp.mem);
+    Value *v = value_new_native(n->fn, n->ctx, n->sig, n->name);
+    env_def(L->interp.global, n->name, v);
+    value_decref(v);
+    mem_set_current(prev);
+}
+
+/* interp_init leaves the new interpreter current for parsing; the API keeps
+   allocations made between calls uncharged instead. */
+static void init_interp(LangInterp *L) {
+    MemStats *prev = mem_current();
+    interp_init(&L->interp);
+    mem_set_current(prev);
+}
+
+LangInterp *lang_new(void) {
+    LangInterp *L = calloc(1, sizeof(LangInterp));
+    if (!L) return NULL;
+    init_interp(L);
+    return L;
+}
+
+void lang_free(LangInterp *L) {
+    if (!L) return;
+    MemStats *prev = mem_current();
+    interp_free(&L->interp);
+    mem_set_current(prev == &L->interp.mem ? NULL : prev);
+    for (int i = 0; i < L->native_count; i++) {
+        free(L->natives[i].name);
+        free(L->natives[i].sig);
+    }
+    free(L->natives);
+    mem_arena_free(L->arena);
+    free(L);
+}
+
+void lang_reset(LangInterp *L) {
+    long long step_limit = L->interp.step_limit;
+    long long timeout_ns = L->interp.timeout_ns;
+    MemStats *prev = mem_current();
+    interp_free(&L->interp);
+    mem_set_current(prev == &L->interp.mem ? NULL : prev);
+
+    /* values the host still holds stay charged here and are credited back
+       when released, so the counts carry over rather than restart */
+    MemStats old = L->interp.mem;
+    init_interp(L);
+    L->interp.mem.current += old.current;
+    L->interp.mem.allocs  += old.allocs;
+    if (mem_peak(&old) > mem_peak(&L->interp.mem)) L->interp.mem.peak = mem_peak(&old);
+    L->interp.mem.limit = old.limit;
+    interp_set_step_limit(&L->interp, step_limit);
+    L->interp.timeout_ns = timeout_ns;
+    for (int i = 0; i < L->native_count; i++) define_native(L, &L->natives[i]);
+    L->error[0] = '\0';
+}
+
+const char *lang_error(const LangInterp *L) {
+    return L->error;
+}
+
+void lang_set_limits(LangInterp *L, size_t mem_bytes, long long max_steps, long long timeout_ms) {
+    interp_set_mem_limit(&L->interp, mem_bytes);
+    interp_set_step_limit(&L->interp, max_steps);
+    interp_set_timeout(&L->interp, timeout_ms);
+}
+
+static unsigned type_mask(LangType t) {
+    switch (t) {
+        case LANG_NULL:   return 1u << VAL_NULL;
+        case LANG_INT:    return 1u << VAL_INT;
+        case LANG_FLOAT:  return 1u << VAL_FLOAT;
+        case LANG_NUMBER: return 1u << VAL_INT | 1u << VAL_FLOAT;
+        case LANG_STRING: return 1u << VAL_STRING;
+        case LANG_BOOL:   return 1u << VAL_BOOL;
+        case LANG_TUPLE:  return 1u << VAL_TUPLE;
+        case LANG_OTHER:  return ~(1u << VAL_NULL | 1u << VAL_INT | 1u << VAL_FLOAT | 1u << VAL_STRING |
+                                   1u << VAL_BOOL | 1u << VAL_TUPLE);
+        case LANG_ANY:    return 0;
+    }
+    return ~0u;   /* not a LangType */
+}
+
+static int invalid(LangInterp *L, const char *what) {
+    snprintf(L->error, sizeof(L->error), "lang_define: %s", what);
+    return -1;
+}
+
+int lang_define(LangInterp *L, const LangNativeDef *def) {
+    if (!def || !def->name || !def->name[0] || !def->fn) return invalid(L, "name and fn are required");
+    if (def->min_args < 0 || (def->max_args >= 0 && def->max_args < def->min_args))
+        return invalid(L, "bad arity");
+    if (def->type_count < 0 || def->type_count > LANG_MAX_TYPED_ARGS || (def->type_count && !def->arg_types))
+        return invalid(L, "bad argument type list");
+    if (def->max_args >= 0 && def->type_count > def->max_args)
+        return invalid(L, "more argument types than arguments");
+
+    NativeSig *sig = calloc(1, sizeof(NativeSig));
+    if (!sig) return invalid(L, "out of memory");
+    sig->min_args = def->min_args;
+    sig->max_args = def->max_args;
+    sig->type_count = def->type_count;
+    for (int i = 0; i < def->type_count; i++) {
+        sig->arg_types[i] = type_mask(def->arg_types[i]);
+        if (sig->arg_types[i] == ~0u) { free(sig); return invalid(L, "unknown argument type"); }
+    }
+
+    if (L->native_count >= L->native_cap) {
+        int cap = L->native_cap ? L->native_cap * 2 : 8;
+        Native *n = realloc(L->natives, sizeof(Native) * (size_t)cap);
+        if (!n) { free(sig); return invalid(L, "out of memory"); }
+        L->natives = n;
+        L->native_cap = cap;
+    }
+    Native *n = &L->natives[L->native_count++];
+    n->name = strdup(def->name);
+    n->fn = def->fn;
+    n->ctx = def->ctx;
+    n->sig = sig;
+    define_native(L, n);
+    return 0;
+}
+
+int lang_register(LangInterp *L, const char *name, LangNativeFn fn, void *ctx) {
+    LangNativeDef def = { name, fn, ctx, 0, -1, NULL, 0 };
+    return lang_define(L, &def);
+}
+
+void lang_raise(const char *fmt, ...) {
+    char msg[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    interp_raise(msg);
+}
+
+/* ------------------------------------------------------------------ programs */
+
+LangProgram *lang_compile(const char *source, const char *name, char *err, size_t err_size) {
+    /* the tree belongs to no interpreter, so none is charged for it */
+    MemStats *prev = mem_set_current(NULL);
+    Lexer lex;
+    lexer_init(&lex, source);
+    Parser parser;
+    parser_init(&parser, &lex);
+    AstNode *ast = parse_program(&parser);
+    token_free(&parser.cur);
+    mem_set_current(prev);
+
+    if (parser.had_error) {
+        if (err && err_size) snprintf(err, err_size, "%s: %s", name ? name : "<source>", parser.error_msg);
+        ast_free(ast);
+        return NULL;
+    }
+    LangProgram *P = malloc(sizeof(LangProgram));
+    if (!P) { ast_free(ast); return NULL; }
+    P->ast = ast;
+    return P;
+}
+
+void lang_program_free(LangProgram *P) {
+    if (!P) return;
+    ast_free(P->ast);
+    free(P);
+}
+
+static int finish(LangInterp *L, Value *r, LangValue **result) {
+    if (L->interp.had_error) {
+        snprintf(L->error, sizeof(L->error), "%s", L->interp.error_msg);
+        L->interp.had_error = 0;
+        if (result) *result = NULL;
+        return -1;
+    }
+    if (result) *result = r;
+    else value_decref(r);
+    return 0;
+}
+
+int lang_run(LangInterp *L, const LangProgram *P, LangValue **result) {
+    return finish(L, interp_run_value(&L->interp, P->ast), result);
+}
+
+int lang_run_scoped(LangInterp *L, const LangProgram *P, LangValue **result) {
+    if (!L->arena && !(L->arena = mem_arena_new(0))) {
+        snprintf(L->error, sizeof(L->error), "out of memory for an arena");
+        if (result) *result = NULL;
+        return -1;
+    }
+    mem_arena_set_owner(L->arena, &L->interp.mem);
+    MemArena *prev_arena = mem_arena_enter(L->arena);
+    MemStats *prev = mem_set_current(&L->interp.mem);
+    Env *scope = env_new(L->interp.global);
+    Value *r = interp_run_in(&L->interp, P->ast, scope);
+    mem_arena_enter(NULL);
+    Value *copy = r && !L->interp.had_error ? value_deep_copy(r) : NULL;
+    /* dropped inside the arena, so the globals they refer to are released */
+    mem_arena_enter(L->arena);
+    value_decref(r);
+    env_decref(scope);
+    mem_set_current(prev);
+    mem_arena_enter(prev_arena);
+    mem_arena_reset(L->arena);
+    return finish(L, copy, result);
+}
+
+int lang_call(LangInterp *L, const char *name, LangValue **args, int argc, LangValue **result) {
+    Value *fn = env_get(L->interp.global, name);
+    if (!fn || (fn->type != VAL_FUNCTION && fn->type != VAL_BUILTIN_FN && fn->type != VAL_SCOPE)) {
+        snprintf(L->error, sizeof(L->error), "no function named '%s'", name);
+        if (result) *result = NULL;
+        return -1;
+    }
+    value_incref(fn);   /* the call may rebind name */
+    Value *r = interp_call_value(&L->interp, fn, args, argc);
+    value_decref(fn);
+    return finish(L, r, result);
+}
+
+/* ------------------------------------------------------------------ values */
+
+LangValue *lang_null(void)           { return value_new_null(); }
+LangValue *lang_int(long long v)     { return value_new_int(v); }
+LangValue *lang_float(double v)      { return value_new_float(v); }
+LangValue *lang_bool(int v)          { return value_new_bool(v); }
+LangValue *lang_string(const char *s) { return value_new_string(s ? s : ""); }
+void       lang_retain(LangValue *v)  { value_incref(v); }
+void       lang_release(LangValue *v) { value_decref(v); }
+
+LangType lang_type(const LangValue *v) {
+    if (!v) return LANG_NULL;
+    switch (v->type) {
+        case VAL_NULL:   return LANG_NULL;
+        case VAL_INT:    return LANG_INT;
+        case VAL_FLOAT:  return LANG_FLOAT;
+        case VAL_STRING: return LANG_STRING;
+        case VAL_BOOL:   return LANG_BOOL;
+        case VAL_TUPLE:  return LANG_TUPLE;
+        default:         return LANG_OTHER;
+    }
+}
+
+long long lang_to_int(const LangValue *v) {
+    if (!v) return 0;
+    switch (v->type) {
+        case VAL_INT:   return v->int_val;
+        case VAL_FLOAT: return (long long)v->float_val;
+        case VAL_BOOL:  return v->bool_val;
+        default:        return 0;
+    }
+}
+
+double lang_to_float(const LangValue *v) {
+    if (v && v->type == VAL_FLOAT) return v->float_val;
+    return (double)lang_to_int(v);
+}
+
+const char *lang_to_string(const LangValue *v) {
+    return v && v->type == VAL_STRING ? v->str_val : NULL;
+}
+
+int lang_tuple_count(const LangValue *v) {
+    return v && v->type == VAL_TUPLE ? v->tuple.count : 0;
+}
+
+LangValue *lang_tuple_at(const LangValue *v, int i) {
+    if (!v || v->type != VAL_TUPLE || i < 0 || i >= v->tuple.count) return NULL;
+    return v->tuple.elems[i];
+}
+
+LangValue *lang_field(const LangValue *v, const char *name) {
+    if (!v || !name) return NULL;
+    if (v->type == VAL_TUPLE && v->tuple.names) {
+        for (int i = 0; i < v->tuple.count; i++)
+            if (v->tuple.names[i] && strcmp(v->tuple.names[i], name) == 0) return v->tuple.elems[i];
+    }
+    if (v->type == VAL_PAT_INST && v->pat_inst.def) {
+        const PatDef *d = v->pat_inst.def;
+        for (int i = 0; i < d->field_count && i < v->pat_inst.count; i++)
+            if (strcmp(d->field_names[i], name) == 0) return v->pat_inst.fields[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,125 @@
+#ifndef LANG_H
+#define LANG_H
+
+/* Embedding API (liblang).
+ *
+ * A LangProgram is source compiled once: an immutable syntax tree that any
+ * number of interpreters may run any number of times, so a host evaluating
+ * the same script over and over pays for lexing and parsing only once.  A
+ * LangInterp owns a global environment; lang_run() evaluates a program in it,
+ * so definitions persist from one run to the next, and lang_reset() starts
+ * over with a fresh one.  A program must outlive every interpreter that ran it
+ * (or until they are reset), since functions it defined point into its tree.
+ *
+ * Values cross the API as LangValue pointers.  Functions returning a
+ * LangValue * give the caller a reference to drop with lang_release();
+ * accessors marked "borrowed" return one owned by their container.  Values
+ * an interpreter produced must be released before lang_free(), as they are
+ * charged to its memory accounting.
+ *
+ * Interpreters share no mutable state: each has its own globals, memory
+ * accounting and cycle collector heap, so any number of them may run at once
+ * on different threads, sharing LangPrograms, which are never written to.
+ * One interpreter, and the values it produced, is used by one thread at a
+ * time.  The profiling and tracing tools of the command-line interpreter are
+ * process-wide and not meant for this. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct LangInterp  LangInterp;
+typedef struct LangProgram LangProgram;
+typedef struct Value       LangValue;
+
+typedef enum {
+    LANG_NULL, LANG_INT, LANG_FLOAT, LANG_STRING, LANG_BOOL, LANG_TUPLE, LANG_OTHER,
+    LANG_NUMBER,   /* in declarations only: int or float */
+    LANG_ANY       /* in declarations only: unchecked */
+} LangType;
+
+/* Host function callable from scripts.  args are borrowed from the caller for
+   the duration of the call, with no reference taken on the host's behalf:
+   lang_retain() any the host keeps.  Returning NULL yields null; to fail the
+   call with a runtime error instead, call lang_raise() before returning. */
+typedef LangValue *(*LangNativeFn)(void *ctx, LangValue **args, int argc);
+
+/* A host function with its declared signature.  Arity and the types of the
+   first type_count arguments are checked by the interpreter before each call,
+   failing it with a runtime error that names the function, so fn may index
+   args without checking them.  The definition is validated and copied by
+   lang_define(); arg_types need not outlive it. */
+#define LANG_MAX_TYPED_ARGS 8
+typedef struct {
+    const char     *name;
+    LangNativeFn    fn;
+    void           *ctx;        /* passed back to fn on each call */
+    int             min_args;
+    int             max_args;   /* < 0: no upper bound */
+    const LangType *arg_types;  /* type_count entries, or NULL */
+    int             type_count; /* at most LANG_MAX_TYPED_ARGS */
+} LangNativeDef;
+
+/* ---- interpreters ---- */
+LangInterp *lang_new(void);
+void        lang_free(LangInterp *L);
+void        lang_reset(LangInterp *L);        /* fresh global environment; natives and limits kept */
+const char *lang_error(const LangInterp *L);  /* message of the last failed run or call */
+
+/* Limits applied to every run and call; 0 = unlimited. */
+void lang_set_limits(LangInterp *L, size_t mem_bytes, long long max_steps, long long timeout_ms);
+
+/* Bind def->name in the global environment to def->fn; 0 on success, -1 (with
+   lang_error() saying why) for an invalid definition. */
+int lang_define(LangInterp *L, const LangNativeDef *def);
+
+/* lang_define() with any number of unchecked arguments. */
+int lang_register(LangInterp *L, const char *name, LangNativeFn fn, void *ctx);
+
+/* From inside a host function: fail the call with a runtime error at its call
+   site once the function returns (its return value is discarded). */
+void lang_raise(const char *fmt, ...);
+
+/* ---- programs ---- */
+/* NULL on a syntax error, described in err (if not NULL). */
+LangProgram *lang_compile(const char *source, const char *name, char *err, size_t err_size);
+void         lang_program_free(LangProgram *P);
+
+/* 0 on success; *result (if not NULL) receives the last statement's value. */
+int lang_run(LangInterp *L, const LangProgram *P, LangValue **result);
+
+/* lang_run() for one request: P runs in a scope of its own whose allocations
+   all come from an arena of L's, dropped in one step when the run returns, so
+   a host serving many requests neither frees them one by one nor keeps them.
+   *result receives a copy made outside the arena.  What the run assigns to
+   existing globals is copied out likewise; in both copies functions and
+   scopes become null.  Its own definitions do not outlive it. */
+int lang_run_scoped(LangInterp *L, const LangProgram *P, LangValue **result);
+
+/* Call the global function name with args (borrowed); 0 on success. */
+int lang_call(LangInterp *L, const char *name, LangValue **args, int argc, LangValue **result);
+
+/* ---- values ---- */
+LangValue *lang_null(void);
+LangValue *lang_int(long long v);
+LangValue *lang_float(double v);
+LangValue *lang_bool(int v);
+LangValue *lang_string(const char *s);
+void       lang_retain(LangValue *v);
+void       lang_release(LangValue *v);
+
+LangType    lang_type(const LangValue *v);
+long long   lang_to_int(const LangValue *v);      /* ints, floats and bools; 0 otherwise */
+double      lang_to_float(const LangValue *v);
+const char *lang_to_string(const LangValue *v);   /* borrowed; NULL unless a string */
+int         lang_tuple_count(const LangValue *v);
+LangValue  *lang_tuple_at(const LangValue *v, int i);              /* borrowed */
+LangValue  *lang_field(const LangValue *v, const char *name);      /* borrowed; named tuples and pat instances */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LANG_H */
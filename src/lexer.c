@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 200809L
 #include "lexer.h"
+#include "mem.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -36,7 +37,7 @@ static char advance(Lexer *lex) {
 static Token make_tok(TokenType t, const char *val, int line, int col) {
     Token tok;
     tok.type = t;
-    tok.value = val ? strdup(val) : NULL;
+    tok.value = val ? mem_strdup(val) : NULL;
     tok.line = line;
     tok.col = col;
     return tok;
@@ -80,7 +81,7 @@ static Token lex_string(Lexer *lex, char quote) {
     int line = lex->line, col = lex->col;
     advance(lex); /* consume opening quote */
     size_t cap = 64, len = 0;
-    char *buf = malloc(cap);
+    char *buf = mem_alloc(cap);
     while (cur(lex) != '\0' && cur(lex) != quote) {
         char c = cur(lex);
         if (c == '\\') {
@@ -96,7 +97,7 @@ static Token lex_string(Lexer *lex, char quote) {
         } else {
             advance(lex);
         }
-        if (len + 1 >= cap) { cap *= 2; buf = realloc(buf, cap); }
+        if (len + 1 >= cap) { cap *= 2; buf = mem_realloc(buf, cap); }
         buf[len++] = c;
     }
     if (cur(lex) == quote) advance(lex);
@@ -112,32 +113,32 @@ static Token lex_string(Lexer *lex, char quote) {
 static Token lex_number(Lexer *lex) {
     int line = lex->line, col = lex->col;
     size_t cap = 32, len = 0;
-    char *buf = malloc(cap);
+    char *buf = mem_alloc(cap);
     int is_float = 0;
     while (isdigit(cur(lex))) {
-        if (len + 1 >= cap) { cap *= 2; buf = realloc(buf, cap); }
+        if (len + 1 >= cap) { cap *= 2; buf = mem_realloc(buf, cap); }
         buf[len++] = advance(lex);
     }
     if (cur(lex) == '.' && isdigit(peek_ch(lex))) {
         is_float = 1;
-        if (len + 1 >= cap) { cap *= 2; buf = realloc(buf, cap); }
+        if (len + 1 >= cap) { cap *= 2; buf = mem_realloc(buf, cap); }
         buf[len++] = advance(lex);
         while (isdigit(cur(lex))) {
-            if (len + 1 >= cap) { cap *= 2; buf = realloc(buf, cap); }
+            if (len + 1 >= cap) { cap *= 2; buf = mem_realloc(buf, cap); }
             buf[len++] = advance(lex);
         }
     }
     /* optional exponent */
     if ((cur(lex) == 'e' || cur(lex) == 'E')) {
         is_float = 1;
-        if (len + 1 >= cap) { cap *= 2; buf = realloc(buf, cap); }
+        if (len + 1 >= cap) { cap *= 2; buf = mem_realloc(buf, cap); }
         buf[len++] = advance(lex);
         if (cur(lex) == '+' || cur(lex) == '-') {
-            if (len + 1 >= cap) { cap *= 2; buf = realloc(buf, cap); }
+            if (len + 1 >= cap) { cap *= 2; buf = mem_realloc(buf, cap); }
             buf[len++] = advance(lex);
         }
         while (isdigit(cur(lex))) {
-            if (len + 1 >= cap) { cap *= 2; buf = realloc(buf, cap); }
+            if (len + 1 >= cap) { cap *= 2; buf = mem_realloc(buf, cap); }
             buf[len++] = advance(lex);
         }
     }
@@ -153,9 +154,9 @@ static Token lex_number(Lexer *lex) {
 static Token lex_ident_or_kw(Lexer *lex) {
     int line = lex->line, col = lex->col;
     size_t cap = 32, len = 0;
-    char *buf = malloc(cap);
+    char *buf = mem_alloc(cap);
     while (isalnum(cur(lex)) || cur(lex) == '_') {
-        if (len + 1 >= cap) { cap *= 2; buf = realloc(buf, cap); }
+        if (len + 1 >= cap) { cap *= 2; buf = mem_realloc(buf, cap); }
         buf[len++] = advance(lex);
     }
     buf[len] = '\0';
@@ -177,7 +178,7 @@ static Token lex_ident_or_kw(Lexer *lex) {
     for (int i = 0; kws[i].kw; i++) {
         if (strcmp(buf, kws[i].kw) == 0) {
             Token tok = make_tok(kws[i].t, buf, line, col);
-            free(buf);
+            mem_free(buf);
             return tok;
         }
     }
@@ -194,9 +195,9 @@ static Token lex_custom_op(Lexer *lex) {
     int line = lex->line, col = lex->col;
     advance(lex); /* consume " */
     size_t cap = 16, len = 0;
-    char *buf = malloc(cap);
+    char *buf = mem_alloc(cap);
     while (cur(lex) != '"' && cur(lex) != '\0') {
-        if (len + 1 >= cap) { cap *= 2; buf = realloc(buf, cap); }
+        if (len + 1 >= cap) { cap *= 2; buf = mem_realloc(buf, cap); }
         buf[len++] = advance(lex);
     }
     if (cur(lex) == '"') advance(lex);
@@ -349,7 +350,7 @@ Token lexer_peek(Lexer *lex) {
 }
 
 void token_free(Token *tok) {
-    free(tok->value);
+    mem_free(tok->value);
     tok->value = NULL;
 }
 
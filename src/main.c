@@ -3,6 +3,15 @@
 #include "interpreter.h"
 #include "module.h"
 #include "ast.h"
+#include "mem.h"
+#include "profile.h"
+#include "instrument.h"
+#include "trace.h"
+#include "heapprof.h"
+#include "perfctr.h"
+#include "serve.h"
+#include "batch.h"
+#include "parallel.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,22 +23,91 @@ static void print_help(const char *prog) {
     printf("Options:\n");
     printf("  -h, --help       Show this help message\n");
     printf("  -v, --version    Show version\n");
+    printf("  --mem-limit=N    Abort evaluation once N bytes are in use (K/M/G suffixes)\n");
+    printf("  --max-steps=N    Abort evaluation after N loop iterations and calls\n");
+    printf("  --timeout=MS     Abort evaluation after MS milliseconds\n");
+    printf("  --instrument     Count calls, time and allocations per function; table on exit\n");
+    printf("  --instrument-json=FILE  Same, written as JSON to FILE\n");
+    printf("  --stats          Count allocations, lookups and refcount operations; report on exit\n");
+    printf("  --stats=per-thread  Same, counted and reported per thread\n");
+    printf("  --trace=FILE     Write a Chrome trace-event timeline of parsing and top-level statements\n");
+    printf("  --trace-calls=US Also trace function calls that take at least US microseconds\n");
+    printf("  --heap-profile[=FILE]  Sample allocations by source line; live/retained report on exit\n");
+    printf("  --heap-sample=N  Bytes between heap samples (default 512K, K/M/G suffixes)\n");
+    printf("  --perf-counters  Hardware counters (cycles, IPC, cache misses) per top-level statement\n");
+    printf("  --arena          Run the script (each --batch script, each --serve request) in an arena\n");
+    printf("  --profile[=FILE] Sample the script and write collapsed stacks (default profile.folded)\n");
+    printf("  --profile-hz=N   Sampling rate for --profile (default %d)\n", PROF_DEFAULT_HZ);
+    printf("  --serve=SOCKET   Run file.lang once as a prelude, then serve requests on a Unix socket\n");
+    printf("  --workers=N      Worker processes for --serve (default %d)\n", SERVE_DEFAULT_WORKERS);
+    printf("  --max-requests=N Requests a --serve worker handles before it is replaced (default %d, 0 = no limit)\n",
+           SERVE_DEFAULT_MAX_REQUESTS);
+    printf("  --threads=N      Threads for parallel loops (default: one per CPU, 1 = run them on one thread)\n");
+    printf("  --batch DIR      Run every .lang file in DIR, each in its own interpreter; report pass/fail\n");
+    printf("  -j N, --jobs=N   Worker threads for --batch (default: one per CPU)\n");
+    printf("  --batch-verbose  Also show the output of --batch scripts that passed\n");
     printf("If no file is given, starts an interactive REPL.\n");
 }
 
+/* Parse a byte count such as 65536, 64K, 512M or 2G; returns 0 on error. */
+static size_t parse_size(const char *s) {
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (end == s) return 0;
+    switch (*end) {
+        case 'k': case 'K': n <<= 10; end++; break;
+        case 'm': case 'M': n <<= 20; end++; break;
+        case 'g': case 'G': n <<= 30; end++; break;
+        default: break;
+    }
+    return *end ? 0 : (size_t)n;
+}
+
 static char *read_file(const char *path) {
     FILE *f = fopen(path, "r");
     if (!f) { perror(path); return NULL; }
     fseek(f, 0, SEEK_END);
     long len = ftell(f);
     fseek(f, 0, SEEK_SET);
-    char *buf = malloc((size_t)len + 1);
+    char *buf = mem_alloc((size_t)len + 1);
     size_t n = fread(buf, 1, (size_t)len, f);
     buf[n] = '\0';
     fclose(f);
     return buf;
 }
 
+/* Directory part of path, for resolving the script's imports; NULL if none. */
+static char *dir_of(const char *path) {
+    const char *slash = path ? strrchr(path, '/') : NULL;
+    if (!slash) return NULL;
+    size_t n = slash == path ? 1 : (size_t)(slash - path);
+    char *dir = malloc(n + 1);
+    if (!dir) return NULL;
+    memcpy(dir, path, n);
+    dir[n] = '\0';
+    return dir;
+}
+
+/* Trees of the programs run so far.  Functions and suspended generators
+   point into them, so they are freed only after the interpreter. */
+static AstNode **kept;
+static int       kept_count, kept_cap;
+
+static void keep(AstNode *program) {
+    if (kept_count >= kept_cap) {
+        kept_cap = kept_cap ? kept_cap * 2 : 16;
+        kept = realloc(kept, sizeof(AstNode *) * (size_t)kept_cap);
+    }
+    kept[kept_count++] = program;
+}
+
+static void free_kept(void) {
+    for (int i = 0; i < kept_count; i++) ast_free(kept[i]);
+    free(kept);
+    kept = NULL;
+    kept_count = kept_cap = 0;
+}
+
 static int run_source(Interpreter *interp, const char *src, const char *filename) {
     Lexer lex;
     lexer_init(&lex, src);
@@ -46,7 +124,7 @@ static int run_source(Interpreter *interp, const char *src, const char *filename
     token_free(&parser.cur);
 
     interp_run(interp, program);
-    ast_free(program);
+    keep(program);
 
     if (interp->had_error) {
         fprintf(stderr, "%s\n", interp->error_msg);
@@ -87,17 +165,34 @@ static void repl(Interpreter *interp) {
             } else if (r.val && r.val->type != VAL_NULL) {
                 char *s = value_to_string(r.val);
                 printf("%s\n", s);
-                free(s);
+                mem_free(s);
             }
             value_decref(r.val);
         }
 
-        ast_free(program);
+        keep(program);
     }
 }
 
 int main(int argc, char **argv) {
     /* Parse flags */
+    const char *filename = NULL;
+    size_t mem_limit = 0;
+    long long max_steps = 0, timeout_ms = 0;
+    int use_arena = 0;
+    const char *profile_path = NULL;
+    int profile_hz = PROF_DEFAULT_HZ;
+    int instrument_table = 0;
+    const char *instrument_json = NULL;
+    int show_stats = 0;
+    const char *trace_path = NULL;
+    int heap_profile = 0;
+    const char *heap_path = NULL;
+    size_t heap_interval = 0;
+    int perf_counters = 0;
+    ServeOptions serve_opt = { NULL, SERVE_DEFAULT_WORKERS, SERVE_DEFAULT_MAX_REQUESTS, 0 };
+    const char *batch_dir = NULL;
+    BatchOptions batch_opt = { 0 };
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             print_help(argv[0]);
@@ -107,23 +202,218 @@ int main(int argc, char **argv) {
             printf("lang-interpreter %s\n", VERSION);
             return 0;
         }
+        if (strncmp(argv[i], "--mem-limit=", 12) == 0) {
+            mem_limit = parse_size(argv[i] + 12);
+            if (!mem_limit) { fprintf(stderr, "invalid --mem-limit: %s\n", argv[i] + 12); return 1; }
+            continue;
+        }
+        if (strncmp(argv[i], "--max-steps=", 12) == 0) {
+            max_steps = strtoll(argv[i] + 12, NULL, 10);
+            if (max_steps <= 0) { fprintf(stderr, "invalid --max-steps: %s\n", argv[i] + 12); return 1; }
+            continue;
+        }
+        if (strncmp(argv[i], "--timeout=", 10) == 0) {
+            timeout_ms = strtoll(argv[i] + 10, NULL, 10);
+            if (timeout_ms <= 0) { fprintf(stderr, "invalid --timeout: %s\n", argv[i] + 10); return 1; }
+            continue;
+        }
+        if (strcmp(argv[i], "--profile") == 0) {
+            profile_path = "profile.folded";
+            continue;
+        }
+        if (strncmp(argv[i], "--profile=", 10) == 0) {
+            profile_path = argv[i] + 10;
+            continue;
+        }
+        if (strncmp(argv[i], "--profile-hz=", 13) == 0) {
+            profile_hz = atoi(argv[i] + 13);
+            if (profile_hz <= 0) { fprintf(stderr, "invalid --profile-hz: %s\n", argv[i] + 13); return 1; }
+            continue;
+        }
+        if (strcmp(argv[i], "--instrument") == 0) {
+            instrument_table = 1;
+            continue;
+        }
+        if (strncmp(argv[i], "--instrument-json=", 18) == 0) {
+            instrument_json = argv[i] + 18;
+            continue;
+        }
+        if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--stats=per-thread") == 0) {
+            show_stats = 1;
+            stats_set_per_thread(1);
+            continue;
+        }
+        if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_path = argv[i] + 8;
+            continue;
+        }
+        if (strncmp(argv[i], "--trace-calls=", 14) == 0) {
+            trace_call_min_ns = strtoll(argv[i] + 14, NULL, 10) * 1000;
+            if (trace_call_min_ns < 0) { fprintf(stderr, "invalid --trace-calls: %s\n", argv[i] + 14); return 1; }
+            continue;
+        }
+        if (strcmp(argv[i], "--heap-profile") == 0) {
+            heap_profile = 1;
+            continue;
+        }
+        if (strncmp(argv[i], "--heap-profile=", 15) == 0) {
+            heap_profile = 1;
+            heap_path = argv[i] + 15;
+            continue;
+        }
+        if (strncmp(argv[i], "--heap-sample=", 14) == 0) {
+            heap_interval = parse_size(argv[i] + 14);
+            if (!heap_interval) { fprintf(stderr, "invalid --heap-sample: %s\n", argv[i] + 14); return 1; }
+            continue;
+        }
+        if (strcmp(argv[i], "--perf-counters") == 0) {
+            perf_counters = 1;
+            continue;
+        }
+        if (strncmp(argv[i], "--serve=", 8) == 0) {
+            serve_opt.socket_path = argv[i] + 8;
+            if (!*serve_opt.socket_path) { fprintf(stderr, "invalid --serve: missing socket path\n"); return 1; }
+            continue;
+        }
+        if (strncmp(argv[i], "--workers=", 10) == 0) {
+            serve_opt.workers = atoi(argv[i] + 10);
+            if (serve_opt.workers <= 0) { fprintf(stderr, "invalid --workers: %s\n", argv[i] + 10); return 1; }
+            continue;
+        }
+        if (strncmp(argv[i], "--max-requests=", 15) == 0) {
+            char *end;
+            serve_opt.max_requests = (int)strtol(argv[i] + 15, &end, 10);
+            if (*end || end == argv[i] + 15 || serve_opt.max_requests < 0) {
+                fprintf(stderr, "invalid --max-requests: %s\n", argv[i] + 15);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--batch") == 0 || strncmp(argv[i], "--batch=", 8) == 0) {
+            batch_dir = argv[i][7] == '=' ? argv[i] + 8 : (i + 1 < argc ? argv[++i] : "");
+            if (!*batch_dir) { fprintf(stderr, "invalid --batch: missing directory\n"); return 1; }
+            continue;
+        }
+        if (strncmp(argv[i], "--threads=", 10) == 0) {
+            int n = atoi(argv[i] + 10);
+            if (n <= 0) { fprintf(stderr, "invalid --threads: %s\n", argv[i] + 10); return 1; }
+            par_set_threads(n);
+            continue;
+        }
+        if (strcmp(argv[i], "--batch-verbose") == 0) {
+            batch_opt.verbose = 1;
+            continue;
+        }
+        if (strncmp(argv[i], "-j", 2) == 0 || strncmp(argv[i], "--jobs=", 7) == 0) {
+            const char *n = argv[i][1] == 'j' ? (argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : ""))
+                                              : argv[i] + 7;
+            batch_opt.jobs = atoi(n);
+            if (batch_opt.jobs <= 0) { fprintf(stderr, "invalid -j: %s\n", n); return 1; }
+            continue;
+        }
+        if (strcmp(argv[i], "--arena") == 0) {
+            use_arena = 1;
+            continue;
+        }
+        if (argv[i][0] == '-' && argv[i][1]) {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+            return 1;
+        }
+        if (!filename) filename = argv[i];
+    }
+
+    /* Each batch script gets an interpreter of its own; the per-process tools
+     * below (profiler, tracer, arena) are not for it. */
+    if (batch_dir) {
+        if (filename) { fprintf(stderr, "--batch runs a directory, not %s\n", filename); return 1; }
+        batch_opt.mem_limit = mem_limit;
+        batch_opt.max_steps = max_steps;
+        batch_opt.timeout_ms = timeout_ms;
+        batch_opt.arena = use_arena;
+        return batch_run(batch_dir, &batch_opt);
+    }
+
+    /* The REPL keeps allocating for as long as it runs, so only scripts use an
+       arena; a server uses one per request instead. */
+    serve_opt.arena = use_arena;
+    MemArena *arena = NULL;
+    if (use_arena && filename && !serve_opt.socket_path) {
+        arena = mem_arena_new(0);
+        mem_arena_enter(arena);
     }
 
+    instr_enable(instrument_table || instrument_json);
+    if (trace_path && trace_open(trace_path) != 0) return 1;
+    if (heap_profile) heapprof_start(heap_interval);
+
     Interpreter interp;
     interp_init(&interp);
+    interp_set_mem_limit(&interp, mem_limit);
+    interp_set_step_limit(&interp, max_steps);
+    interp_set_timeout(&interp, timeout_ms);
+    interp_enable_stats(&interp, show_stats);
+    char *script_dir = dir_of(filename);
+    interp.module_root = script_dir;
 
-    if (argc < 2) {
+    if (serve_opt.socket_path) {
+        int ret = serve(&interp, filename, &serve_opt);
+        trace_close();
+        interp_free(&interp);
+        free(script_dir);
+        return ret;
+    }
+
+    if (!filename) {
         repl(&interp);
     } else {
-        const char *filename = argv[1];
         char *src = read_file(filename);
-        if (!src) { interp_free(&interp); return 1; }
-        int ret = run_source(&interp, src, filename);
-        free(src);
-        interp_free(&interp);
+        if (profile_path && prof_start(profile_hz) != 0) perror("--profile");
+        int counting = src && perf_counters && perfctr_start() >= 0;
+        int ret = src ? run_source(&interp, src, filename) : 1;
+        if (counting) {
+            perfctr_stop();
+            perfctr_report(stderr);
+        }
+        if (profile_path && prof_active) {
+            prof_stop();
+            int n = prof_write_collapsed(profile_path);
+            if (n >= 0) fprintf(stderr, "profile: %d samples written to %s\n", n, profile_path);
+        }
+        if (instrument_table) instr_print_table(stderr);
+        if (instrument_json) instr_write_json(instrument_json);
+        instr_reset();
+        if (show_stats && stats_per_thread()) stats_print_threads(stderr);
+        else if (show_stats) stats_print(&interp.stats, stderr);
+        if (heap_profile) {
+            FILE *hf = heap_path ? fopen(heap_path, "w") : stderr;
+            if (!hf) perror(heap_path);
+            else {
+                heapprof_report(interp.global, hf);
+                if (hf != stderr) fclose(hf);
+            }
+            heapprof_stop();
+        }
+        trace_close();
+        mem_free(src);
+        if (arena) {
+            mem_arena_enter(NULL);
+            interp_discard(&interp);
+            free_kept();
+            mem_arena_free(arena);
+        } else {
+            interp_free(&interp);
+            free_kept();
+        }
+        free(script_dir);
         return ret;
     }
 
+    trace_close();
     interp_free(&interp);
+    free_kept();
     return 0;
 }
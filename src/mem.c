@@ -0,0 +1,358 @@
+#include "mem.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Aligned to 16 so the header is 16 bytes with 32-bit pointers too and the
+   block after it keeps the alignment malloc and the arena give the header. */
+typedef struct {
+    _Alignas(16) size_t size;
+    MemStats *owner;
+} MemHeader;
+
+_Static_assert(sizeof(MemHeader) % 16 == 0, "MemHeader must preserve malloc alignment");
+
+/* Flags kept in the top bits of MemHeader.size: blocks carved out of an
+   arena, and blocks picked by allocation sampling. */
+#define ARENA_BIT   ((size_t)1 << (sizeof(size_t) * 8 - 1))
+#define SAMPLED_BIT ((size_t)1 << (sizeof(size_t) * 8 - 2))
+#define FLAG_BITS   (ARENA_BIT | SAMPLED_BIT)
+
+static _Thread_local MemStats *current;
+static _Thread_local MemArena *cur_arena;
+
+static size_t          sample_interval;
+static MemSampleAlloc  sample_alloc_hook;
+static MemSampleFree   sample_free_hook;
+static _Thread_local long long sample_countdown;   /* 0 = not seeded on this thread yet */
+
+MemStats *mem_current(void) { return current; }
+
+MemStats *mem_set_current(MemStats *ms) {
+    MemStats *prev = current;
+    current = ms;
+    return prev;
+}
+
+static void charge(MemStats *ms, size_t size) {
+    ms->current += size;
+    ms->allocs++;
+}
+
+/* current only ever drops here, so this is where a new high-water mark is
+   noticed; mem_peak covers one not followed by a credit yet */
+static void credit(MemStats *ms, size_t size) {
+    if (ms->current > ms->peak) ms->peak = ms->current;
+    ms->current -= size;
+}
+
+static void *arena_alloc(MemArena *a, size_t size);
+
+static MemHeader *raw_alloc(size_t size, int zero) {
+    if (size & FLAG_BITS) return NULL;   /* no room for the flags, nor for the header */
+    if (cur_arena) {
+        MemHeader *h = arena_alloc(cur_arena, sizeof(MemHeader) + size);
+        if (h && zero) memset(h + 1, 0, size);
+        if (h) h->size = size | ARENA_BIT;
+        return h;
+    }
+    MemHeader *h = zero ? calloc(1, sizeof(MemHeader) + size) : malloc(sizeof(MemHeader) + size);
+    if (h) h->size = size;
+    return h;
+}
+
+/* Pick one allocation per sample_interval bytes.  A block at least as large as
+   the interval always counts for itself; smaller ones stand for the whole
+   interval of allocations they completed. */
+static void maybe_sample(MemHeader *h, size_t size) {
+    if (h->size & ARENA_BIT) return;   /* arena blocks are never freed one by one */
+    if (sample_countdown == 0) sample_countdown = (long long)sample_interval;
+    sample_countdown -= (long long)size;
+    if (sample_countdown > 0) return;
+    size_t weight = size > sample_interval ? size : sample_interval;
+    sample_countdown = (long long)sample_interval;
+    h->size |= SAMPLED_BIT;
+    sample_alloc_hook(h + 1, size, weight);
+}
+
+static void arena_charged(MemArena *a, MemStats *ms, size_t size);
+static void arena_credit(MemHeader *h);
+
+static void *finish_alloc(MemHeader *h, size_t size) {
+    if (!h) return NULL;
+    h->owner = current;
+    if (current) charge(current, size);
+    if (current && (h->size & ARENA_BIT)) arena_charged(cur_arena, current, size);
+    if (sample_interval) maybe_sample(h, size);
+    return h + 1;
+}
+
+void *mem_alloc(size_t size) {
+    return finish_alloc(raw_alloc(size, 0), size);
+}
+
+void *mem_calloc(size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    size_t n = count * size;
+    return finish_alloc(raw_alloc(n, 1), n);
+}
+
+void *mem_realloc(void *p, size_t size) {
+    if (!p) return mem_alloc(size);
+    if (size & FLAG_BITS) return NULL;   /* as in raw_alloc */
+    MemHeader *h = (MemHeader *)p - 1;
+    if (h->size & ARENA_BIT) {
+        /* arena blocks cannot grow in place; move to a fresh block */
+        size_t old = h->size & ~ARENA_BIT;
+        void *n = mem_alloc(size);
+        if (n) {
+            memcpy(n, p, old < size ? old : size);
+            arena_credit(h);
+        }
+        return n;
+    }
+    if (h->size & SAMPLED_BIT) {
+        /* the block moves; it stops being a sample */
+        sample_free_hook(p);
+        h->size &= ~SAMPLED_BIT;
+    }
+    size_t old = h->size;
+    MemStats *owner = h->owner;
+    h = realloc(h, sizeof(MemHeader) + size);
+    if (!h) return NULL;
+    h->size = size;
+    if (owner) {
+        credit(owner, old);
+        charge(owner, size);
+    }
+    return h + 1;
+}
+
+char *mem_strdup(const char *s) {
+    size_t n = strlen(s) + 1;
+    char *d = mem_alloc(n);
+    if (d) memcpy(d, s, n);
+    return d;
+}
+
+void mem_free(void *p) {
+    if (!p) return;
+    MemHeader *h = (MemHeader *)p - 1;
+    if (h->size & FLAG_BITS) {
+        if (h->size & ARENA_BIT) {   /* released with the whole arena */
+            arena_credit(h);
+            return;
+        }
+        sample_free_hook(p);
+        h->size &= ~SAMPLED_BIT;
+    }
+    if (h->owner) credit(h->owner, h->size);
+    free(h);
+}
+
+size_t mem_peak(const MemStats *ms) {
+    return ms->current > ms->peak ? ms->current : ms->peak;
+}
+
+MemStats *mem_owner(const void *p) {
+    return p ? ((const MemHeader *)p - 1)->owner : NULL;
+}
+
+size_t mem_block_size(const void *p) {
+    return p ? ((const MemHeader *)p - 1)->size & ~FLAG_BITS : 0;
+}
+
+void mem_disown(void *p) {
+    if (!p) return;
+    MemHeader *h = (MemHeader *)p - 1;
+    if (h->size & SAMPLED_BIT) {
+        /* it may be freed on any thread from now on: stop sampling it */
+        sample_free_hook(p);
+        h->size &= ~SAMPLED_BIT;
+    }
+    if (h->owner) credit(h->owner, h->size & ~FLAG_BITS);
+    h->owner = NULL;
+}
+
+void mem_adopt(void *p) {
+    if (!p) return;
+    MemHeader *h = (MemHeader *)p - 1;
+    if (h->owner || !current) return;
+    h->owner = current;
+    current->current += h->size & ~FLAG_BITS;   /* not an allocation of its own */
+}
+
+void mem_set_sampling(size_t interval, MemSampleAlloc on_alloc, MemSampleFree on_free) {
+    sample_alloc_hook = on_alloc;
+    sample_free_hook  = on_free;
+    sample_countdown  = 0;
+    sample_interval   = on_alloc && on_free ? interval : 0;
+}
+
+int mem_over_limit(void) {
+    return current && current->limit && current->current > current->limit;
+}
+
+int mem_would_exceed(size_t size) {
+    return current && current->limit && current->current + size > current->limit;
+}
+
+/* ------------------------------------------------------------------ arenas */
+
+#define ARENA_DEFAULT_CHUNK (64 * 1024)
+#define ALIGN16(n) (((n) + 15) & ~(size_t)15)
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;   /* usable bytes after the chunk header */
+    size_t off;    /* bytes handed out from this chunk */
+} ArenaChunk;
+
+#define CHUNK_DATA(c) ((char *)(c) + ALIGN16(sizeof(ArenaChunk)))
+
+typedef struct ArenaHook {
+    struct ArenaHook *next;
+    void (*fn)(void *);
+    void *arg;
+} ArenaHook;
+
+struct MemArena {
+    ArenaChunk *head;    /* regular chunks, kept across resets */
+    ArenaChunk *cur;     /* chunk currently being bumped */
+    ArenaChunk *large;   /* blocks too big for a chunk, freed on reset */
+    size_t chunk_size;
+    size_t used;         /* bytes handed out since the last reset */
+    MemStats *owner;     /* credited with owned on reset */
+    size_t owned;        /* bytes charged to owner since the last reset */
+    ArenaHook *hooks;    /* run by the next reset, see mem_arena_on_reset */
+};
+
+static ArenaChunk *chunk_new(size_t size) {
+    ArenaChunk *c = malloc(ALIGN16(sizeof(ArenaChunk)) + size);
+    if (!c) return NULL;
+    c->next = NULL;
+    c->size = size;
+    c->off  = 0;
+    return c;
+}
+
+static void *arena_alloc(MemArena *a, size_t size) {
+    size = ALIGN16(size);
+    a->used += size;
+    if (size > a->chunk_size / 4) {
+        ArenaChunk *c = chunk_new(size);
+        if (!c) return NULL;
+        c->next  = a->large;
+        a->large = c;
+        return CHUNK_DATA(c);
+    }
+    ArenaChunk *c = a->cur;
+    if (c->off + size > c->size) {
+        if (!c->next && !(c->next = chunk_new(a->chunk_size))) return NULL;
+        c = a->cur = c->next;
+        c->off = 0;
+    }
+    void *p = CHUNK_DATA(c) + c->off;
+    c->off += size;
+    return p;
+}
+
+MemArena *mem_arena_new(size_t chunk_size) {
+    MemArena *a = malloc(sizeof(MemArena));
+    if (!a) return NULL;
+    a->chunk_size = chunk_size ? ALIGN16(chunk_size) : ARENA_DEFAULT_CHUNK;
+    a->head = a->cur = chunk_new(a->chunk_size);
+    a->large = NULL;
+    a->used  = 0;
+    a->owner = NULL;
+    a->owned = 0;
+    a->hooks = NULL;
+    if (!a->head) { free(a); return NULL; }
+    return a;
+}
+
+static void free_chunks(ArenaChunk *c) {
+    while (c) {
+        ArenaChunk *next = c->next;
+        free(c);
+        c = next;
+    }
+}
+
+static void arena_charged(MemArena *a, MemStats *ms, size_t size) {
+    if (ms == a->owner) a->owned += size;
+}
+
+/* A dead arena block stops counting against the MemStats that frees it, so a
+   run's charge follows its live data as it would outside an arena; only the
+   memory waits for the reset.  Blocks charged to other MemStats (a finished
+   parallel loop's worker, say) stay charged, as those may be gone. */
+static void arena_credit(MemHeader *h) {
+    if (!h->owner || h->owner != current || !cur_arena) return;
+    size_t size = h->size & ~FLAG_BITS;
+    if (cur_arena->owner == h->owner) {
+        if (cur_arena->owned < size) return;   /* not from this arena */
+        cur_arena->owned -= size;
+    }
+    credit(h->owner, size);
+    h->owner = NULL;
+}
+
+/* The hooks live in the arena too, so they run before its blocks go. */
+static void run_hooks(MemArena *a) {
+    while (a->hooks) {
+        ArenaHook *h = a->hooks;
+        a->hooks = h->next;
+        h->fn(h->arg);
+    }
+}
+
+int mem_arena_on_reset(void (*fn)(void *), void *arg) {
+    if (!cur_arena) return -1;
+    ArenaHook *h = arena_alloc(cur_arena, sizeof(ArenaHook));
+    if (!h) return -1;
+    h->fn = fn;
+    h->arg = arg;
+    h->next = cur_arena->hooks;
+    cur_arena->hooks = h;
+    return 0;
+}
+
+void mem_arena_reset(MemArena *a) {
+    run_hooks(a);
+    free_chunks(a->large);
+    a->large = NULL;
+    a->cur = a->head;
+    a->head->off = 0;
+    a->used = 0;
+    if (a->owner) credit(a->owner, a->owned);
+    a->owned = 0;
+}
+
+void mem_arena_set_owner(MemArena *a, MemStats *owner) {
+    a->owner = owner;
+    a->owned = 0;
+}
+
+void mem_arena_free(MemArena *a) {
+    if (!a) return;
+    if (cur_arena == a) cur_arena = NULL;
+    run_hooks(a);
+    free_chunks(a->large);
+    free_chunks(a->head);
+    free(a);
+}
+
+MemArena *mem_arena_enter(MemArena *a) {
+    MemArena *prev = cur_arena;
+    cur_arena = a;
+    return prev;
+}
+
+MemArena *mem_arena_current(void) { return cur_arena; }
+
+size_t mem_arena_used(const MemArena *a) { return a->used; }
+
+int mem_in_arena(const void *p) {
+    return p && (((const MemHeader *)p - 1)->size & ARENA_BIT) != 0;
+}
@@ -0,0 +1,98 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+
+/* Accounted allocation.
+ *
+ * Every allocation the runtime makes (values, envs, strings, AST, tokens) goes
+ * through these wrappers.  Each block carries a small header recording its size
+ * and the MemStats it was charged to, so a block is always credited back to
+ * the same owner no matter which interpreter happens to free it.  Allocations
+ * are charged to the MemStats that is current on the calling thread; with no
+ * current MemStats they are simply not counted.  Counting is on whether or not
+ * a limit is set, since current and peak are always queryable, and costs two
+ * updates per allocation: the peak is only compared when current drops.  On
+ * an allocation-bound script (benchmarks/fib.lang) that is lost in the noise
+ * next to the same build with counting compiled out; the header, which the
+ * cycle collector needs for the owner anyway, costs about 3% over plain
+ * malloc. */
+
+typedef struct MemStats {
+    size_t    current;   /* bytes currently allocated */
+    size_t    peak;      /* high-water mark of current as of its last drop, see mem_peak */
+    size_t    limit;     /* 0 = unlimited */
+    long long allocs;    /* allocations made so far */
+    struct GcHeap *gc;   /* cycle collector heap of objects charged here, see gc.h */
+} MemStats;
+
+void *mem_alloc(size_t size);
+void *mem_calloc(size_t count, size_t size);   /* NULL if count * size overflows */
+void *mem_realloc(void *p, size_t size);
+char *mem_strdup(const char *s);
+void  mem_free(void *p);
+
+size_t    mem_peak(const MemStats *ms);   /* high-water mark of ms->current */
+MemStats *mem_owner(const void *p);   /* MemStats p was charged to, NULL if none */
+size_t mem_block_size(const void *p);   /* size requested for a mem_* block */
+
+/* Blocks handed between interpreters (see actor.h): mem_disown credits p back
+   to its owner and leaves it charged to nobody, so any thread may free it;
+   mem_adopt charges such a block to the current MemStats. */
+void mem_disown(void *p);
+void mem_adopt(void *p);
+
+/* Allocation sampling: once enabled, about one allocation per interval bytes
+   is reported to on_alloc (with the number of bytes it stands for), and
+   on_free is called when such a block is freed or moved.  interval 0 turns
+   sampling off; blocks sampled before must not outlive the hooks. */
+typedef void (*MemSampleAlloc)(void *p, size_t size, size_t weight);
+typedef void (*MemSampleFree)(void *p);
+void mem_set_sampling(size_t interval, MemSampleAlloc on_alloc, MemSampleFree on_free);
+
+MemStats *mem_current(void);
+MemStats *mem_set_current(MemStats *ms);   /* returns the previously current stats */
+
+/* Limit checks against the current MemStats; both are 0 when no limit is set. */
+int mem_over_limit(void);
+int mem_would_exceed(size_t size);
+
+/* Request-scoped arenas.
+ *
+ * While an arena is entered on a thread, every mem_* allocation on that thread
+ * is bump-allocated from it instead of the heap, and mem_free of such a block
+ * only credits it back to the current MemStats if it was charged there; its
+ * memory is not reused.  mem_arena_reset then discards everything at once, so
+ * a whole run (AST, environments, values) can be dropped without walking it,
+ * and the arena is ready for the next one.  Live blocks stay charged to their
+ * MemStats until then; a reset credits those charged to the arena's owner
+ * back to it, while others (charged to a parallel loop's workers, say) stay
+ * charged.
+ * Nothing outside the arena may keep pointers into it across a reset: values
+ * that must survive are copied out with value_deep_copy() after leaving the
+ * arena, and the interpreter copies what a run stores into variables and
+ * fields outside the arena the same way.
+ *
+ * An arena with an owner serves the runs of an interpreter that outlives it (a
+ * --serve worker, lang_run_scoped), so its objects may hold references to the
+ * interpreter's heap.  While an arena is entered, arena objects that die
+ * release what they hold like any other, only their own memory waits for the
+ * reset; once it has been left, they are discarded with it unwalked. */
+typedef struct MemArena MemArena;
+
+MemArena *mem_arena_new(size_t chunk_size);    /* 0 = default chunk size */
+void      mem_arena_free(MemArena *a);
+void      mem_arena_reset(MemArena *a);         /* discard every block allocated so far */
+void      mem_arena_set_owner(MemArena *a, MemStats *owner);   /* credited by each reset; NULL = none */
+MemArena *mem_arena_enter(MemArena *a);         /* NULL leaves arena mode; returns the previous arena */
+MemArena *mem_arena_current(void);
+size_t    mem_arena_used(const MemArena *a);    /* bytes handed out since the last reset */
+int       mem_in_arena(const void *p);          /* p came from mem_alloc while an arena was entered */
+
+/* Have the current arena call fn(arg) when it is next reset or freed, before
+   its blocks go: for resources an arena object holds outside the arena (a
+   generator's stack mapping).  fn must cope with having released them
+   already.  Returns -1 with no arena entered or out of memory. */
+int       mem_arena_on_reset(void (*fn)(void *), void *arg);
+
+#endif /* MEM_H */
@@ -3,9 +3,16 @@
 #include "lexer.h"
 #include "parser.h"
 #include "ast.h"
+#include "mem.h"
+#include "trace.h"
+#include "perfctr.h"
+#include "heapprof.h"
+#include "probes.h"
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/stat.h>
 
 void module_system_init(ModuleSystem *ms) {
     ms->head = NULL;
@@ -15,9 +22,9 @@ void module_system_free(ModuleSystem *ms) {
     ModuleCache *c = ms->head;
     while (c) {
         ModuleCache *next = c->next;
-        free(c->path);
+        mem_free(c->path);
         value_decref(c->module);
-        free(c);
+        mem_free(c);
         c = next;
     }
     ms->head = NULL;
@@ -31,98 +38,244 @@ static Value *cache_lookup(ModuleSystem *ms, const char *path) {
 }
 
 static void cache_insert(ModuleSystem *ms, const char *path, Value *mod) {
-    ModuleCache *c = calloc(1, sizeof(ModuleCache));
-    c->path = strdup(path);
+    ModuleCache *c = mem_calloc(1, sizeof(ModuleCache));
+    c->path = mem_strdup(path);
     c->module = mod;
     value_incref(mod);
     c->next = ms->head;
     ms->head = c;
 }
 
+static void cache_remove(ModuleSystem *ms, const char *path) {
+    for (ModuleCache **link = &ms->head; *link; link = &(*link)->next) {
+        ModuleCache *c = *link;
+        if (strcmp(c->path, path) != 0) continue;
+        *link = c->next;
+        mem_free(c->path);
+        value_decref(c->module);
+        mem_free(c);
+        return;
+    }
+}
+
 static char *read_file(const char *path) {
     FILE *f = fopen(path, "r");
     if (!f) return NULL;
     fseek(f, 0, SEEK_END);
     long len = ftell(f);
     fseek(f, 0, SEEK_SET);
-    char *buf = malloc((size_t)len + 1);
+    char *buf = mem_alloc((size_t)len + 1);
     size_t read = fread(buf, 1, (size_t)len, f);
     buf[read] = '\0';
     fclose(f);
     return buf;
 }
 
-Value *load_module(ModuleSystem *ms, const char *path, Interpreter *interp) {
-    Value *cached = cache_lookup(ms, path);
-    if (cached) { value_incref(cached); return cached; }
+/* ------------------------------------------------------------------ shared trees */
+
+/* Parsed modules of the whole process.  An entry is immutable once published
+   and never removed, and publishing is one compare-and-swap onto the head, so
+   interpreters on any thread look trees up without taking a lock.
+
+   Each tree is keyed on the file it came from as well as its path: a file
+   that was replaced or edited since (another inode, mtime or size) is parsed
+   again and published in front of the old tree, which stays for interpreters
+   that may still be running it. */
+typedef struct {
+    dev_t           dev;
+    ino_t           ino;
+    struct timespec mtime;
+    off_t           size;
+} FileStamp;
+
+typedef struct ParsedModule {
+    char                *path;
+    FileStamp            stamp;
+    AstNode             *ast;
+    struct ParsedModule *next;
+} ParsedModule;
+
+static _Atomic(ParsedModule *) parsed;
+
+static int stamp_file(const char *path, FileStamp *st) {
+    struct stat sb;
+    if (stat(path, &sb) != 0) return -1;
+    st->dev   = sb.st_dev;
+    st->ino   = sb.st_ino;
+    st->mtime = sb.st_mtim;
+    st->size  = sb.st_size;
+    return 0;
+}
 
+static int same_stamp(const FileStamp *a, const FileStamp *b) {
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+           a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+static AstNode *parsed_find(ParsedModule *m, const char *path, const FileStamp *st) {
+    for (; m; m = m->next)
+        if (strcmp(m->path, path) == 0) return same_stamp(&m->stamp, st) ? m->ast : NULL;
+    return NULL;
+}
+
+/* The tree of path as the file is now, parsed by whichever interpreter
+   needed it first. */
+static AstNode *shared_tree(const char *path, char *err, size_t err_size) {
+    FileStamp st;
+    if (stamp_file(path, &st) != 0) {
+        snprintf(err, err_size, "module not found: %s", path);
+        return NULL;
+    }
+    AstNode *ast = parsed_find(atomic_load_explicit(&parsed, memory_order_acquire), path, &st);
+    if (ast) return ast;
+
+    /* it belongs to no interpreter, so none is charged for it, nor to any
+       arena, since it outlives them all */
+    MemStats *prev = mem_set_current(NULL);
+    MemArena *arena = mem_arena_enter(NULL);
     char *src = read_file(path);
     if (!src) {
-        fprintf(stderr, "Module not found: %s\n", path);
-        return value_new_null();
+        mem_arena_enter(arena);
+        mem_set_current(prev);
+        snprintf(err, err_size, "module not found: %s", path);
+        return NULL;
     }
-
     Lexer lex;
     lexer_init(&lex, src);
     Parser parser;
     parser_init(&parser, &lex);
-    AstNode *program = parse_program(&parser);
-
+    ast = parse_program(&parser);
+    token_free(&parser.cur);
+    mem_free(src);
     if (parser.had_error) {
-        fprintf(stderr, "Parse error in module %s: %s\n", path, parser.error_msg);
-        ast_free(program);
-        free(src);
-        token_free(&parser.cur);
-        return value_new_null();
+        snprintf(err, err_size, "parse error in module %s: %s", path, parser.error_msg);
+        ast_free(ast);
+        ast = NULL;
     }
+    mem_arena_enter(arena);
+    mem_set_current(prev);
+    if (!ast) return NULL;
 
-    /* Run in a fresh module environment */
-    Env *mod_env = env_new(interp->global);
-    EvalResult r = eval(program, mod_env);
-    ast_free(program);
-    free(src);
-    token_free(&parser.cur);
-
-    if (r.sig == SIG_ERROR) {
-        fprintf(stderr, "Runtime error in module %s: %s\n", path, r.error_msg);
-        value_decref(r.val);
-        env_decref(mod_env);
-        return value_new_null();
+    ParsedModule *m = malloc(sizeof(ParsedModule));
+    char *key = strdup(path);
+    if (!m || !key) {
+        free(m);
+        free(key);
+        ast_free(ast);
+        snprintf(err, err_size, "out of memory loading %s", path);
+        return NULL;
     }
-    value_decref(r.val);
+    m->path = key;
+    m->stamp = st;
+    m->ast = ast;
+    ParsedModule *head = atomic_load_explicit(&parsed, memory_order_acquire);
+    do {
+        /* another thread may have published the same module meanwhile */
+        AstNode *theirs = parsed_find(head, path, &st);
+        if (theirs) {
+            ast_free(ast);
+            free(key);
+            free(m);
+            return theirs;
+        }
+        m->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&parsed, &head, m,
+                                                    memory_order_release, memory_order_acquire));
+    return ast;
+}
 
-    /* extract module name from path */
+/* ------------------------------------------------------------------ loading */
+
+static Value *load_module_file(ModuleSystem *ms, const char *path, Interpreter *interp,
+                               char *err, size_t err_size) {
+    AstNode *program = shared_tree(path, err, err_size);
+    if (!program) return NULL;
+
+    /* module name: file name without directory and .lang extension */
     const char *slash = strrchr(path, '/');
     const char *base = slash ? slash + 1 : path;
-    /* strip .lang extension */
     char name_buf[256];
     strncpy(name_buf, base, sizeof(name_buf) - 1);
     name_buf[sizeof(name_buf)-1] = '\0';
     char *dot = strrchr(name_buf, '.');
     if (dot) *dot = '\0';
 
+    /* Run in a fresh module environment.  The module is cached before its
+       body runs, so an import cycle sees the partly initialised module
+       instead of recursing. */
+    Env *mod_env = env_new(interp->global);
     Value *mod = value_new_module(name_buf, mod_env);
     env_decref(mod_env);
     cache_insert(ms, path, mod);
+
+    const char *heap_where = heapprof_where;
+    int heap_line = heapprof_line;
+    heapprof_where = path;
+    EvalResult r = eval(program, mod_env);
+    heapprof_where = heap_where;
+    heapprof_line = heap_line;
+    value_decref(r.val);
+    if (r.sig == SIG_ERROR) {
+        snprintf(err, err_size, "in module %s: %s", path, r.error_msg);
+        cache_remove(ms, path);
+        value_decref(mod);
+        return NULL;
+    }
+    return mod;
+}
+
+/* load_module_file under the tracer and/or the perf counters */
+static Value *load_module_observed(ModuleSystem *ms, const char *path, Interpreter *interp,
+                                   char *err, size_t err_size) {
+    long long t0 = trace_active ? trace_now() : 0;
+    PerfSample ps;
+    if (perfctr_active) perfctr_read(&ps);
+    Value *mod = load_module_file(ms, path, interp, err, err_size);
+    if (perfctr_active) {
+        char label[96];
+        snprintf(label, sizeof(label), "module %s", path);
+        perfctr_attribute(label, 0, &ps);
+    }
+    if (t0) trace_span("load_module", "module", t0, path);
     return mod;
 }
 
-void resolve_import(AstNode *import_node, Env *env, ModuleSystem *ms, Interpreter *interp) {
-    if (!import_node || import_node->type != AST_IMPORT_DECL) return;
+Value *load_module(ModuleSystem *ms, const char *path, Interpreter *interp, char *err, size_t err_size) {
+    Value *cached = cache_lookup(ms, path);
+    if (cached) { value_incref(cached); return cached; }
+    LANG_PROBE1(module__load__start, path);
+    /* a module imported by a run in an arena whose interpreter outlives it
+       (a --serve request) is cached, so it is loaded outside the arena */
+    MemArena *arena = mem_arena_current();
+    if (arena && mem_in_arena(ms)) arena = NULL;
+    if (arena) mem_arena_enter(NULL);
+    Value *mod = trace_active | perfctr_active ? load_module_observed(ms, path, interp, err, err_size)
+                                               : load_module_file(ms, path, interp, err, err_size);
+    if (arena) mem_arena_enter(arena);
+    LANG_PROBE2(module__load__done, path, mod);
+    return mod;
+}
+
+int resolve_import(AstNode *import_node, Env *env, Interpreter *interp, char *err, size_t err_size) {
+    if (!import_node || import_node->type != AST_IMPORT_DECL) return 0;
 
-    /* Build file path from module name (dots → slashes), preserving .lang extension */
+    /* Build file path from module name (dots → slashes) under module_root, plus .lang */
     const char *mod_name = import_node->name;
     char path_buf[512];
-    /* Replace dots in module name with slashes, then append .lang */
     size_t i = 0;
-    for (; mod_name[i] && i < sizeof(path_buf) - 6; i++) {
-        path_buf[i] = (mod_name[i] == '.') ? '/' : mod_name[i];
+    if (interp->module_root && *interp->module_root)
+        i = (size_t)snprintf(path_buf, sizeof(path_buf) - 6, "%s/", interp->module_root);
+    if (i >= sizeof(path_buf) - 6) i = sizeof(path_buf) - 7;
+    for (const char *c = mod_name; *c && i < sizeof(path_buf) - 6; c++, i++) {
+        path_buf[i] = (*c == '.') ? '/' : *c;
     }
     snprintf(path_buf + i, sizeof(path_buf) - i, ".lang");
 
-    Value *mod = load_module(ms, path_buf, interp);
+    Value *mod = load_module(interp->modules, path_buf, interp, err, err_size);
+    if (!mod) return -1;
     const char *alias = import_node->op ? import_node->op : mod_name;
 
+    int rc = 0;
     if (import_node->child_count == 0) {
         /* import as alias */
         env_def(env, alias, mod);
@@ -130,20 +283,21 @@ void resolve_import(AstNode *import_node, Env *env, ModuleSystem *ms, Interprete
         /* import specific items */
         for (int i = 0; i < import_node->child_count; i++) {
             AstNode *item = import_node->children[i];
-            if (!item) continue;
+            if (!item || !item->name) continue;
             const char *iname = item->name;
             const char *ialias = item->op ? item->op : iname;
-            Value *v = NULL;
-            if (mod->type == VAL_MODULE && mod->module.env) {
-                v = env_get(mod->module.env, iname);
-            }
-            if (v) {
-                value_incref(v);
-                env_def(env, ialias, v);
-                value_decref(v);
+            Value *v = NULL;   /* the module's own definitions, not the globals it sees */
+            for (EnvEntry *en = mod->module.env ? mod->module.env->entries : NULL; en && !v; en = en->next)
+                if (strcmp(en->name, iname) == 0) v = en->val;
+            if (!v) {
+                snprintf(err, err_size, "module %s has no '%s'", mod_name, iname);
+                rc = -1;
+                break;
             }
+            env_def(env, ialias, v);
         }
     }
 
     value_decref(mod);
+    return rc;
 }
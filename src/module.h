@@ -3,6 +3,14 @@
 
 #include "interpreter.h"
 
+/* Modules.
+ *
+ * `import a.b` evaluates a/b.lang, relative to the interpreter's module_root,
+ * once per interpreter, in an environment of its own whose parent is the
+ * global one; the resulting module value is cached per interpreter.  Parsed
+ * trees are cached per process and shared by all interpreters, whatever
+ * thread they run on: a tree is never modified or freed once published. */
+
 /* Module cache entry */
 typedef struct ModuleCache {
     char  *path;
@@ -10,13 +18,17 @@ typedef struct ModuleCache {
     struct ModuleCache *next;
 } ModuleCache;
 
-typedef struct {
+typedef struct ModuleSystem {
     ModuleCache *head;
 } ModuleSystem;
 
 void   module_system_init(ModuleSystem *ms);
 void   module_system_free(ModuleSystem *ms);
-Value *load_module(ModuleSystem *ms, const char *path, Interpreter *interp);
-void   resolve_import(AstNode *import_node, Env *env, ModuleSystem *ms, Interpreter *interp);
+
+/* New reference to the module at path; NULL with the reason in err. */
+Value *load_module(ModuleSystem *ms, const char *path, Interpreter *interp, char *err, size_t err_size);
+
+/* Bind what import_node names in env; 0 on success, -1 with the reason in err. */
+int    resolve_import(AstNode *import_node, Env *env, Interpreter *interp, char *err, size_t err_size);
 
 #endif /* MODULE_H */
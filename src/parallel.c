@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+#include "parallel.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+
+typedef struct {
+    pthread_mutex_t lock;
+    long long       lo, hi;   /* chunks not taken yet: [lo, hi) */
+} Deque;
+
+static atomic_int  threads;   /* as set by par_set_threads, 0 = per CPU */
+static atomic_flag busy = ATOMIC_FLAG_INIT;
+
+/* Owned by whoever holds busy. */
+static pthread_t pool[PAR_MAX_THREADS];
+static int       started;     /* pool threads running: workers 1..started */
+static Deque     deques[PAR_MAX_THREADS];
+static int       deques_ready;
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT;
+
+/* The current job, published under wake_lock. */
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  done = PTHREAD_COND_INITIALIZER;
+static unsigned long   generation;   /* bumped for every job */
+static int             job_workers;
+static int             running;      /* pool workers still busy with the job */
+static ParChunkFn      job_fn;
+static void           *job_ctx;
+
+void par_set_threads(int n) {
+    atomic_store(&threads, n > PAR_MAX_THREADS ? PAR_MAX_THREADS : n < 0 ? 0 : n);
+}
+
+int par_threads(void) {
+    int n = atomic_load(&threads);
+    if (n > 0) return n;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus < 1 ? 1 : cpus > PAR_MAX_THREADS ? PAR_MAX_THREADS : (int)cpus;
+}
+
+/* ------------------------------------------------------------------ scheduling */
+
+static int take(Deque *d, long long *chunk) {
+    pthread_mutex_lock(&d->lock);
+    int got = d->lo < d->hi;
+    if (got) *chunk = d->lo++;
+    pthread_mutex_unlock(&d->lock);
+    return got;
+}
+
+/* Move the back half of the fullest other deque into self's (empty) one;
+   0 once there is nothing left anywhere. */
+static int steal(int self, int workers) {
+    int victim = -1;
+    long long most = 0;
+    for (int i = 0; i < workers; i++) {
+        if (i == self) continue;
+        pthread_mutex_lock(&deques[i].lock);
+        long long left = deques[i].hi - deques[i].lo;
+        pthread_mutex_unlock(&deques[i].lock);
+        if (left > most) { most = left; victim = i; }
+    }
+    if (victim < 0) return 0;
+
+    Deque *v = &deques[victim];
+    pthread_mutex_lock(&v->lock);
+    long long left = v->hi - v->lo, mid = v->hi - (left + 1) / 2, hi = v->hi;
+    if (left > 0) v->hi = mid;
+    pthread_mutex_unlock(&v->lock);
+    if (left <= 0) return 1;   /* emptied meanwhile: look again */
+
+    pthread_mutex_lock(&deques[self].lock);
+    deques[self].lo = mid;
+    deques[self].hi = hi;
+    pthread_mutex_unlock(&deques[self].lock);
+    return 1;
+}
+
+static void work(int self, int workers, ParChunkFn fn, void *ctx) {
+    long long chunk;
+    do {
+        while (take(&deques[self], &chunk)) fn(ctx, self, chunk);
+    } while (steal(self, workers));
+}
+
+static void *pool_main(void *arg) {
+    int self = (int)(intptr_t)arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&wake_lock);
+    for (;;) {
+        while (generation == seen) pthread_cond_wait(&wake, &wake_lock);
+        seen = generation;
+        if (self >= job_workers) continue;
+        int workers = job_workers;
+        ParChunkFn fn = job_fn;
+        void *ctx = job_ctx;
+        pthread_mutex_unlock(&wake_lock);
+        work(self, workers, fn, ctx);
+        pthread_mutex_lock(&wake_lock);
+        if (--running == 0) pthread_cond_signal(&done);
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ fork */
+
+/* A child of fork() has none of the pool's threads, only their state, and
+   locks some of them may have held.  It starts over with a pool of its own
+   (a --serve worker forked after the prelude ran a parallel loop). */
+static void after_fork_child(void) {
+    started = 0;
+    deques_ready = 0;
+    pthread_mutex_init(&wake_lock, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_cond_init(&done, NULL);
+    generation = 0;
+    job_workers = 0;
+    running = 0;
+    job_fn = NULL;
+    job_ctx = NULL;
+    atomic_flag_clear(&busy);
+}
+
+static void watch_fork(void) { pthread_atfork(NULL, NULL, after_fork_child); }
+
+/* ------------------------------------------------------------------ par_for */
+
+void par_for(long long chunks, int max_workers, ParChunkFn fn, void *ctx) {
+    int workers = par_threads();
+    if (workers > max_workers) workers = max_workers;
+    if (workers > chunks) workers = (int)chunks;
+    if (workers < 2 || atomic_flag_test_and_set_explicit(&busy, memory_order_acquire)) {
+        for (long long c = 0; c < chunks; c++) fn(ctx, 0, c);
+        return;
+    }
+
+    pthread_once(&fork_once, watch_fork);
+    if (!deques_ready) {
+        for (int i = 0; i < PAR_MAX_THREADS; i++) pthread_mutex_init(&deques[i].lock, NULL);
+        deques_ready = 1;
+    }
+    while (started < workers - 1
+           && pthread_create(&pool[started], NULL, pool_main, (void *)(intptr_t)(started + 1)) == 0)
+        started++;
+    if (workers > started + 1) workers = started + 1;
+
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_lock(&deques[i].lock);
+        deques[i].lo = chunks * i / workers;
+        deques[i].hi = chunks * (i + 1) / workers;
+        pthread_mutex_unlock(&deques[i].lock);
+    }
+
+    pthread_mutex_lock(&wake_lock);
+    job_fn = fn;
+    job_ctx = ctx;
+    job_workers = workers;
+    running = workers - 1;
+    generation++;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&wake_lock);
+
+    work(0, workers, fn, ctx);
+
+    pthread_mutex_lock(&wake_lock);
+    while (running > 0) pthread_cond_wait(&done, &wake_lock);
+    pthread_mutex_unlock(&wake_lock);
+    atomic_flag_clear_explicit(&busy, memory_order_release);
+}
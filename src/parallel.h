@@ -0,0 +1,29 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/* Work-stealing thread pool for parallel loops (for (...) :: parallel).
+ *
+ * par_for runs fn(ctx, worker, chunk) once for every chunk in [0, chunks) on
+ * up to max_workers threads, the calling thread included as worker 0, and
+ * returns when all of them have run.  Each worker starts with an equal,
+ * contiguous share of the chunks in a deque of its own and takes them from the
+ * front; one that runs dry steals the back half of the fullest other deque, so
+ * uneven chunks even out without every chunk going through a shared counter.
+ *
+ * The pool's threads are started on first use and live as long as the
+ * process; a child of fork() starts threads of its own.  It runs one loop at a
+ * time: a par_for that finds it busy (a loop on another thread, or one nested
+ * in a chunk) runs every chunk on the calling thread, as worker 0. */
+
+#define PAR_MAX_THREADS 64
+
+typedef void (*ParChunkFn)(void *ctx, int worker, long long chunk);
+
+/* Threads a loop may use, the calling one included; 0 = one per online CPU
+   (the default), 1 = run every loop on the calling thread. */
+void par_set_threads(int n);
+int  par_threads(void);
+
+void par_for(long long chunks, int max_workers, ParChunkFn fn, void *ctx);
+
+#endif /* PARALLEL_H */
@@ -1,5 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include "parser.h"
+#include "mem.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -21,6 +23,9 @@ static AstNode *parse_primary(Parser *p);
 static AstNode *parse_template_args(Parser *p);
 static AstNode *parse_template_decl(Parser *p);
 static AstNode *parse_type_ann(Parser *p);
+static void mark_late_bindings(AstNode *prog);
+static int binop_prec(TokenType t);
+static const char *tok_op_str(TokenType t);
 
 /* ------------------------------------------------------------------ helpers */
 
@@ -60,13 +65,32 @@ static void expect(Parser *p, TokenType t) {
     advance(p);
 }
 
-/* Consume any trailing attribute keywords (static, const, constexpr) and set
-   the corresponding flags on node.  Called after a '::' has already been consumed. */
+/* Consume any trailing attribute keywords (static, const, constexpr,
+   parallel, generator) and set the corresponding flags on node.  Called after
+   a '::' has already been consumed.  parallel may name a reduction:
+   parallel(+), parallel(min), parallel(max), any binary operator. */
 static void parse_attrs(Parser *p, AstNode *node) {
     while (check(p, TK_STATIC) || check(p, TK_CONST) || check(p, TK_CONSTEXPR) || check(p, TK_IDENT)) {
         if (check(p, TK_STATIC))    { node->is_static    = 1; advance(p); }
         else if (check(p, TK_CONST))     { node->is_const     = 1; advance(p); }
         else if (check(p, TK_CONSTEXPR)) { node->is_constexpr = 1; advance(p); }
+        else if (strcmp(p->cur.value, "parallel") == 0) {
+            node->is_parallel = 1;
+            advance(p);
+            if (match(p, TK_LPAREN)) {
+                if (binop_prec(p->cur.type) > 0) {
+                    node->op = mem_strdup(tok_op_str(p->cur.type));
+                    advance(p);
+                } else if (check(p, TK_IDENT) && (strcmp(p->cur.value, "min") == 0 || strcmp(p->cur.value, "max") == 0)) {
+                    node->op = mem_strdup(p->cur.value);
+                    advance(p);
+                } else {
+                    parser_error(p, "expected a reduction operator in parallel(...)");
+                }
+                expect(p, TK_RPAREN);
+            }
+        }
+        else if (strcmp(p->cur.value, "generator") == 0) { node->is_generator = 1; advance(p); }
         else advance(p); /* allow unknown attrs syntactically */
     }
 }
@@ -77,6 +101,7 @@ void parser_init(Parser *p, Lexer *lex) {
     p->lex = lex;
     p->had_error = 0;
     p->error_msg[0] = '\0';
+    p->in_generator = 0;
     p->cur.value = NULL;
     advance(p); /* prime first token */
 }
@@ -84,6 +109,7 @@ void parser_init(Parser *p, Lexer *lex) {
 /* ------------------------------------------------------------------ program */
 
 AstNode *parse_program(Parser *p) {
+    long long t0 = trace_active ? trace_now() : 0;
     AstNode *prog = ast_new(AST_PROGRAM, 1, 1);
     skip_terminators(p);
     while (!check(p, TK_EOF) && !p->had_error) {
@@ -92,6 +118,12 @@ AstNode *parse_program(Parser *p) {
         /* consume terminators between statements */
         while (check(p, TK_NEWLINE) || check(p, TK_SEMI)) advance(p);
     }
+    mark_late_bindings(prog);
+    if (trace_active) {
+        char detail[64];
+        snprintf(detail, sizeof(detail), "%d top-level statements", prog->child_count);
+        trace_span("parse_program", "parse", t0, detail);
+    }
     return prog;
 }
 
@@ -118,6 +150,7 @@ static AstNode *parse_stmt(Parser *p) {
             int line = p->cur.line, col = p->cur.col;
             advance(p);
             AstNode *n = ast_new(AST_YIELD, line, col);
+            n->is_generator = p->in_generator;
             if (!check(p, TK_NEWLINE) && !check(p, TK_SEMI) && !check(p, TK_EOF) && !check(p, TK_RBRACE))
                 n->init = parse_expr(p);
             return n;
@@ -156,7 +189,7 @@ static AstNode *parse_template_decl(Parser *p) {
     while (!check(p, TK_GT) && !check(p, TK_EOF)) {
         if (check(p, TK_IDENT)) {
             AstNode *param = ast_new(AST_PARAM, p->cur.line, p->cur.col);
-            param->name = strdup(p->cur.value);
+            param->name = mem_strdup(p->cur.value);
             advance(p);
 
             if (match(p, TK_DCOLON)) {
@@ -171,7 +204,7 @@ static AstNode *parse_template_decl(Parser *p) {
                 if (check(p, TK_IDENT) || check(p, TK_VAR)) {
                     /* type constraint — store in type_ann */
                     AstNode *ta = ast_new(AST_TYPE_ANN, p->cur.line, p->cur.col);
-                    ta->data.str_val = strdup(p->cur.value);
+                    ta->data.str_val = mem_strdup(p->cur.value);
                     param->type_ann = ta;
                     advance(p);
                 }
@@ -195,6 +228,198 @@ static AstNode *parse_template_decl(Parser *p) {
     return tmpl;
 }
 
+/* ------------------------------------------------------------------ free variables */
+
+typedef struct {
+    char **names;
+    int    count, cap;
+} NameSet;
+
+static int nameset_has(NameSet *s, const char *name) {
+    for (int i = 0; i < s->count; i++) if (strcmp(s->names[i], name) == 0) return 1;
+    return 0;
+}
+
+static void nameset_add(NameSet *s, const char *name) {
+    if (!name || nameset_has(s, name)) return;
+    if (s->count >= s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 8;
+        s->names = mem_realloc(s->names, sizeof(char *) * (size_t)s->cap);
+    }
+    s->names[s->count++] = mem_strdup(name);
+}
+
+static void nameset_free(NameSet *s) {
+    for (int i = 0; i < s->count; i++) mem_free(s->names[i]);
+    mem_free(s->names);
+}
+
+/* Collect identifiers referenced by node into refs and names it declares into
+   decls.  Nested functions contribute their own free variables instead of
+   being walked again; pattern bodies are skipped because their methods only
+   ever see the pattern's own environment. */
+static void collect_names(AstNode *node, NameSet *refs, NameSet *decls) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_IDENT:
+            nameset_add(refs, node->name);
+            return;
+        case AST_FN_DECL:
+            nameset_add(decls, node->name);
+            for (int i = 0; i < node->free_var_count; i++)
+                if (!node->free_var_local[i]) nameset_add(refs, node->free_vars[i]);
+            return;
+        case AST_PAT_DECL:
+            nameset_add(decls, node->name);
+            return;
+        case AST_IMPORT_DECL:
+            nameset_add(decls, node->op ? node->op : node->name);
+            for (int i = 0; i < node->child_count; i++) {
+                AstNode *item = node->children[i];
+                if (item) nameset_add(decls, item->op ? item->op : item->name);
+            }
+            return;
+        case AST_VAR_DECL:
+            nameset_add(decls, node->name);
+            collect_names(node->init, refs, decls);
+            return;
+        case AST_FOR:
+            if (node->init) nameset_add(decls, node->init->name);
+            collect_names(node->cond, refs, decls);
+            collect_names(node->body, refs, decls);
+            return;
+        case AST_MEMBER:
+        case AST_PARAM:
+            collect_names(node->init, refs, decls);
+            return;
+        case AST_TYPE_ANN:   /* evaluated, it looks its type name up */
+            if (node->data.str_val) nameset_add(refs, node->data.str_val);
+            return;
+        default:
+            for (int i = 0; i < node->child_count; i++) collect_names(node->children[i], refs, decls);
+            collect_names(node->init, refs, decls);
+            collect_names(node->body, refs, decls);
+            collect_names(node->cond, refs, decls);
+            collect_names(node->alt,  refs, decls);
+            return;
+    }
+}
+
+/* Resolve fn->free_vars: everything the body (and parameter defaults) refers to
+   except the parameters and named return variables bound on entry. */
+static void resolve_free_vars(AstNode *fn) {
+    NameSet refs = {0}, decls = {0}, bound = {0};
+    for (int i = 0; i < fn->child_count; i++) {
+        AstNode *param = fn->children[i];
+        if (!param || param->type != AST_PARAM) continue;
+        nameset_add(&bound, param->name);
+        collect_names(param->init, &refs, &decls);
+    }
+    if (fn->type_ann && fn->type_ann->type == AST_TUPLE) {
+        for (int i = 0; i < fn->type_ann->child_count; i++) {
+            AstNode *rta = fn->type_ann->children[i];
+            if (rta) nameset_add(&bound, rta->name);
+        }
+    }
+    collect_names(fn->body, &refs, &decls);
+
+    for (int i = 0; i < refs.count; i++) {
+        if (nameset_has(&bound, refs.names[i])) continue;
+        if (fn->free_var_count % 8 == 0) {
+            size_t n = (size_t)fn->free_var_count + 8;
+            fn->free_vars      = mem_realloc(fn->free_vars, sizeof(char *) * n);
+            fn->free_var_local = mem_realloc(fn->free_var_local, n);
+        }
+        fn->free_vars[fn->free_var_count]      = mem_strdup(refs.names[i]);
+        fn->free_var_local[fn->free_var_count] = (unsigned char)nameset_has(&decls, refs.names[i]);
+        fn->free_var_count++;
+    }
+    nameset_free(&refs);
+    nameset_free(&decls);
+    nameset_free(&bound);
+}
+
+/* ------------------------------------------------------------------ late bindings */
+
+/* A statement of an enclosing statement list: the list and its index. */
+typedef struct {
+    AstNode *list;
+    int      at;
+} ScopeFrame;
+
+typedef struct {
+    ScopeFrame *frames;
+    int         count, cap;
+} ScopeStack;
+
+static int declares(AstNode *stmt, const char *name) {
+    if (!stmt) return 0;
+    switch (stmt->type) {
+        case AST_VAR_DECL:
+        case AST_FN_DECL:
+        case AST_PAT_DECL:
+            return stmt->name && strcmp(stmt->name, name) == 0;
+        case AST_IMPORT_DECL: {
+            const char *as = stmt->op ? stmt->op : stmt->name;
+            if (as && strcmp(as, name) == 0) return 1;
+            for (int i = 0; i < stmt->child_count; i++) {
+                AstNode *item = stmt->children[i];
+                const char *n = item ? (item->op ? item->op : item->name) : NULL;
+                if (n && strcmp(n, name) == 0) return 1;
+            }
+            return 0;
+        }
+        default:
+            return 0;
+    }
+}
+
+/* Set fn->binds_late when a statement list around fn declares one of its free
+   variables after it: when fn is created that declaration has not run yet, and
+   once it has, it shadows whatever the name resolved to before. */
+static void check_late(AstNode *fn, ScopeStack *st) {
+    for (int i = 0; i < fn->free_var_count; i++) {
+        if (fn->free_var_local[i]) continue;
+        for (int f = st->count - 1; f >= 0; f--) {
+            AstNode *list = st->frames[f].list;
+            for (int j = st->frames[f].at + 1; j < list->child_count; j++)
+                if (declares(list->children[j], fn->free_vars[i])) { fn->binds_late = 1; return; }
+        }
+    }
+}
+
+/* Statement lists are the program, scope bodies and switch cases; each runs in
+   an environment of its own.  Pattern bodies are skipped as in collect_names. */
+static void walk_late(AstNode *node, ScopeStack *st) {
+    if (!node || node->type == AST_PAT_DECL) return;
+    if (node->type == AST_FN_DECL) check_late(node, st);
+    if (node->type == AST_PROGRAM || node->type == AST_SCOPE || node->type == AST_CASE) {
+        if (st->count >= st->cap) {
+            st->cap = st->cap ? st->cap * 2 : 16;
+            st->frames = mem_realloc(st->frames, sizeof(ScopeFrame) * (size_t)st->cap);
+        }
+        int f = st->count++;
+        st->frames[f].list = node;
+        for (int i = 0; i < node->child_count; i++) {
+            st->frames[f].at = i;
+            walk_late(node->children[i], st);
+        }
+        st->count--;
+    } else {
+        for (int i = 0; i < node->child_count; i++) walk_late(node->children[i], st);
+    }
+    walk_late(node->init, st);
+    walk_late(node->body, st);
+    walk_late(node->cond, st);
+    walk_late(node->alt,  st);
+}
+
+static void mark_late_bindings(AstNode *prog) {
+    ScopeStack st = {0};
+    walk_late(prog, &st);
+    mem_free(st.frames);
+}
+
 /* ------------------------------------------------------------------ fn */
 
 static AstNode *parse_fn_decl(Parser *p, int is_pub) {
@@ -208,10 +433,10 @@ static AstNode *parse_fn_decl(Parser *p, int is_pub) {
 
     /* name: identifier or quoted custom operator */
     if (check(p, TK_IDENT)) {
-        fn->name = strdup(p->cur.value);
+        fn->name = mem_strdup(p->cur.value);
         advance(p);
     } else if (check(p, TK_OP_CUSTOM)) {
-        fn->name = strdup(p->cur.value);
+        fn->name = mem_strdup(p->cur.value);
         advance(p);
     } else {
         parser_error(p, "expected function name");
@@ -229,7 +454,7 @@ static AstNode *parse_fn_decl(Parser *p, int is_pub) {
         if (check(p, TK_COPY)) { param->is_const = 1; advance(p); }
         else if (check(p, TK_MOVE)) { param->is_static = 1; advance(p); }
         if (check(p, TK_IDENT)) {
-            param->name = strdup(p->cur.value);
+            param->name = mem_strdup(p->cur.value);
             advance(p);
         }
         /* param::attrs — type omitted, attributes present */
@@ -278,10 +503,14 @@ static AstNode *parse_fn_decl(Parser *p, int is_pub) {
         parse_attrs(p, fn);
     }
 
-    /* body */
+    /* body; a yield in it belongs to this function alone */
+    int outer_generator = p->in_generator;
+    p->in_generator = fn->is_generator;
     skip_terminators(p);
     if (check(p, TK_LBRACE)) fn->body = parse_scope(p);
+    p->in_generator = outer_generator;
 
+    resolve_free_vars(fn);
     return fn;
 }
 
@@ -298,7 +527,7 @@ static AstNode *parse_var_decl(Parser *p, int is_pub) {
 
     /* name */
     if (!check(p, TK_IDENT)) { parser_error(p, "expected variable name"); return vd; }
-    vd->name = strdup(p->cur.value);
+    vd->name = mem_strdup(p->cur.value);
     advance(p);
 
     /* optional type annotation and/or attributes.
@@ -347,7 +576,7 @@ static AstNode *parse_pat_decl(Parser *p, int is_pub) {
     pd->tmpl = parse_template_decl(p);
 
     if (!check(p, TK_IDENT)) { parser_error(p, "expected pattern name"); return pd; }
-    pd->name = strdup(p->cur.value);
+    pd->name = mem_strdup(p->cur.value);
     advance(p);
 
     /* optional base patterns and/or attributes.
@@ -365,7 +594,7 @@ static AstNode *parse_pat_decl(Parser *p, int is_pub) {
         /* consume base pat names separated by | */
         do {
             AstNode *base = ast_new(AST_IDENT, p->cur.line, p->cur.col);
-            if (check(p, TK_IDENT)) { base->name = strdup(p->cur.value); advance(p); }
+            if (check(p, TK_IDENT)) { base->name = mem_strdup(p->cur.value); advance(p); }
             ast_add_child(pd, base);
         } while (match(p, TK_PIPE));
         /* optional attributes after :: */
@@ -390,11 +619,11 @@ static AstNode *parse_import_decl(Parser *p) {
     /* module path: ident[.ident]* */
     if (!check(p, TK_IDENT)) { parser_error(p, "expected module name"); return imp; }
     size_t cap = 128, len = 0;
-    char *path = malloc(cap);
+    char *path = mem_alloc(cap);
     path[0] = '\0';
     while (check(p, TK_IDENT)) {
         size_t n = strlen(p->cur.value);
-        if (len + n + 2 >= cap) { cap *= 2; path = realloc(path, cap); }
+        if (len + n + 2 >= cap) { cap *= 2; path = mem_realloc(path, cap); }
         if (len > 0) { path[len++] = '.'; }
         memcpy(path + len, p->cur.value, n);
         len += n;
@@ -406,7 +635,7 @@ static AstNode *parse_import_decl(Parser *p) {
 
     /* optional 'as' alias */
     if (match(p, TK_AS)) {
-        if (check(p, TK_IDENT)) { imp->op = strdup(p->cur.value); advance(p); }
+        if (check(p, TK_IDENT)) { imp->op = mem_strdup(p->cur.value); advance(p); }
     }
 
     /* optional 'of' items */
@@ -414,9 +643,9 @@ static AstNode *parse_import_decl(Parser *p) {
         int has_brace = match(p, TK_LBRACE);
         do {
             AstNode *item = ast_new(AST_IMPORT_ITEM, p->cur.line, p->cur.col);
-            if (check(p, TK_IDENT)) { item->name = strdup(p->cur.value); advance(p); }
+            if (check(p, TK_IDENT)) { item->name = mem_strdup(p->cur.value); advance(p); }
             if (match(p, TK_AS)) {
-                if (check(p, TK_IDENT)) { item->op = strdup(p->cur.value); advance(p); }
+                if (check(p, TK_IDENT)) { item->op = mem_strdup(p->cur.value); advance(p); }
             }
             ast_add_child(imp, item);
             if (!match(p, TK_COMMA)) break;
@@ -435,7 +664,7 @@ static AstNode *parse_type_ann(Parser *p) {
 
     /* named return value: name:type */
     if (check(p, TK_IDENT) && lexer_peek(p->lex).type == TK_COLON) {
-        ta->name = strdup(p->cur.value);
+        ta->name = mem_strdup(p->cur.value);
         advance(p);
         advance(p); /* consume : */
         /* If attrs follow immediately, this was actually `type:attrs`, not `name:type`. */
@@ -449,14 +678,14 @@ static AstNode *parse_type_ann(Parser *p) {
 
     /* type name, possibly with template args */
     if (check(p, TK_IDENT)) {
-        ta->data.str_val = strdup(p->cur.value);
+        ta->data.str_val = mem_strdup(p->cur.value);
         advance(p);
         /* template instantiation */
         if (check(p, TK_LT)) {
             ta->init = parse_template_args(p);
         }
     } else if (check(p, TK_NULL)) {
-        ta->data.str_val = strdup("null");
+        ta->data.str_val = mem_strdup("null");
         advance(p);
     }
 
@@ -493,17 +722,24 @@ static AstNode *parse_for(Parser *p) {
     expect(p, TK_LPAREN);
     /* val : range */
     AstNode *var = ast_new(AST_IDENT, p->cur.line, p->cur.col);
-    if (check(p, TK_IDENT)) { var->name = strdup(p->cur.value); advance(p); }
+    if (check(p, TK_IDENT)) { var->name = mem_strdup(p->cur.value); advance(p); }
     fn->init = var;
     expect(p, TK_COLON);
     fn->cond = parse_expr(p);
     expect(p, TK_RPAREN);
-    /* optional type/attrs */
-    if (match(p, TK_COLON)) {
-        while (check(p, TK_COLON) || check(p, TK_IDENT)) advance(p);
+    /* optional : Type [: attrs] or :: attrs */
+    if (match(p, TK_DCOLON)) {
+        parse_attrs(p, fn);
+    } else if (match(p, TK_COLON)) {
+        if (check(p, TK_IDENT)) advance(p);   /* element type, not checked */
+        if (match(p, TK_COLON) || match(p, TK_DCOLON)) parse_attrs(p, fn);
     }
+    /* a parallel body yields to its reduction, even inside a generator */
+    int outer_generator = p->in_generator;
+    if (fn->is_parallel) p->in_generator = 0;
     skip_terminators(p);
     fn->body = parse_scope(p);
+    p->in_generator = outer_generator;
     return fn;
 }
 
@@ -672,7 +908,7 @@ static AstNode *parse_expr_prec(Parser *p, int min_prec) {
         advance(p);
         AstNode *right = parse_expr_prec(p, prec);
         AstNode *bin = ast_new(AST_BINOP, line, col);
-        bin->op = strdup(op);
+        bin->op = mem_strdup(op);
         ast_add_child(bin, left);
         ast_add_child(bin, right);
         left = bin;
@@ -700,7 +936,7 @@ static AstNode *parse_unary(Parser *p) {
         if (p->cur.type == TK_TILDE) op = "~";
         advance(p);
         AstNode *n = ast_new(AST_UNOP, line, col);
-        n->op = strdup(op);
+        n->op = mem_strdup(op);
         n->init = parse_unary(p);
         return n;
     }
@@ -764,6 +1000,10 @@ static AstNode *parse_primary(Parser *p) {
         return NULL;
     }
 
+    /* loops are expressions too: their value is what they yield */
+    if (check(p, TK_FOR))   return parse_for(p);
+    if (check(p, TK_WHILE)) return parse_while(p);
+
     if (check(p, TK_INT_LIT)) {
         AstNode *n = ast_new(AST_INT_LIT, line, col);
         n->data.int_val = strtoll(p->cur.value, NULL, 10);
@@ -778,7 +1018,7 @@ static AstNode *parse_primary(Parser *p) {
     }
     if (check(p, TK_STR_LIT)) {
         AstNode *n = ast_new(AST_STR_LIT, line, col);
-        n->data.str_val = strdup(p->cur.value);
+        n->data.str_val = mem_strdup(p->cur.value);
         advance(p);
         return n;
     }
@@ -788,7 +1028,7 @@ static AstNode *parse_primary(Parser *p) {
     }
     if (check(p, TK_IDENT)) {
         AstNode *n = ast_new(AST_IDENT, line, col);
-        n->name = strdup(p->cur.value);
+        n->name = mem_strdup(p->cur.value);
         advance(p);
         return n;
     }
@@ -812,7 +1052,7 @@ static AstNode *parse_primary(Parser *p) {
                 if (look.type == TK_EQ) {
                     /* (name=value) */
                     AstNode *pnode = ast_new(AST_PARAM, p->cur.line, p->cur.col);
-                    pnode->name = strdup(p->cur.value);
+                    pnode->name = mem_strdup(p->cur.value);
                     advance(p);
                     expect(p, TK_EQ);
                     pnode->init = parse_expr(p);
@@ -821,7 +1061,7 @@ static AstNode *parse_primary(Parser *p) {
                 } else if (look.type == TK_COLON) {
                     /* (name:type[:attrs]=value) or legacy (name:value) */
                     AstNode *pnode = ast_new(AST_PARAM, p->cur.line, p->cur.col);
-                    pnode->name = strdup(p->cur.value);
+                    pnode->name = mem_strdup(p->cur.value);
                     advance(p);
                     expect(p, TK_COLON);
                     pnode->type_ann = parse_type_ann(p);
@@ -894,7 +1134,7 @@ static AstNode *parse_postfix(Parser *p, AstNode *base) {
             AstNode *mem = ast_new(AST_MEMBER, line, col);
             mem->init = base;
             if (check(p, TK_IDENT)) {
-                mem->name = strdup(p->cur.value);
+                mem->name = mem_strdup(p->cur.value);
                 advance(p);
             }
             base = mem;
@@ -934,10 +1174,10 @@ static AstNode *parse_postfix(Parser *p, AstNode *base) {
             TokenType saved_lr = p->lex->last_real;
             int saved_hp = p->lex->has_peek;
             Token saved_peek = p->lex->peek_buf;
-            if (saved_hp && saved_peek.value) saved_peek.value = strdup(saved_peek.value);
+            if (saved_hp && saved_peek.value) saved_peek.value = mem_strdup(saved_peek.value);
             Token saved_cur;
             saved_cur.type = p->cur.type;
-            saved_cur.value = p->cur.value ? strdup(p->cur.value) : NULL;
+            saved_cur.value = p->cur.value ? mem_strdup(p->cur.value) : NULL;
             saved_cur.line = p->cur.line;
             saved_cur.col = p->cur.col;
 
@@ -978,9 +1218,9 @@ static AstNode *parse_postfix(Parser *p, AstNode *base) {
                 p->cur = saved_cur;
                 break;
             }
-            free(saved_cur.value);
+            mem_free(saved_cur.value);
             /* Only free saved_peek.value if it was strdup'd (i.e., was_peek was set) */
-            if (saved_hp) free(saved_peek.value);
+            if (saved_hp) mem_free(saved_peek.value);
         } else {
             break;
         }
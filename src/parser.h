@@ -9,6 +9,7 @@ typedef struct {
     Token  cur;
     int    had_error;
     char   error_msg[256];
+    int    in_generator;   /* parsing the body of a ::generator function */
 } Parser;
 
 void    parser_init(Parser *p, Lexer *lex);
@@ -0,0 +1,196 @@
+#define _GNU_SOURCE
+#include "perfctr.h"
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+int perfctr_active;
+_Thread_local long long perfctr_nodes;
+
+static const struct { unsigned type; unsigned long long config; const char *name; } events[PERF_COUNTER_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,       "cycles" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,     "instructions" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,    "branch-miss" },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "L1d-miss" },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "LLC-miss" },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,      "page-faults" },
+};
+
+static int        fds[PERF_COUNTER_COUNT] = { -1, -1, -1, -1, -1, -1 };
+static int        available[PERF_COUNTER_COUNT];
+static PerfSample run_start, run_total;
+
+/* ------------------------------------------------------------------ counters */
+
+int perfctr_start(void) {
+    int open = 0, first_errno = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        struct perf_event_attr a;
+        memset(&a, 0, sizeof(a));
+        a.size = sizeof(a);
+        a.type = events[i].type;
+        a.config = events[i].config;
+        a.exclude_kernel = 1;
+        a.exclude_hv = 1;
+        a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds[i] = (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        available[i] = fds[i] >= 0;
+        if (fds[i] >= 0) open++;
+        else if (!first_errno) first_errno = errno;
+    }
+    if (open < PERF_COUNTER_COUNT)
+        fprintf(stderr, "perf counters: %d of %d available (%s)\n", open, PERF_COUNTER_COUNT,
+                strerror(first_errno));
+    if (!open) return -1;
+    perfctr_nodes = 0;
+    perfctr_active = 1;
+    perfctr_read(&run_start);
+    return open;
+}
+
+void perfctr_stop(void) {
+    if (!perfctr_active) return;
+    PerfSample end;
+    perfctr_read(&end);
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) run_total.v[i] = end.v[i] - run_start.v[i];
+    run_total.nodes = end.nodes - run_start.nodes;
+    perfctr_active = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+        fds[i] = -1;
+    }
+}
+
+void perfctr_read(PerfSample *s) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        unsigned long long buf[3];   /* value, time enabled, time running */
+        s->v[i] = 0;
+        if (fds[i] < 0 || read(fds[i], buf, sizeof(buf)) != (ssize_t)sizeof(buf)) continue;
+        s->v[i] = buf[2] && buf[2] < buf[1]
+                ? (long long)((double)buf[0] * (double)buf[1] / (double)buf[2])
+                : (long long)buf[0];
+    }
+    s->nodes = perfctr_nodes;
+}
+
+/* ------------------------------------------------------------------ attribution */
+
+typedef struct {
+    char       label[96];
+    int        line;
+    long long  runs;
+    PerfSample total;
+    int        next;       /* hash chain */
+} PerfEntry;
+
+#define PERF_BUCKETS 1024
+
+static PerfEntry *entries;
+static int        entry_count, entry_cap;
+static int        buckets[PERF_BUCKETS];
+static int        buckets_ready;
+
+static unsigned hash_key(const char *label, int line) {
+    unsigned h = 2166136261u ^ (unsigned)line;
+    for (; label && *label; label++) h = (h ^ (unsigned char)*label) * 16777619u;
+    return h % PERF_BUCKETS;
+}
+
+void perfctr_attribute(const char *label, int line, const PerfSample *start) {
+    PerfSample now;
+    perfctr_read(&now);
+    if (!buckets_ready) {
+        for (int i = 0; i < PERF_BUCKETS; i++) buckets[i] = -1;
+        buckets_ready = 1;
+    }
+    if (!label) label = "";
+    unsigned b = hash_key(label, line);
+    int idx = buckets[b];
+    while (idx >= 0 && (entries[idx].line != line || strcmp(entries[idx].label, label) != 0))
+        idx = entries[idx].next;
+    if (idx < 0) {
+        if (entry_count >= entry_cap) {
+            entry_cap = entry_cap ? entry_cap * 2 : 64;
+            entries = realloc(entries, sizeof(PerfEntry) * (size_t)entry_cap);
+        }
+        idx = entry_count++;
+        memset(&entries[idx], 0, sizeof(PerfEntry));
+        snprintf(entries[idx].label, sizeof(entries[idx].label), "%s", label);
+        entries[idx].line = line;
+        entries[idx].next = buckets[b];
+        buckets[b] = idx;
+    }
+    PerfEntry *e = &entries[idx];
+    e->runs++;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) e->total.v[i] += now.v[i] - start->v[i];
+    e->total.nodes += now.nodes - start->nodes;
+}
+
+/* ------------------------------------------------------------------ report */
+
+static int sort_key;   /* counter the rows are ordered by, -1 = nodes */
+
+static long long key_of(const PerfEntry *e) {
+    return sort_key >= 0 ? e->total.v[sort_key] : e->total.nodes;
+}
+
+static int by_key(const void *a, const void *b) {
+    long long x = key_of(a), y = key_of(b);
+    return (x < y) - (x > y);
+}
+
+static void print_count(FILE *f, int i, long long v) {
+    if (!available[i]) fprintf(f, " %13s", "n/a");
+    else fprintf(f, " %13lld", v);
+}
+
+static void print_ratio(FILE *f, int avail, double num, double den, const char *fmt) {
+    if (!avail || den <= 0) fprintf(f, " %9s", "n/a");
+    else fprintf(f, fmt, num / den);
+}
+
+static void print_row(FILE *f, const char *name, const PerfSample *s) {
+    fprintf(f, "%-24s", name);
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) print_count(f, i, s->v[i]);
+    fprintf(f, " %12lld", s->nodes);
+    int have_ipc = available[PERF_CYCLES] && available[PERF_INSTRUCTIONS];
+    print_ratio(f, have_ipc, (double)s->v[PERF_INSTRUCTIONS], (double)s->v[PERF_CYCLES], " %9.2f");
+    print_ratio(f, available[PERF_L1D_MISSES], (double)s->v[PERF_L1D_MISSES], (double)s->nodes, " %9.3f");
+    print_ratio(f, available[PERF_LLC_MISSES], (double)s->v[PERF_LLC_MISSES], (double)s->nodes, " %9.3f");
+    fprintf(f, "\n");
+}
+
+void perfctr_report(FILE *f) {
+    fprintf(f, "perf counters (user space)\n%-24s", "");
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) fprintf(f, " %13s", events[i].name);
+    fprintf(f, " %12s %9s %9s %9s\n", "nodes", "IPC", "L1d/node", "LLC/node");
+    print_row(f, "whole run", &run_total);
+
+    sort_key = available[PERF_CYCLES] ? PERF_CYCLES : -1;
+    qsort(entries, (size_t)entry_count, sizeof(PerfEntry), by_key);
+    /* entries moved: rebuild the hash chains */
+    for (int i = 0; i < PERF_BUCKETS; i++) buckets[i] = -1;
+    for (int i = 0; i < entry_count; i++) {
+        unsigned b = hash_key(entries[i].label, entries[i].line);
+        entries[i].next = buckets[b];
+        buckets[b] = i;
+    }
+    int shown = entry_count < 20 ? entry_count : 20;
+    for (int i = 0; i < shown; i++) {
+        char name[128];
+        const PerfEntry *e = &entries[i];
+        if (e->label[0]) snprintf(name, sizeof(name), "%s", e->label);
+        else             snprintf(name, sizeof(name), "line %d", e->line);
+        if (e->runs > 1) {
+            size_t n = strlen(name);
+            snprintf(name + n, sizeof(name) - n, " (x%lld)", e->runs);
+        }
+        print_row(f, name, &e->total);
+    }
+    if (shown < entry_count) fprintf(f, "(%d more)\n", entry_count - shown);
+}
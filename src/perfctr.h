@@ -0,0 +1,43 @@
+#ifndef PERFCTR_H
+#define PERFCTR_H
+
+#include <stdio.h>
+
+/* Hardware performance counters.
+ *
+ * With counters open, cycles, instructions, branch misses, L1d and LLC read
+ * misses and page faults of the calling thread are counted (user space only)
+ * over the whole run and attributed to each top-level statement and module
+ * load, alongside the number of AST nodes evaluated, so the report can show
+ * IPC and misses per node.  Counters the kernel or the machine does not offer
+ * (common in VMs and containers) are reported as n/a; the rest still work. */
+
+enum {
+    PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_PAGE_FAULTS,
+    PERF_COUNTER_COUNT
+};
+
+typedef struct {
+    long long v[PERF_COUNTER_COUNT];   /* scaled for multiplexing */
+    long long nodes;                   /* AST nodes evaluated */
+} PerfSample;
+
+extern int perfctr_active;
+extern _Thread_local long long perfctr_nodes;
+
+/* Count one evaluated AST node. */
+static inline void perfctr_node(void) {
+    if (perfctr_active) perfctr_nodes++;
+}
+
+int  perfctr_start(void);   /* open the counters; number available, -1 if none */
+void perfctr_stop(void);    /* end the whole-run measurement and close the counters */
+
+void perfctr_read(PerfSample *s);
+/* Charge the counts since *start to the statement or module named label. */
+void perfctr_attribute(const char *label, int line, const PerfSample *start);
+
+void perfctr_report(FILE *f);
+
+#endif /* PERFCTR_H */
@@ -0,0 +1,34 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/* USDT static tracepoints (provider "lang").
+ *
+ * Built on <sys/sdt.h> when the build finds it (HAVE_SYS_SDT_H): each probe is
+ * a single NOP plus an ELF note until a tracer attaches, so production
+ * interpreters can be observed without restarting them, e.g.
+ *
+ *     bpftrace -e 'usdt:./interpreter:lang:fn__entry { @[str(arg0)] = count(); }'
+ *     perf probe -x ./interpreter sdt_lang:value__alloc
+ *
+ * Without the header (or with LANG_NO_PROBES) the probes compile to nothing.
+ *
+ *   fn__entry(name, line)              fn__return(name, line, failed)
+ *   value__alloc(value, type)          value__free(value, type)
+ *   env__new(env, parent)
+ *   module__load__start(path)          module__load__done(path, module)
+ *   error(message)                     runtime error ending a run */
+
+#if defined(HAVE_SYS_SDT_H) && !defined(LANG_NO_PROBES)
+#include <sys/sdt.h>
+#define LANG_PROBES 1
+#define LANG_PROBE1(name, a)       DTRACE_PROBE1(lang, name, a)
+#define LANG_PROBE2(name, a, b)    DTRACE_PROBE2(lang, name, a, b)
+#define LANG_PROBE3(name, a, b, c) DTRACE_PROBE3(lang, name, a, b, c)
+#else
+#define LANG_PROBES 0
+#define LANG_PROBE1(name, a)       do { } while (0)
+#define LANG_PROBE2(name, a, b)    do { } while (0)
+#define LANG_PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+#endif /* PROBES_H */
@@ -0,0 +1,188 @@
+#define _XOPEN_SOURCE 700
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+volatile sig_atomic_t  prof_active;
+_Thread_local ProfStack prof_stack;
+
+/* ------------------------------------------------------------------ ring buffer */
+
+/* Multi-producer (signal handlers, possibly on several threads), single-consumer
+   ring.  A producer claims a slot by advancing head with a CAS, fills it and
+   sets ready; the consumer takes slots in order and stops at the first one
+   still being filled.  Nothing here blocks, so it is safe in a handler. */
+
+#define RING_SIZE 512   /* samples; drained once half full */
+
+typedef struct {
+    atomic_int ready;
+    int        depth;
+    ProfFrame  frames[PROF_MAX_DEPTH];
+} Sample;
+
+static Sample       ring[RING_SIZE];
+static atomic_uint  ring_head, ring_tail;
+static atomic_uint  dropped;
+static atomic_flag  draining = ATOMIC_FLAG_INIT;
+
+static void on_sigprof(int sig) {
+    (void)sig;
+    int depth = prof_stack.depth;
+    if (depth <= 0) return;   /* thread is not running a script */
+    atomic_signal_fence(memory_order_acquire);
+
+    unsigned head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    do {
+        if (head - atomic_load_explicit(&ring_tail, memory_order_acquire) >= RING_SIZE) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&ring_head, &head, head + 1,
+                                                    memory_order_acq_rel, memory_order_relaxed));
+
+    Sample *s = &ring[head % RING_SIZE];
+    int n = depth < PROF_MAX_DEPTH ? depth : PROF_MAX_DEPTH;
+    s->depth = depth;
+    memcpy(s->frames, prof_stack.frames, sizeof(ProfFrame) * (size_t)n);
+    atomic_store_explicit(&s->ready, 1, memory_order_release);
+}
+
+/* ------------------------------------------------------------------ aggregation */
+
+/* Collapsed stack -> sample count.  Uses plain malloc so the profiler's own
+   bookkeeping is not charged to the interpreter being profiled. */
+typedef struct {
+    char     *key;
+    unsigned  hash;
+    long long count;
+} StackCount;
+
+static StackCount *table;
+static int         table_count, table_cap;
+static long long   total_samples;
+
+static unsigned hash_str(const char *s) {
+    unsigned h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static void table_grow(void) {
+    int old_cap = table_cap;
+    StackCount *old = table;
+    table_cap = table_cap ? table_cap * 2 : 256;
+    table = calloc((size_t)table_cap, sizeof(StackCount));
+    for (int i = 0; i < old_cap; i++) {
+        if (!old[i].key) continue;
+        int j = (int)(old[i].hash & (unsigned)(table_cap - 1));
+        while (table[j].key) j = (j + 1) & (table_cap - 1);
+        table[j] = old[i];
+    }
+    free(old);
+}
+
+static void table_add(char *key) {
+    if ((table_count + 1) * 2 > table_cap) table_grow();
+    unsigned h = hash_str(key);
+    int j = (int)(h & (unsigned)(table_cap - 1));
+    while (table[j].key) {
+        if (table[j].hash == h && strcmp(table[j].key, key) == 0) {
+            table[j].count++;
+            free(key);
+            return;
+        }
+        j = (j + 1) & (table_cap - 1);
+    }
+    table[j].key   = key;
+    table[j].hash  = h;
+    table[j].count = 1;
+    table_count++;
+}
+
+/* "main:3;outer:12;bump:8", outermost frame first */
+static char *collapse(const Sample *s) {
+    int n = s->depth < PROF_MAX_DEPTH ? s->depth : PROF_MAX_DEPTH;
+    size_t len = 16;
+    for (int i = 0; i < n; i++) len += strlen(s->frames[i].name) + 14;
+    char *key = malloc(len);
+    size_t off = 0;
+    for (int i = 0; i < n; i++)
+        off += (size_t)snprintf(key + off, len - off, "%s%s:%d", i ? ";" : "",
+                                s->frames[i].name, s->frames[i].line);
+    if (s->depth > PROF_MAX_DEPTH) snprintf(key + off, len - off, ";[truncated]");
+    return key;
+}
+
+void prof_drain(void) {
+    if (atomic_flag_test_and_set(&draining)) return;
+    unsigned tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    for (;;) {
+        Sample *s = &ring[tail % RING_SIZE];
+        if (!atomic_load_explicit(&s->ready, memory_order_acquire)) break;
+        table_add(collapse(s));
+        total_samples++;
+        atomic_store_explicit(&s->ready, 0, memory_order_relaxed);
+        atomic_store_explicit(&ring_tail, ++tail, memory_order_release);
+    }
+    atomic_flag_clear(&draining);
+}
+
+void prof_set_line(int line) {
+    int d = prof_stack.depth;
+    if (d > 0 && d <= PROF_MAX_DEPTH) prof_stack.frames[d - 1].line = line;
+    if (atomic_load_explicit(&ring_head, memory_order_relaxed)
+        - atomic_load_explicit(&ring_tail, memory_order_relaxed) >= RING_SIZE / 2)
+        prof_drain();
+}
+
+/* ------------------------------------------------------------------ control */
+
+int prof_start(int hz) {
+    if (hz <= 0) hz = PROF_DEFAULT_HZ;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigprof;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) != 0) return -1;
+
+    struct itimerval it;
+    it.it_interval.tv_sec  = 0;
+    it.it_interval.tv_usec = 1000000 / hz;
+    if (it.it_interval.tv_usec == 0) it.it_interval.tv_usec = 1;
+    it.it_value = it.it_interval;
+    prof_active = 1;
+    if (setitimer(ITIMER_PROF, &it, NULL) != 0) { prof_active = 0; return -1; }
+    return 0;
+}
+
+void prof_stop(void) {
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, NULL);
+    signal(SIGPROF, SIG_IGN);
+    prof_active = 0;
+    prof_drain();
+}
+
+int prof_write_collapsed(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) { perror(path); return -1; }
+    for (int i = 0; i < table_cap; i++)
+        if (table[i].key) fprintf(f, "%s %lld\n", table[i].key, table[i].count);
+    fclose(f);
+
+    unsigned lost = atomic_load(&dropped);
+    if (lost) fprintf(stderr, "profile: %u samples dropped (ring buffer full)\n", lost);
+
+    int n = (int)total_samples;
+    for (int i = 0; i < table_cap; i++) free(table[i].key);
+    free(table);
+    table = NULL;
+    table_count = table_cap = 0;
+    total_samples = 0;
+    return n;
+}
@@ -0,0 +1,63 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <signal.h>
+#include <stdatomic.h>
+
+/* Sampling profiler.
+ *
+ * While profiling is on, eval_fn_call maintains a shadow stack of the script
+ * functions being executed and statement boundaries record the current line in
+ * the innermost frame.  A SIGPROF timer interrupts the program at a fixed rate;
+ * the handler copies the shadow stack of the interrupted thread into a
+ * lock-free ring buffer.  Samples are drained from the ring at statement
+ * boundaries and aggregated into collapsed stacks ("main:3;outer:12;bump:8 57"),
+ * the input format of flamegraph.pl and speedscope.
+ *
+ * Frame names point into the AST and the builtin table, so samples must be
+ * drained (prof_drain) before the program that produced them is freed;
+ * interp_run does this before returning. */
+
+#define PROF_MAX_DEPTH  128    /* deeper frames are counted but not recorded */
+#define PROF_DEFAULT_HZ 1000
+
+typedef struct {
+    const char *name;
+    int         line;
+} ProfFrame;
+
+typedef struct {
+    ProfFrame             frames[PROF_MAX_DEPTH];
+    volatile sig_atomic_t depth;   /* may exceed PROF_MAX_DEPTH */
+} ProfStack;
+
+extern volatile sig_atomic_t  prof_active;
+extern _Thread_local ProfStack prof_stack;
+
+int  prof_start(int hz);                      /* 0 on success */
+void prof_stop(void);
+void prof_drain(void);                        /* move pending samples into the aggregate */
+int  prof_write_collapsed(const char *path);  /* returns number of samples written, -1 on error */
+void prof_set_line(int line);                 /* out-of-line part of prof_line */
+
+/* Enter a frame; name must outlive the next prof_drain. */
+static inline void prof_push(const char *name, int line) {
+    int d = prof_stack.depth;
+    if (d < PROF_MAX_DEPTH) {
+        prof_stack.frames[d].name = name;
+        prof_stack.frames[d].line = line;
+    }
+    atomic_signal_fence(memory_order_release);   /* the handler must see a filled-in frame */
+    prof_stack.depth = d + 1;
+}
+
+static inline void prof_pop(void) {
+    prof_stack.depth = prof_stack.depth - 1;
+}
+
+/* Record the line being executed in the innermost frame. */
+static inline void prof_line(int line) {
+    if (prof_active) prof_set_line(line);
+}
+
+#endif /* PROFILE_H */
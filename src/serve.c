@@ -0,0 +1,375 @@
+#define _GNU_SOURCE
+#include "serve.h"
+#include "lexer.h"
+#include "parser.h"
+#include "mem.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_REQUEST (16u << 20)
+#define MAX_CALL_ARGS 64
+
+/* ------------------------------------------------------------------ buffers */
+
+typedef struct {
+    char  *data;
+    size_t len, cap;
+} Buf;
+
+static int buf_reserve(Buf *b, size_t more) {
+    if (b->len + more + 1 <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + more + 1) cap *= 2;
+    char *d = realloc(b->data, cap);
+    if (!d) return -1;
+    b->data = d;
+    b->cap = cap;
+    return 0;
+}
+
+static int buf_add(Buf *b, const void *p, size_t n) {
+    if (buf_reserve(b, n) != 0) return -1;
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+    return 0;
+}
+
+/* Read fd to EOF; -1 on error or a request over MAX_REQUEST. */
+static int read_all(int fd, Buf *b) {
+    for (;;) {
+        if (buf_reserve(b, 4096) != 0) return -1;
+        ssize_t n = read(fd, b->data + b->len, b->cap - b->len - 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        b->len += (size_t)n;
+        if (b->len > MAX_REQUEST) return -1;
+    }
+    if (buf_reserve(b, 0) != 0) return -1;
+    b->data[b->len] = '\0';
+    return 0;
+}
+
+static int write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------ requests */
+
+/* Trees of the requests a worker has run outside an arena.  Functions a
+   request defines point into its tree and may have been stored in the global
+   environment, so trees live as long as the worker. */
+static AstNode **kept;
+static int       kept_count, kept_cap;
+
+static void keep(AstNode *ast) {
+    if (kept_count >= kept_cap) {
+        kept_cap = kept_cap ? kept_cap * 2 : 64;
+        kept = realloc(kept, sizeof(AstNode *) * (size_t)kept_cap);
+    }
+    kept[kept_count++] = ast;
+}
+
+/* Parse src; NULL with the message in err on a syntax error. */
+static AstNode *parse_source(const char *src, char *err, size_t err_size) {
+    Lexer lex;
+    lexer_init(&lex, src);
+    Parser parser;
+    parser_init(&parser, &lex);
+    AstNode *program = parse_program(&parser);
+    token_free(&parser.cur);
+    if (parser.had_error) {
+        snprintf(err, err_size, "%s", parser.error_msg);
+        ast_free(program);
+        return NULL;
+    }
+    return program;
+}
+
+/* Run src in a scope of its own; NULL with the message in err on failure. */
+static Value *run_script(Interpreter *interp, const char *src, char *err, size_t err_size) {
+    AstNode *ast = parse_source(src, err, err_size);
+    if (!ast) return NULL;
+    if (!mem_arena_current()) keep(ast);
+    Env *scope = env_new(interp->global);
+    Value *v = interp_run_in(interp, ast, scope);
+    env_decref(scope);
+    if (interp->had_error) {
+        snprintf(err, err_size, "%s", interp->error_msg);
+        interp->had_error = 0;
+    }
+    return v;
+}
+
+static Value *run_call(Interpreter *interp, const char *name, char *body, char *err, size_t err_size) {
+    Value *fn = env_get(interp->global, name);
+    if (!fn || (fn->type != VAL_FUNCTION && fn->type != VAL_BUILTIN_FN && fn->type != VAL_SCOPE)) {
+        snprintf(err, err_size, "no function named '%s'", name);
+        return NULL;
+    }
+    value_incref(fn);
+
+    Value *args[MAX_CALL_ARGS];
+    int argc = 0;
+    Value *result = NULL;
+    char *line = body;
+    while (line && *line) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        if (*line) {
+            if (argc == MAX_CALL_ARGS) {
+                snprintf(err, err_size, "more than %d arguments", MAX_CALL_ARGS);
+                goto done;
+            }
+            Value *arg = run_script(interp, line, err, err_size);
+            if (!arg) {
+                if (!err[0]) snprintf(err, err_size, "argument %d has no value", argc + 1);
+                goto done;
+            }
+            args[argc++] = arg;
+        }
+        line = next;
+    }
+    result = interp_call_value(interp, fn, args, argc);
+    if (interp->had_error) {
+        snprintf(err, err_size, "%s", interp->error_msg);
+        interp->had_error = 0;
+    }
+done:
+    for (int i = 0; i < argc; i++) value_decref(args[i]);
+    value_decref(fn);
+    return result;
+}
+
+/* Handle the request on fd, with whatever it prints captured in cap_fd. */
+static void handle(Interpreter *interp, int fd, int cap_fd) {
+    Buf req = { 0 }, reply = { 0 };
+    char err[300] = "";
+    Value *result = NULL;
+
+    if (read_all(fd, &req) != 0) {
+        snprintf(err, sizeof(err), "request could not be read (at most %u bytes)", MAX_REQUEST);
+        req.len = 0;
+    }
+
+    int saved = -1;
+    if (req.len) {
+        fflush(stdout);
+        saved = dup(STDOUT_FILENO);
+        if (ftruncate(cap_fd, 0) != 0 || lseek(cap_fd, 0, SEEK_SET) != 0 || saved < 0 ||
+            dup2(cap_fd, STDOUT_FILENO) < 0) {
+            snprintf(err, sizeof(err), "cannot capture output: %s", strerror(errno));
+            req.len = 0;
+        }
+    }
+    if (req.len) {
+        char *body = strchr(req.data, '\n');
+        if (body) *body++ = '\0';
+        else body = req.data + req.len;
+        if (strcmp(req.data, "run") == 0)
+            result = run_script(interp, body, err, sizeof(err));
+        else if (strncmp(req.data, "call ", 5) == 0)
+            result = run_call(interp, req.data + 5, body, err, sizeof(err));
+        else
+            snprintf(err, sizeof(err), "unknown request '%.32s'", req.data);
+    }
+
+    size_t out_len = 0;
+    if (saved >= 0) {
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        off_t end = lseek(cap_fd, 0, SEEK_CUR);
+        out_len = end > 0 ? (size_t)end : 0;
+    }
+
+    char head[64];
+    int ok = err[0] == '\0';
+    snprintf(head, sizeof(head), "%s %zu\n", ok ? "OK" : "ERR", out_len);
+    buf_add(&reply, head, strlen(head));
+    if (out_len && buf_reserve(&reply, out_len) == 0 &&
+        pread(cap_fd, reply.data + reply.len, out_len, 0) == (ssize_t)out_len)
+        reply.len += out_len;
+    if (!ok) {
+        buf_add(&reply, err, strlen(err));
+        buf_add(&reply, "\n", 1);
+    } else if (result && result->type != VAL_NULL) {
+        char *s = value_to_string(result);
+        buf_add(&reply, s, strlen(s));
+        buf_add(&reply, "\n", 1);
+        mem_free(s);
+    }
+    if (reply.data) write_all(fd, reply.data, reply.len);
+
+    value_decref(result);
+    free(req.data);
+    free(reply.data);
+}
+
+/* ------------------------------------------------------------------ processes */
+
+static volatile sig_atomic_t stopping;
+
+static void on_stop(int sig) { (void)sig; stopping = 1; }
+static void on_child(int sig) { (void)sig; }
+
+/* With opt->arena, each request runs in an arena reset once its reply is
+   out: its tree, scope and values go in one step, and with them its charge
+   against the worker's memory limit.  What it assigns to the prelude's globals
+   is copied out of the arena (functions become null), and modules it imports
+   are loaded outside it, so both stay for the worker's later requests. */
+static void worker(Interpreter *interp, int listen_fd, const ServeOptions *opt) {
+    FILE *cap = tmpfile();
+    if (!cap) { perror("serve: tmpfile"); _exit(1); }
+    MemArena *arena = NULL;
+    if (opt->arena) {
+        arena = mem_arena_new(0);
+        if (!arena) { perror("serve: arena"); _exit(1); }
+        mem_arena_set_owner(arena, &interp->mem);
+    }
+    int max_requests = opt->max_requests;
+    for (int served = 0; !max_requests || served < max_requests; served++) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) { served--; continue; }
+            perror("serve: accept");
+            _exit(1);
+        }
+        mem_arena_enter(arena);
+        handle(interp, fd, fileno(cap));
+        mem_arena_enter(NULL);
+        if (arena) mem_arena_reset(arena);
+        close(fd);
+    }
+    /* the interpreter is dropped with the process */
+    _exit(0);
+}
+
+static pid_t spawn(Interpreter *interp, int listen_fd, const ServeOptions *opt, const sigset_t *mask) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) perror("serve: fork");
+    if (pid != 0) return pid;
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    sigprocmask(SIG_SETMASK, mask, NULL);
+    worker(interp, listen_fd, opt);
+    return 0;
+}
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "serve: socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    /* a socket left behind by a server that did not shut down cleanly */
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { perror("serve: socket"); return -1; }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+        fprintf(stderr, "serve: %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return NULL; }
+    Buf b = { 0 };
+    int ok = read_all(fileno(f), &b) == 0;
+    fclose(f);
+    if (!ok) { fprintf(stderr, "%s: cannot read\n", path); free(b.data); return NULL; }
+    return b.data ? b.data : calloc(1, 1);
+}
+
+int serve(Interpreter *interp, const char *prelude, const ServeOptions *opt) {
+    /* the prelude's tree stays alive: the workers' functions point into it */
+    if (prelude) {
+        char *src = read_file(prelude);
+        if (!src) return 1;
+        char err[300];
+        AstNode *ast = parse_source(src, err, sizeof(err));
+        free(src);
+        if (!ast) { fprintf(stderr, "%s: %s\n", prelude, err); return 1; }
+        interp_run(interp, ast);
+        if (interp->had_error) {
+            fprintf(stderr, "%s\n", interp->error_msg);
+            return 1;
+        }
+    }
+
+    int listen_fd = listen_on(opt->socket_path);
+    if (listen_fd < 0) return 1;
+
+    /* SIGCHLD, SIGINT and SIGTERM are only taken in sigsuspend below, so none
+       is lost between reaping workers and waiting */
+    sigset_t block, orig;
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigprocmask(SIG_BLOCK, &block, &orig);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = on_child;
+    sigaction(SIGCHLD, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);   /* a client that hangs up early only loses its reply */
+
+    int workers = opt->workers > 0 ? opt->workers : SERVE_DEFAULT_WORKERS;
+    pid_t *pids = calloc((size_t)workers, sizeof(pid_t));
+    for (int i = 0; i < workers; i++) pids[i] = spawn(interp, listen_fd, opt, &orig);
+    fprintf(stderr, "serving on %s with %d workers\n", opt->socket_path, workers);
+
+    while (!stopping) {
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            if (WIFSIGNALED(status))
+                fprintf(stderr, "serve: worker %d killed by signal %d\n", (int)pid, WTERMSIG(status));
+            for (int i = 0; i < workers; i++) {
+                if (pids[i] != pid) continue;
+                pids[i] = stopping ? 0 : spawn(interp, listen_fd, opt, &orig);
+                break;
+            }
+        }
+        if (!stopping) sigsuspend(&orig);
+    }
+
+    for (int i = 0; i < workers; i++) if (pids[i] > 0) kill(pids[i], SIGTERM);
+    for (int i = 0; i < workers; i++) if (pids[i] > 0) waitpid(pids[i], NULL, 0);
+    free(pids);
+    close(listen_fd);
+    unlink(opt->socket_path);
+    sigprocmask(SIG_SETMASK, &orig, NULL);
+    fprintf(stderr, "server stopped\n");
+    return 0;
+}
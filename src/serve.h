@@ -0,0 +1,39 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+/* Pre-forking server (--serve).
+ *
+ * The prelude script is parsed and run once; the process then listens on a
+ * Unix socket and forks workers that inherit the warmed-up interpreter (global
+ * environment, prelude definitions and their syntax trees) copy-on-write, so
+ * a request pays for neither startup nor the prelude.  One request per
+ * connection: the client writes it, shuts down its side and reads the reply.
+ *
+ *     run\n<script>                 run script in a scope of its own
+ *     call <name>\n<arg>\n...       call global function name; one expression per arg
+ *
+ *     OK <n>\n<n bytes of output><result>\n     result: the value, unless null
+ *     ERR <n>\n<n bytes of output><message>\n
+ *
+ * Output is what the request printed.  A worker exits after max_requests
+ * requests (0 = never) and is replaced; anything a request leaves in the
+ * global environment lasts until then.  With arena set, each request runs in
+ * an arena reset once it is answered (see worker() in serve.c).  SIGINT or
+ * SIGTERM stop the server and remove the socket. */
+
+#include "interpreter.h"
+
+#define SERVE_DEFAULT_WORKERS      4
+#define SERVE_DEFAULT_MAX_REQUESTS 1000
+
+typedef struct {
+    const char *socket_path;
+    int         workers;
+    int         max_requests;   /* per worker; 0 = unlimited */
+    int         arena;          /* run each request in an arena (--arena) */
+} ServeOptions;
+
+/* Serve until stopped; returns the exit status.  prelude may be NULL. */
+int serve(Interpreter *interp, const char *prelude, const ServeOptions *opt);
+
+#endif /* SERVE_H */
@@ -0,0 +1,79 @@
+#include "stats.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+_Thread_local RuntimeStats *stats_current;
+
+typedef struct ThreadStats {
+    RuntimeStats        stats;
+    struct ThreadStats *next;
+} ThreadStats;
+
+static int per_thread;
+static _Thread_local ThreadStats *thread_stats;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadStats    *threads_head, **threads_tail = &threads_head;
+
+void stats_set_per_thread(int on) { per_thread = on; }
+int  stats_per_thread(void)       { return per_thread; }
+
+RuntimeStats *stats_thread(void) {
+    if (!thread_stats) {
+        ThreadStats *t = calloc(1, sizeof(*t));
+        if (!t) return NULL;
+        pthread_mutex_lock(&threads_lock);
+        *threads_tail = t;
+        threads_tail = &t->next;
+        pthread_mutex_unlock(&threads_lock);
+        thread_stats = t;
+    }
+    return &thread_stats->stats;
+}
+
+void stats_print_threads(FILE *f) {
+    pthread_mutex_lock(&threads_lock);
+    int n = 0;
+    for (ThreadStats *t = threads_head; t; t = t->next) {
+        fprintf(f, "thread %d:\n", ++n);
+        stats_print(&t->stats, f);
+    }
+    pthread_mutex_unlock(&threads_lock);
+}
+
+void stats_add(RuntimeStats *into, const RuntimeStats *from) {
+    for (int t = 0; t < VAL_TYPE_COUNT; t++) into->value_allocs[t] += from->value_allocs[t];
+    into->env_new       += from->env_new;
+    into->env_get       += from->env_get;
+    into->env_get_depth += from->env_get_depth;
+    into->increfs       += from->increfs;
+    into->decrefs       += from->decrefs;
+    into->string_bytes  += from->string_bytes;
+    /* a worker's peak counts on top of what is live here */
+    if (into->live + from->peak_live > into->peak_live) into->peak_live = into->live + from->peak_live;
+    into->live          += from->live;
+}
+
+const char *stats_type_name(int type) {
+    static const char *names[VAL_TYPE_COUNT] = {
+        "null", "int", "float", "string", "bool", "tuple", "variant", "function",
+        "pat_inst", "scope", "builtin", "optional", "type", "module", "channel",
+        "generator", "range",
+    };
+    return type >= 0 && type < VAL_TYPE_COUNT ? names[type] : "?";
+}
+
+void stats_print(const RuntimeStats *s, FILE *f) {
+    long long total = 0;
+    for (int t = 0; t < VAL_TYPE_COUNT; t++) total += s->value_allocs[t];
+    fprintf(f, "values allocated     %12lld\n", total);
+    for (int t = 0; t < VAL_TYPE_COUNT; t++)
+        if (s->value_allocs[t]) fprintf(f, "  %-18s %12lld\n", stats_type_name(t), s->value_allocs[t]);
+    fprintf(f, "envs created         %12lld\n", s->env_new);
+    fprintf(f, "env_get calls        %12lld\n", s->env_get);
+    fprintf(f, "env_get avg depth    %12.2f\n", s->env_get ? (double)s->env_get_depth / (double)s->env_get : 0.0);
+    fprintf(f, "increfs              %12lld\n", s->increfs);
+    fprintf(f, "decrefs              %12lld\n", s->decrefs);
+    fprintf(f, "string bytes copied  %12lld\n", s->string_bytes);
+    fprintf(f, "live objects         %12lld\n", s->live);
+    fprintf(f, "peak live objects    %12lld\n", s->peak_live);
+}
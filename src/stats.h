@@ -0,0 +1,57 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "value.h"
+#include <stdio.h>
+
+/* Runtime counters.
+ *
+ * Cheap event counts from the hot paths of the runtime (allocation, variable
+ * lookup, reference counting), used to see where a script spends its work and
+ * to confirm that an optimization changed what it was meant to.  Counting
+ * goes to the RuntimeStats current on the calling thread: an interpreter's own
+ * counters once interp_enable_stats() is on, or a per-thread block in
+ * per-thread mode.  With nothing current every hook is one thread-local load
+ * and a branch. */
+
+#define VAL_TYPE_COUNT (VAL_RANGE + 1)
+
+typedef struct RuntimeStats {
+    long long value_allocs[VAL_TYPE_COUNT];  /* values created, by ValueType */
+    long long env_new;                       /* environments created */
+    long long env_get;                       /* variable reads */
+    long long env_get_depth;                 /* scopes walked by those reads */
+    long long increfs, decrefs;              /* value reference count operations */
+    long long string_bytes;                  /* bytes copied into string values */
+    long long live;                          /* values + environments alive now */
+    long long peak_live;                     /* high-water mark of live */
+} RuntimeStats;
+
+extern _Thread_local RuntimeStats *stats_current;
+
+#define STAT_ADD(field, n) do { RuntimeStats *s_ = stats_current; if (s_) s_->field += (n); } while (0)
+#define STAT_INC(field)    STAT_ADD(field, 1)
+
+static inline void stat_born(void) {
+    RuntimeStats *s = stats_current;
+    if (s && ++s->live > s->peak_live) s->peak_live = s->live;
+}
+
+static inline void stat_died(void) { STAT_ADD(live, -1); }
+
+/* Per-thread mode (--stats=per-thread): counters of every interpreter running
+   on a thread go to that thread's own block instead of the interpreter's.
+   Blocks are numbered in the order threads first count, and outlive their
+   threads so stats_print_threads can report them at exit. */
+void          stats_set_per_thread(int on);
+int           stats_per_thread(void);
+RuntimeStats *stats_thread(void);   /* NULL if it cannot be allocated */
+void          stats_print_threads(FILE *f);
+
+/* Fold the counters of from (a parallel loop's worker) into into. */
+void stats_add(RuntimeStats *into, const RuntimeStats *from);
+
+const char *stats_type_name(int type);
+void        stats_print(const RuntimeStats *s, FILE *f);
+
+#endif /* STATS_H */
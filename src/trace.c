@@ -0,0 +1,109 @@
+#define _POSIX_C_SOURCE 200809L
+#include "trace.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+int       trace_active;
+int       trace_calls;
+long long trace_call_min_ns = -1;
+
+#define TRACE_BUF_SIZE (64 * 1024)
+
+static FILE       *out;
+static char        buf[TRACE_BUF_SIZE];
+static size_t      buf_len;
+static long long   origin_ns;
+static int         pid;
+static int         events;
+static atomic_flag lock = ATOMIC_FLAG_INIT;
+static atomic_int  next_tid = 1;
+static _Thread_local int tid;
+
+long long trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void flush(void) {
+    if (buf_len) fwrite(buf, 1, buf_len, out);
+    buf_len = 0;
+}
+
+static void append(const char *s, size_t n) {
+    if (buf_len + n > sizeof(buf)) flush();
+    if (n > sizeof(buf)) { fwrite(s, 1, n, out); return; }
+    memcpy(buf + buf_len, s, n);
+    buf_len += n;
+}
+
+/* Append s as the contents of a JSON string literal. */
+static size_t escape(char *dst, size_t cap, const char *s) {
+    size_t n = 0;
+    for (; *s && n + 7 < cap; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') { dst[n++] = '\\'; dst[n++] = (char)c; }
+        else if (c < 0x20) n += (size_t)snprintf(dst + n, cap - n, "\\u%04x", c);
+        else dst[n++] = (char)c;
+    }
+    dst[n] = '\0';
+    return n;
+}
+
+int trace_open(const char *path) {
+    out = fopen(path, "w");
+    if (!out) { perror(path); return -1; }
+    origin_ns = trace_now();
+    pid = (int)getpid();
+    events = 0;
+    buf_len = 0;
+    static const char head[] = "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    append(head, sizeof(head) - 1);
+    trace_active = 1;
+    trace_calls  = trace_call_min_ns >= 0;
+    return 0;
+}
+
+void trace_close(void) {
+    if (!out) return;
+    trace_active = 0;
+    trace_calls  = 0;
+    static const char tail[] = "\n]}\n";
+    append(tail, sizeof(tail) - 1);
+    flush();
+    fclose(out);
+    out = NULL;
+}
+
+void trace_span(const char *name, const char *cat, long long start_ns, const char *detail) {
+    long long end_ns = trace_now();
+    if (!tid) tid = atomic_fetch_add(&next_tid, 1);
+
+    char ename[256], edetail[512], line[1024];
+    escape(ename, sizeof(ename), name);
+    int n = snprintf(line, sizeof(line),
+                     "\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d,"
+                     " \"ts\": %.3f, \"dur\": %.3f",
+                     ename, cat, pid, tid,
+                     (start_ns - origin_ns) / 1000.0, (end_ns - start_ns) / 1000.0);
+    if (detail) {
+        escape(edetail, sizeof(edetail), detail);
+        n += snprintf(line + n, sizeof(line) - (size_t)n, ", \"args\": {\"detail\": \"%s\"}", edetail);
+    }
+    n += snprintf(line + n, sizeof(line) - (size_t)n, "}");
+    if (n >= (int)sizeof(line)) n = (int)sizeof(line) - 1;
+
+    while (atomic_flag_test_and_set_explicit(&lock, memory_order_acquire)) ;
+    if (out) {
+        if (events++) append(",", 1);
+        append(line, (size_t)n);
+    }
+    atomic_flag_clear_explicit(&lock, memory_order_release);
+}
+
+void trace_call(const char *name, long long start_ns) {
+    if (trace_now() - start_ns >= trace_call_min_ns) trace_span(name, "call", start_ns, NULL);
+}
@@ -0,0 +1,29 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Chrome trace-event output.
+ *
+ * With a trace file open, parsing, module loading, top-level statements and
+ * (optionally) function calls that run longer than a threshold are written as
+ * complete ("ph":"X") events, loadable in chrome://tracing or Perfetto.  Events
+ * go through a private buffer that is written out in large blocks, so a span
+ * costs two clock reads and a formatted append. */
+
+extern int       trace_active;
+extern int       trace_calls;         /* call spans wanted: trace open and trace_call_min_ns >= 0 */
+extern long long trace_call_min_ns;   /* calls shorter than this are not traced; < 0 = no call spans;
+                                         set before trace_open */
+
+int  trace_open(const char *path);    /* 0 on success */
+void trace_close(void);               /* finish the JSON and close the file */
+
+long long trace_now(void);            /* monotonic nanoseconds, for span start times */
+
+/* Write a span that started at start_ns and ends now.  detail, if not NULL,
+   is recorded as args.detail. */
+void trace_span(const char *name, const char *cat, long long start_ns, const char *detail);
+
+/* Span for a call that started at start_ns, if it ran at least trace_call_min_ns. */
+void trace_call(const char *name, long long start_ns);
+
+#endif /* TRACE_H */
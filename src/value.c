@@ -1,6 +1,14 @@
 #define _POSIX_C_SOURCE 200809L
 #include "value.h"
 #include "interpreter.h"  /* for Env definition */
+#include "gc.h"
+#include "mem.h"
+#include "stats.h"
+#include "probes.h"
+#include "actor.h"
+#include "generator.h"
+#include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -8,34 +16,37 @@
 /* ------------------------------------------------------------------ PatDef */
 
 PatDef *patdef_new(const char *name, int field_count) {
-    PatDef *p = calloc(1, sizeof(PatDef));
-    p->name = strdup(name);
+    PatDef *p = mem_calloc(1, sizeof(PatDef));
+    p->name = mem_strdup(name);
     p->field_count = field_count;
-    p->field_names = calloc((size_t)field_count, sizeof(char *));
+    p->field_names = mem_calloc((size_t)field_count, sizeof(char *));
     p->ref_count = 1;
     return p;
 }
 
-void patdef_incref(PatDef *p) { if (p) p->ref_count++; }
+void patdef_incref(PatDef *p) { if (p && !p->pinned) p->ref_count++; }
 
 void patdef_decref(PatDef *p) {
-    if (!p) return;
+    if (!p || p->pinned) return;
     p->ref_count--;
     if (p->ref_count <= 0) {
-        free(p->name);
-        for (int i = 0; i < p->field_count; i++) free(p->field_names[i]);
-        free(p->field_names);
+        mem_free(p->name);
+        for (int i = 0; i < p->field_count; i++) mem_free(p->field_names[i]);
+        mem_free(p->field_names);
         if (p->methods) env_decref(p->methods);
-        free(p);
+        mem_free(p);
     }
 }
 
 /* ------------------------------------------------------------------ Value allocation */
 
 static Value *value_alloc(ValueType t) {
-    Value *v = calloc(1, sizeof(Value));
+    Value *v = mem_calloc(1, sizeof(Value));
     v->type = t;
     v->ref_count = 1;
+    STAT_INC(value_allocs[t]);
+    stat_born();
+    LANG_PROBE2(value__alloc, v, (int)t);
     return v;
 }
 
@@ -46,15 +57,17 @@ Value *value_new_bool(int b)          { Value *v = value_alloc(VAL_BOOL);  v->bo
 
 Value *value_new_string(const char *s) {
     Value *v = value_alloc(VAL_STRING);
-    v->str_val = strdup(s ? s : "");
+    v->str_val = mem_strdup(s ? s : "");
+    STAT_ADD(string_bytes, (long long)strlen(v->str_val) + 1);
     return v;
 }
 
 Value *value_new_tuple(int count) {
     Value *v = value_alloc(VAL_TUPLE);
     v->tuple.count = count;
-    v->tuple.elems = calloc((size_t)count, sizeof(Value *));
+    v->tuple.elems = mem_calloc((size_t)count, sizeof(Value *));
     v->tuple.names = NULL;
+    gc_track_value(v);
     return v;
 }
 
@@ -62,14 +75,26 @@ Value *value_new_function(AstNode *ast, Env *closure, const char *name) {
     Value *v = value_alloc(VAL_FUNCTION);
     v->fn.ast     = ast;
     v->fn.closure = closure;
-    v->fn.name    = name ? strdup(name) : NULL;
+    v->fn.name    = name ? mem_strdup(name) : NULL;
+    if (closure) env_incref(closure);
+    gc_track_value(v);
     return v;
 }
 
-Value *value_new_builtin(BuiltinFn fn, const char *name) {
+Value *value_new_builtin(BuiltinFn fn, const NativeSig *sig, const char *name) {
     Value *v = value_alloc(VAL_BUILTIN_FN);
     v->builtin.fn   = fn;
-    v->builtin.name = strdup(name);
+    v->builtin.sig  = sig;
+    v->builtin.name = mem_strdup(name);
+    return v;
+}
+
+Value *value_new_native(NativeFn fn, void *ctx, const NativeSig *sig, const char *name) {
+    Value *v = value_alloc(VAL_BUILTIN_FN);
+    v->builtin.native = fn;
+    v->builtin.ctx    = ctx;
+    v->builtin.sig    = sig;
+    v->builtin.name   = mem_strdup(name);
     return v;
 }
 
@@ -77,8 +102,9 @@ Value *value_new_pat_inst(PatDef *def, int field_count) {
     Value *v = value_alloc(VAL_PAT_INST);
     v->pat_inst.def    = def;
     v->pat_inst.count  = field_count;
-    v->pat_inst.fields = calloc((size_t)field_count, sizeof(Value *));
+    v->pat_inst.fields = mem_calloc((size_t)field_count, sizeof(Value *));
     patdef_incref(def);
+    gc_track_value(v);
     return v;
 }
 
@@ -87,32 +113,57 @@ Value *value_new_scope(Env *env, AstNode *ast) {
     v->scope.env = env;
     v->scope.ast = ast;
     if (env) env_incref(env);
+    gc_track_value(v);
     return v;
 }
 
 Value *value_new_module(const char *name, Env *env) {
     Value *v = value_alloc(VAL_MODULE);
-    v->module.name = strdup(name);
+    v->module.name = mem_strdup(name);
     v->module.env  = env;
     if (env) env_incref(env);
+    gc_track_value(v);
     return v;
 }
 
 Value *value_new_type(const char *type_name) {
     Value *v = value_alloc(VAL_TYPE);
-    v->type_val.type_name = strdup(type_name);
+    v->type_val.type_name = mem_strdup(type_name);
     v->type_val.patdef    = NULL;
     return v;
 }
 
 Value *value_new_pat_type(const char *type_name, PatDef *def) {
     Value *v = value_alloc(VAL_TYPE);
-    v->type_val.type_name = strdup(type_name);
+    v->type_val.type_name = mem_strdup(type_name);
     v->type_val.patdef    = def;
     if (def) patdef_incref(def);
     return v;
 }
 
+const char *value_kind_name(ValueType t) {
+    switch (t) {
+        case VAL_NULL:       return "null";
+        case VAL_INT:        return "int";
+        case VAL_FLOAT:      return "float";
+        case VAL_STRING:     return "string";
+        case VAL_BOOL:       return "bool";
+        case VAL_TUPLE:      return "tuple";
+        case VAL_VARIANT:    return "variant";
+        case VAL_FUNCTION:   return "function";
+        case VAL_PAT_INST:   return "pat";
+        case VAL_SCOPE:      return "scope";
+        case VAL_BUILTIN_FN: return "builtin";
+        case VAL_OPTIONAL:   return "optional";
+        case VAL_TYPE:       return "type";
+        case VAL_MODULE:     return "module";
+        case VAL_CHANNEL:    return "channel";
+        case VAL_GENERATOR:  return "generator";
+        case VAL_RANGE:      return "range";
+    }
+    return "?";
+}
+
 /* Return a VAL_TYPE that reflects the runtime type of v. */
 Value *value_type_of(Value *v) {
     if (!v) return value_new_type("null");
@@ -128,6 +179,9 @@ Value *value_type_of(Value *v) {
         case VAL_OPTIONAL:   return value_new_type("optional");
         case VAL_TYPE:       return value_new_type("type");
         case VAL_BUILTIN_FN: return value_new_type("function");
+        case VAL_CHANNEL:    return value_new_type("channel");
+        case VAL_GENERATOR:  return value_new_type("generator");
+        case VAL_RANGE:      return value_new_type("range");
         case VAL_FUNCTION: {
             const char *n = v->fn.name ? v->fn.name : "function";
             return value_new_type(n);
@@ -150,68 +204,172 @@ Value *value_new_optional(Value *val, int present) {
     v->optional.val     = val;
     v->optional.present = present;
     if (val) value_incref(val);
+    gc_track_value(v);
+    return v;
+}
+
+/* Channels belong to no interpreter and never to an arena: every actor that
+   has one may drop the last reference. */
+Value *value_new_channel(Channel *ch) {
+    MemArena *arena = mem_arena_enter(NULL);
+    MemStats *prev = mem_set_current(NULL);
+    Value *v = value_alloc(VAL_CHANNEL);
+    mem_set_current(prev);
+    mem_arena_enter(arena);
+    v->chan = ch;
+    v->shared = 1;
     return v;
 }
 
+Value *value_new_generator(Generator *g) {
+    Value *v = value_alloc(VAL_GENERATOR);
+    v->gen = g;
+    gc_track_value(v);
+    return v;
+}
+
+/* Ranges are immutable and hold nothing, so they are never tracked. */
+Value *value_new_range(long long start, long long step, long long len) {
+    Value *v = value_alloc(VAL_RANGE);
+    v->range.start = start;
+    v->range.step  = step;
+    v->range.len   = len;
+    return v;
+}
+
+/* Hand v over to no interpreter in particular, so that interpreters on other
+   threads can hold references to it too (see actor.h).  v must be immutable
+   and outside any arena. */
+void value_share(Value *v) {
+    if (v->shared) return;
+    gc_untrack_value(v);
+    mem_disown(v);
+    if (v->type == VAL_STRING) mem_disown(v->str_val);
+    v->shared = 1;
+}
+
 /* ------------------------------------------------------------------ Ref counting */
 
-void value_incref(Value *v) { if (v) v->ref_count++; }
+/* Pinned values (see interpreter.c, parallel loops) are shared between
+   threads for a while; their counts are left alone until they are unpinned.
+   Frozen values are not counted at all.  Shared values are counted
+   atomically, and only they are. */
+void value_incref(Value *v) {
+    if (!v || (v->pinned | v->frozen)) return;
+    if (v->shared) __atomic_fetch_add(&v->ref_count, 1, __ATOMIC_RELAXED);
+    else v->ref_count++;
+    STAT_INC(increfs);
+}
 
 void value_decref(Value *v) {
-    if (!v) return;
-    v->ref_count--;
-    if (v->ref_count > 0) return;
+    if (!v || (v->pinned | v->frozen)) return;
+    STAT_INC(decrefs);
+    if (v->shared ? __atomic_sub_fetch(&v->ref_count, 1, __ATOMIC_ACQ_REL) > 0 : --v->ref_count > 0) return;
+    stat_died();
+    LANG_PROBE2(value__free, v, (int)v->type);
+    if (mem_in_arena(v) && !mem_arena_current()) return;   /* discarded with its arena */
+    gc_untrack_value(v);
+    value_clear(v);
+    mem_free(v);
+}
 
+/* Release everything v owns and leave it empty.  Safe to call more than once,
+   which the cycle collector relies on. */
+void value_clear(Value *v) {
     switch (v->type) {
         case VAL_STRING:
-            free(v->str_val);
+            mem_free(v->str_val);
+            v->str_val = NULL;
             break;
-        case VAL_TUPLE:
-            for (int i = 0; i < v->tuple.count; i++) value_decref(v->tuple.elems[i]);
-            free(v->tuple.elems);
-            if (v->tuple.names) {
-                for (int i = 0; i < v->tuple.count; i++) free(v->tuple.names[i]);
-                free(v->tuple.names);
+        case VAL_TUPLE: {
+            Value **elems = v->tuple.elems;
+            char  **names = v->tuple.names;
+            int     count = v->tuple.count;
+            v->tuple.elems = NULL; v->tuple.names = NULL; v->tuple.count = 0;
+            for (int i = 0; i < count; i++) value_decref(elems[i]);
+            mem_free(elems);
+            if (names) {
+                for (int i = 0; i < count; i++) mem_free(names[i]);
+                mem_free(names);
             }
             break;
-        case VAL_VARIANT:
-            value_decref(v->variant.val);
+        }
+        case VAL_VARIANT: {
+            Value *inner = v->variant.val;
+            v->variant.val = NULL;
+            value_decref(inner);
             break;
-        case VAL_FUNCTION:
-            free(v->fn.name);
-            /* ast and closure are borrowed */
+        }
+        case VAL_FUNCTION: {
+            Env        *closure  = v->fn.closure;
+            CaptureSet *captures = v->fn.captures;
+            mem_free(v->fn.name);
+            v->fn.name = NULL; v->fn.closure = NULL; v->fn.captures = NULL;
+            /* ast is borrowed */
+            env_decref(closure);
+            if (captures) {
+                for (int i = 0; i < captures->count; i++) entry_decref(captures->entries[i]);
+                mem_free(captures);
+            }
             break;
-        case VAL_PAT_INST:
-            for (int i = 0; i < v->pat_inst.count; i++) value_decref(v->pat_inst.fields[i]);
-            free(v->pat_inst.fields);
-            patdef_decref(v->pat_inst.def);
+        }
+        case VAL_PAT_INST: {
+            Value **fields = v->pat_inst.fields;
+            int     count  = v->pat_inst.count;
+            PatDef *def    = v->pat_inst.def;
+            v->pat_inst.fields = NULL; v->pat_inst.count = 0; v->pat_inst.def = NULL;
+            for (int i = 0; i < count; i++) value_decref(fields[i]);
+            mem_free(fields);
+            patdef_decref(def);
             break;
+        }
         case VAL_BUILTIN_FN:
-            free(v->builtin.name);
+            mem_free(v->builtin.name);
+            v->builtin.name = NULL;
             break;
-        case VAL_OPTIONAL:
-            value_decref(v->optional.val);
+        case VAL_OPTIONAL: {
+            Value *inner = v->optional.val;
+            v->optional.val = NULL;
+            value_decref(inner);
             break;
+        }
         case VAL_TYPE:
-            free(v->type_val.type_name);
+            mem_free(v->type_val.type_name);
             patdef_decref(v->type_val.patdef); /* patdef_decref handles NULL safely */
+            v->type_val.type_name = NULL; v->type_val.patdef = NULL;
             break;
-        case VAL_MODULE:
-            free(v->module.name);
-            env_decref(v->module.env);
-            patdef_decref(v->module.patdef);
+        case VAL_MODULE: {
+            Env    *env = v->module.env;
+            PatDef *def = v->module.patdef;
+            mem_free(v->module.name);
+            v->module.name = NULL; v->module.env = NULL; v->module.patdef = NULL;
+            env_decref(env);
+            patdef_decref(def);
             break;
-        case VAL_SCOPE:
-            env_decref(v->scope.env);
+        }
+        case VAL_SCOPE: {
+            Env *env = v->scope.env;
+            v->scope.env = NULL;
+            env_decref(env);
+            break;
+        }
+        case VAL_CHANNEL:
+            chan_free(v->chan);
+            v->chan = NULL;
             break;
+        case VAL_GENERATOR: {
+            Generator *g = v->gen;
+            v->gen = NULL;
+            gen_free(g);
+            break;
+        }
         default: break;
     }
-    free(v);
 }
 
-/* Deep copy */
-Value *value_copy(Value *v) {
-    if (!v) return value_new_null();
+/* A fresh copy of a number, string or null; anything else is returned as it
+   is, with a new reference. */
+static Value *copy_scalar(Value *v) {
     switch (v->type) {
         case VAL_NULL:    return value_new_null();
         case VAL_INT:     return value_new_int(v->int_val);
@@ -224,103 +382,470 @@ Value *value_copy(Value *v) {
     }
 }
 
+/* Deep copy */
+Value *value_copy(Value *v) {
+    if (!v) return value_new_null();
+    if (v->shared | v->frozen) {   /* immutable: no need for a copy of our own */
+        value_incref(v);
+        return v;
+    }
+    return copy_scalar(v);
+}
+
+/* Copy of a pattern descriptor without its methods, which live in an Env. */
+static PatDef *patdef_copy(PatDef *p) {
+    if (!p) return NULL;
+    PatDef *d = patdef_new(p->name, p->field_count);
+    d->decl = p->decl;
+    for (int i = 0; i < p->field_count; i++)
+        d->field_names[i] = p->field_names[i] ? mem_strdup(p->field_names[i]) : NULL;
+    return d;
+}
+
+static void send_frozen(Value *v);
+
+/* value_deep_copy, or with share set value_send_copy.  A frozen value lives
+   only as long as the interpreter that froze it, so only a send takes it
+   along by reference, and only a shared one. */
+static Value *copy_tree(Value *v, int share) {
+    if (!v) return value_new_null();
+    if (v->shared && (share || !v->frozen)) {
+        if (v->frozen) send_frozen(v);
+        value_incref(v);
+        return v;
+    }
+    switch (v->type) {
+        case VAL_TUPLE: {
+            Value *c = value_new_tuple(v->tuple.count);
+            for (int i = 0; i < v->tuple.count; i++) c->tuple.elems[i] = copy_tree(v->tuple.elems[i], share);
+            if (v->tuple.names) {
+                c->tuple.names = mem_calloc((size_t)v->tuple.count, sizeof(char *));
+                for (int i = 0; i < v->tuple.count; i++)
+                    if (v->tuple.names[i]) c->tuple.names[i] = mem_strdup(v->tuple.names[i]);
+            }
+            return c;
+        }
+        case VAL_VARIANT: {
+            Value *c = value_alloc(VAL_VARIANT);
+            c->variant.tag = v->variant.tag;
+            c->variant.val = v->variant.val ? copy_tree(v->variant.val, share) : NULL;
+            return c;
+        }
+        case VAL_PAT_INST: {
+            PatDef *def = patdef_copy(v->pat_inst.def);
+            Value *c = value_new_pat_inst(def, v->pat_inst.count);
+            patdef_decref(def);
+            for (int i = 0; i < v->pat_inst.count; i++) c->pat_inst.fields[i] = copy_tree(v->pat_inst.fields[i], share);
+            return c;
+        }
+        case VAL_OPTIONAL: {
+            Value *inner = v->optional.val ? copy_tree(v->optional.val, share) : NULL;
+            Value *c = value_new_optional(inner, v->optional.present);
+            value_decref(inner);
+            return c;
+        }
+        case VAL_TYPE: {
+            PatDef *def = patdef_copy(v->type_val.patdef);
+            Value *c = value_new_pat_type(v->type_val.type_name, def);
+            patdef_decref(def);
+            return c;
+        }
+        case VAL_BUILTIN_FN:
+            if (v->builtin.native)
+                return value_new_native(v->builtin.native, v->builtin.ctx, v->builtin.sig, v->builtin.name);
+            return value_new_builtin(v->builtin.fn, v->builtin.sig, v->builtin.name);
+        case VAL_FUNCTION:
+        case VAL_SCOPE:
+        case VAL_MODULE:
+        case VAL_GENERATOR:
+            return value_new_null();
+        case VAL_CHANNEL:
+            chan_release(v->chan);
+            value_incref(v);
+            return v;
+        case VAL_RANGE:
+            return value_new_range(v->range.start, v->range.step, v->range.len);
+        case VAL_STRING:
+            if (share && !v->frozen && !v->pinned && !mem_in_arena(v)) {
+                value_share(v);
+                value_incref(v);
+                return v;
+            }
+            return copy_scalar(v);
+        default:
+            return copy_scalar(v);
+    }
+}
+
+/* Fully independent copy of v made with the current allocator; used to carry
+   results out of an arena before it is reset.  Functions, scopes, modules and
+   generators are tied to the environment and AST of their run and become
+   null. */
+Value *value_deep_copy(Value *v) {
+    return copy_tree(v, 0);
+}
+
+/* The same for a message to another interpreter: charged to none until the
+   receiver adopts it, and with its strings shared rather than copied. */
+Value *value_send_copy(Value *v) {
+    MemArena *arena = mem_arena_enter(NULL);
+    MemStats *prev = mem_set_current(NULL);
+    Value *c = copy_tree(v, 1);
+    mem_set_current(prev);
+    mem_arena_enter(arena);
+    return c;
+}
+
+static void patdef_adopt(PatDef *p) {
+    if (!p || mem_owner(p)) return;
+    mem_adopt(p);
+    mem_adopt(p->name);
+    mem_adopt(p->field_names);
+    for (int i = 0; i < p->field_count; i++) mem_adopt(p->field_names[i]);
+}
+
+/* Charge a value_send_copy, shared parts aside, to the current interpreter
+   and let its cycle collector track it. */
+void value_adopt(Value *v) {
+    if (!v || v->shared || mem_owner(v)) return;
+    mem_adopt(v);
+    switch (v->type) {
+        case VAL_STRING: mem_adopt(v->str_val); break;
+        case VAL_TUPLE:
+            mem_adopt(v->tuple.elems);
+            mem_adopt(v->tuple.names);
+            for (int i = 0; i < v->tuple.count; i++) {
+                if (v->tuple.names) mem_adopt(v->tuple.names[i]);
+                value_adopt(v->tuple.elems[i]);
+            }
+            gc_track_value(v);
+            break;
+        case VAL_VARIANT: value_adopt(v->variant.val); break;
+        case VAL_PAT_INST:
+            mem_adopt(v->pat_inst.fields);
+            patdef_adopt(v->pat_inst.def);
+            for (int i = 0; i < v->pat_inst.count; i++) value_adopt(v->pat_inst.fields[i]);
+            gc_track_value(v);
+            break;
+        case VAL_OPTIONAL:
+            value_adopt(v->optional.val);
+            gc_track_value(v);
+            break;
+        case VAL_TYPE:
+            mem_adopt(v->type_val.type_name);
+            patdef_adopt(v->type_val.patdef);
+            break;
+        case VAL_BUILTIN_FN: mem_adopt(v->builtin.name); break;
+        default: break;
+    }
+}
+
+/* ------------------------------------------------------------------ Freezing */
+
+typedef struct {
+    Value **items;
+    size_t  len, cap;
+} ValueStack;
+
+static void vs_push(ValueStack *s, Value *v) {
+    if (!v) return;
+    if (s->len == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 64;
+        s->items = realloc(s->items, sizeof(Value *) * s->cap);
+    }
+    s->items[s->len++] = v;
+}
+
+/* The blocks a shared value owns stop counting against its interpreter. */
+static void disown_blocks(Value *v) {
+    mem_disown(v);
+    switch (v->type) {
+        case VAL_STRING: mem_disown(v->str_val); break;
+        case VAL_TUPLE:
+            mem_disown(v->tuple.elems);
+            mem_disown(v->tuple.names);
+            if (v->tuple.names)
+                for (int i = 0; i < v->tuple.count; i++) mem_disown(v->tuple.names[i]);
+            break;
+        case VAL_TYPE:       mem_disown(v->type_val.type_name); break;
+        case VAL_BUILTIN_FN: mem_disown(v->builtin.name); break;
+        default: break;
+    }
+}
+
+static void frozen_add(FrozenSet *s, Value *v) {
+    if (s->count == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 64;
+        MemArena *arena = mem_arena_enter(NULL);
+        Value **items = mem_realloc(s->items, sizeof(Value *) * (size_t)cap);
+        mem_arena_enter(arena);
+        if (!items) return;   /* then v simply lives as long as the process */
+        s->items = items;
+        s->cap = cap;
+    }
+    s->items[s->count++] = v;
+}
+
+int value_freeze(Value *v, const char **why) {
+    if (!v || v->frozen) return 0;
+    /* Mark as we go, the frozen flag doubling as the visited mark, and
+       remember what was marked in case it has to be undone. */
+    ValueStack todo = { 0 }, marked = { 0 };
+    int shareable = 1, in_arena = 0, rc = 0;
+    vs_push(&todo, v);
+    while (todo.len && rc == 0) {
+        Value *x = todo.items[--todo.len];
+        if (x->frozen) {
+            if (!x->shared) shareable = 0;
+            continue;
+        }
+        if (x->shared) {   /* immutable already, and other threads may hold it */
+            if (x->type == VAL_CHANNEL) chan_release(x->chan);
+            continue;
+        }
+        if (x->pinned) {
+            *why = "a running parallel loop shares it";
+            rc = -1;
+            break;
+        }
+        if (x->type == VAL_FUNCTION || x->type == VAL_SCOPE || x->type == VAL_MODULE || x->type == VAL_GENERATOR) {
+            *why = x->type == VAL_FUNCTION ? "it holds a function"
+                 : x->type == VAL_SCOPE    ? "it holds a scope"
+                 : x->type == VAL_MODULE   ? "it holds a module" : "it holds a generator";
+            rc = -1;
+            break;
+        }
+        x->frozen = 1;
+        vs_push(&marked, x);
+        if (mem_in_arena(x)) in_arena = 1;
+        switch (x->type) {
+            case VAL_TUPLE:
+                for (int i = 0; i < x->tuple.count; i++) vs_push(&todo, x->tuple.elems[i]);
+                break;
+            case VAL_PAT_INST:
+                shareable = 0;   /* its methods live in its interpreter's environments */
+                for (int i = 0; i < x->pat_inst.count; i++) vs_push(&todo, x->pat_inst.fields[i]);
+                break;
+            case VAL_TYPE:     if (x->type_val.patdef) shareable = 0; break;
+            case VAL_VARIANT:  vs_push(&todo, x->variant.val);  break;
+            case VAL_OPTIONAL: vs_push(&todo, x->optional.val); break;
+            default: break;
+        }
+    }
+
+    if (rc != 0) {
+        for (size_t i = 0; i < marked.len; i++) marked.items[i]->frozen = 0;
+    } else {
+        /* An arena reclaims its frozen values with everything else, and they
+           are never handed to another thread; the rest are freed with the
+           interpreter, which stays charged for them until then. */
+        Interpreter *interp = interp_current();
+        for (size_t i = 0; i < marked.len; i++) {
+            Value *x = marked.items[i];
+            gc_untrack_value(x);
+            if (mem_in_arena(x)) continue;
+            x->shared = (unsigned)(shareable && !in_arena);
+            if (interp) frozen_add(&interp->frozen, x);
+        }
+    }
+    free(todo.items);
+    free(marked.items);
+    return rc;
+}
+
+/* Frozen graphs that have been sent, kept for as long as the process runs. */
+static pthread_mutex_t sent_lock = PTHREAD_MUTEX_INITIALIZER;
+static Value         **sent_items;
+static size_t          sent_len, sent_cap;
+
+static void keep_sent(Value *v) {
+    pthread_mutex_lock(&sent_lock);
+    if (sent_len == sent_cap) {
+        size_t cap = sent_cap ? sent_cap * 2 : 16;
+        Value **items = realloc(sent_items, sizeof(Value *) * cap);
+        if (items) {
+            sent_items = items;
+            sent_cap = cap;
+        }
+    }
+    if (sent_len < sent_cap) sent_items[sent_len++] = v;
+    pthread_mutex_unlock(&sent_lock);
+}
+
+/* A shared frozen graph is still charged to the interpreter that froze it
+   until it is first sent: from then on other interpreters may hold it, so it
+   is charged to none and lives as long as the process. */
+static void send_frozen(Value *v) {
+    if (!mem_owner(v)) return;
+    keep_sent(v);
+    ValueStack todo = { 0 };
+    vs_push(&todo, v);
+    while (todo.len) {
+        Value *x = todo.items[--todo.len];
+        if (!x->frozen || !mem_owner(x)) continue;
+        disown_blocks(x);
+        switch (x->type) {
+            case VAL_TUPLE:
+                for (int i = 0; i < x->tuple.count; i++) vs_push(&todo, x->tuple.elems[i]);
+                break;
+            case VAL_VARIANT:  vs_push(&todo, x->variant.val);  break;
+            case VAL_OPTIONAL: vs_push(&todo, x->optional.val); break;
+            default: break;
+        }
+    }
+    free(todo.items);
+}
+
+/* Frozen values point at each other without holding references, so every
+   one goes at once: first the pointers to frozen values are dropped, then
+   each value releases the rest (shared strings and channels) and is freed. */
+void value_free_frozen(FrozenSet *s) {
+    for (int i = 0; i < s->count; i++) {
+        Value *x = s->items[i];
+        if (!mem_owner(x)) {   /* sent: other interpreters may hold it */
+            s->items[i] = NULL;
+            continue;
+        }
+        switch (x->type) {
+            case VAL_TUPLE:
+                for (int j = 0; j < x->tuple.count; j++)
+                    if (x->tuple.elems[j] && x->tuple.elems[j]->frozen) x->tuple.elems[j] = NULL;
+                break;
+            case VAL_PAT_INST:
+                for (int j = 0; j < x->pat_inst.count; j++)
+                    if (x->pat_inst.fields[j] && x->pat_inst.fields[j]->frozen) x->pat_inst.fields[j] = NULL;
+                break;
+            case VAL_VARIANT:
+                if (x->variant.val && x->variant.val->frozen) x->variant.val = NULL;
+                break;
+            case VAL_OPTIONAL:
+                if (x->optional.val && x->optional.val->frozen) x->optional.val = NULL;
+                break;
+            default: break;
+        }
+    }
+    for (int i = 0; i < s->count; i++) {
+        Value *x = s->items[i];
+        if (!x) continue;
+        x->frozen = x->shared = 0;
+        value_clear(x);
+        mem_free(x);
+    }
+    mem_free(s->items);
+    s->items = NULL;
+    s->count = s->cap = 0;
+}
+
 /* ------------------------------------------------------------------ Utilities */
 
 char *value_to_string(Value *v) {
-    if (!v) return strdup("null");
-    char buf[64];
+    if (!v) return mem_strdup("null");
+    char buf[80];   /* room for a range of three 20-character integers */
     switch (v->type) {
-        case VAL_NULL:  return strdup("null");
-        case VAL_INT:   snprintf(buf, sizeof(buf), "%lld", v->int_val); return strdup(buf);
-        case VAL_FLOAT: snprintf(buf, sizeof(buf), "%g",   v->float_val); return strdup(buf);
-        case VAL_BOOL:  return strdup(v->bool_val ? "true" : "false");
-        case VAL_STRING: return strdup(v->str_val);
+        case VAL_NULL:  return mem_strdup("null");
+        case VAL_INT:   snprintf(buf, sizeof(buf), "%lld", v->int_val); return mem_strdup(buf);
+        case VAL_FLOAT: snprintf(buf, sizeof(buf), "%g",   v->float_val); return mem_strdup(buf);
+        case VAL_BOOL:  return mem_strdup(v->bool_val ? "true" : "false");
+        case VAL_STRING: return mem_strdup(v->str_val);
         case VAL_FUNCTION:
             snprintf(buf, sizeof(buf), "<fn:%s>", v->fn.name ? v->fn.name : "?");
-            return strdup(buf);
+            return mem_strdup(buf);
         case VAL_BUILTIN_FN:
             snprintf(buf, sizeof(buf), "<builtin:%s>", v->builtin.name);
-            return strdup(buf);
+            return mem_strdup(buf);
+        case VAL_CHANNEL:
+            return mem_strdup("<channel>");
+        case VAL_GENERATOR:
+            return mem_strdup("<generator>");
+        case VAL_RANGE: {
+            /* the stop one step past the last element, unless that overflows */
+            long long stop;
+            if (__builtin_mul_overflow(v->range.len, v->range.step, &stop)
+                    || __builtin_add_overflow(v->range.start, stop, &stop))
+                stop = v->range.step > 0 ? LLONG_MAX : LLONG_MIN;
+            snprintf(buf, sizeof(buf), "range(%lld, %lld, %lld)", v->range.start, stop, v->range.step);
+            return mem_strdup(buf);
+        }
         case VAL_TUPLE: {
             /* build "(a, b, ...)" */
             size_t cap = 64, len = 0;
-            char *s = malloc(cap);
+            char *s = mem_alloc(cap);
             s[len++] = '(';
             for (int i = 0; i < v->tuple.count; i++) {
-                if (i > 0) { if (len + 2 >= cap) { cap *= 2; s = realloc(s, cap); } s[len++] = ','; s[len++] = ' '; }
+                if (i > 0) { if (len + 2 >= cap) { cap *= 2; s = mem_realloc(s, cap); } s[len++] = ','; s[len++] = ' '; }
                 if (v->tuple.names && v->tuple.names[i]) {
                     size_t nl = strlen(v->tuple.names[i]);
-                    while (len + nl + 2 >= cap) { cap *= 2; s = realloc(s, cap); }
+                    while (len + nl + 2 >= cap) { cap *= 2; s = mem_realloc(s, cap); }
                     memcpy(s + len, v->tuple.names[i], nl); len += nl;
                     s[len++] = ':'; s[len++] = ' ';
                 }
                 char *es = value_to_string(v->tuple.elems[i]);
                 size_t el = strlen(es);
-                while (len + el + 2 >= cap) { cap *= 2; s = realloc(s, cap); }
+                while (len + el + 2 >= cap) { cap *= 2; s = mem_realloc(s, cap); }
                 memcpy(s + len, es, el); len += el;
-                free(es);
+                mem_free(es);
             }
-            if (len + 2 >= cap) { cap += 4; s = realloc(s, cap); }
+            if (len + 2 >= cap) { cap += 4; s = mem_realloc(s, cap); }
             s[len++] = ')'; s[len] = '\0';
             return s;
         }
         case VAL_PAT_INST: {
             size_t cap2 = 256, len2 = 0;
-            char *s = malloc(cap2);
+            char *s = mem_alloc(cap2);
             const char *pname = v->pat_inst.def ? v->pat_inst.def->name : "?";
             size_t pnl = strlen(pname);
-            while (len2 + pnl + 2 >= cap2) { cap2 *= 2; s = realloc(s, cap2); }
+            while (len2 + pnl + 2 >= cap2) { cap2 *= 2; s = mem_realloc(s, cap2); }
             memcpy(s + len2, pname, pnl); len2 += pnl;
             s[len2++] = '{';
             for (int i = 0; i < v->pat_inst.count; i++) {
                 if (i > 0) {
-                    while (len2 + 2 >= cap2) { cap2 *= 2; s = realloc(s, cap2); }
+                    while (len2 + 2 >= cap2) { cap2 *= 2; s = mem_realloc(s, cap2); }
                     s[len2++] = ','; s[len2++] = ' ';
                 }
                 if (v->pat_inst.def && i < v->pat_inst.def->field_count && v->pat_inst.def->field_names[i]) {
                     const char *fn2 = v->pat_inst.def->field_names[i];
                     size_t fnl = strlen(fn2);
-                    while (len2 + fnl + 2 >= cap2) { cap2 *= 2; s = realloc(s, cap2); }
+                    while (len2 + fnl + 2 >= cap2) { cap2 *= 2; s = mem_realloc(s, cap2); }
                     memcpy(s + len2, fn2, fnl); len2 += fnl;
                     s[len2++] = ':'; s[len2++] = ' ';
                 }
                 char *fstr = value_to_string(v->pat_inst.fields[i]);
                 size_t fsl = strlen(fstr);
-                while (len2 + fsl + 2 >= cap2) { cap2 *= 2; s = realloc(s, cap2); }
+                while (len2 + fsl + 2 >= cap2) { cap2 *= 2; s = mem_realloc(s, cap2); }
                 memcpy(s + len2, fstr, fsl); len2 += fsl;
-                free(fstr);
+                mem_free(fstr);
             }
-            while (len2 + 2 >= cap2) { cap2 *= 2; s = realloc(s, cap2); }
+            while (len2 + 2 >= cap2) { cap2 *= 2; s = mem_realloc(s, cap2); }
             s[len2++] = '}'; s[len2] = '\0';
             return s;
         }
         case VAL_TYPE:
             snprintf(buf, sizeof(buf), "<type:%s>", v->type_val.type_name ? v->type_val.type_name : "?");
-            return strdup(buf);
+            return mem_strdup(buf);
         case VAL_MODULE:
             snprintf(buf, sizeof(buf), "<module:%s>", v->module.name ? v->module.name : "?");
-            return strdup(buf);
+            return mem_strdup(buf);
         case VAL_OPTIONAL:
             if (v->optional.present) {
                 char *inner = value_to_string(v->optional.val);
                 size_t n = strlen(inner) + 16;
-                char *r = malloc(n);
+                char *r = mem_alloc(n);
                 snprintf(r, n, "some(%s)", inner);
-                free(inner);
+                mem_free(inner);
                 return r;
             }
-            return strdup("none");
+            return mem_strdup("none");
         case VAL_SCOPE:
-            return strdup("<scope>");
+            return mem_strdup("<scope>");
         case VAL_VARIANT: {
             char *inner = value_to_string(v->variant.val);
             size_t n = strlen(inner) + 32;
-            char *r = malloc(n);
+            char *r = mem_alloc(n);
             snprintf(r, n, "variant(%d, %s)", v->variant.tag, inner);
-            free(inner);
+            mem_free(inner);
             return r;
         }
-        default: return strdup("<unknown>");
+        default: return mem_strdup("<unknown>");
     }
 }
 
@@ -347,5 +872,10 @@ int value_equals(Value *a, Value *b) {
     if (a->type == VAL_FLOAT && b->type == VAL_INT) return a->float_val == (double)b->int_val;
     if (a->type == VAL_BOOL && b->type == VAL_BOOL) return a->bool_val == b->bool_val;
     if (a->type == VAL_STRING && b->type == VAL_STRING) return strcmp(a->str_val, b->str_val) == 0;
+    if (a->type == VAL_CHANNEL && b->type == VAL_CHANNEL) return a->chan == b->chan;
+    if (a->type == VAL_RANGE && b->type == VAL_RANGE)   /* the same elements */
+        return a->range.len == b->range.len
+            && (a->range.len == 0 || (a->range.start == b->range.start
+                                      && (a->range.len == 1 || a->range.step == b->range.step)));
     return 0;
 }
@@ -8,6 +8,9 @@ typedef struct AstNode AstNode;
 typedef struct Env Env;
 typedef struct Value Value;
 typedef struct PatDef PatDef;
+typedef struct EnvEntry EnvEntry;
+typedef struct Channel Channel;
+typedef struct Generator Generator;
 
 typedef enum {
     VAL_NULL,
@@ -24,6 +27,9 @@ typedef enum {
     VAL_OPTIONAL,
     VAL_TYPE,
     VAL_MODULE,
+    VAL_CHANNEL,
+    VAL_GENERATOR,
+    VAL_RANGE,
 } ValueType;
 
 /* Pattern definition (like a struct descriptor) */
@@ -32,14 +38,40 @@ struct PatDef {
     char **field_names;
     int    field_count;
     Env   *methods;   /* method environment */
+    const AstNode *decl;   /* the pat declaration, shared by every copy */
     int    ref_count;
+    int    pinned;    /* see Value.pinned */
 };
 
 typedef Value *(*BuiltinFn)(Value **args, int argc);
+typedef Value *(*NativeFn)(void *ctx, Value **args, int argc);   /* host function, see lang.h */
+
+/* Declared signature of a builtin, checked by the interpreter before each call
+   so the function itself need not: at least min_args and (unless max_args is
+   negative) at most max_args arguments, the first type_count of which must
+   have a type whose bit (1 << VAL_*) is set in arg_types[i]. */
+#define NATIVE_MAX_TYPED_ARGS 8
+typedef struct {
+    int      min_args, max_args;
+    int      type_count;
+    unsigned arg_types[NATIVE_MAX_TYPED_ARGS];
+} NativeSig;
+
+/* Variables a closure captured from enclosing non-global scopes.  The entries
+   are shared with the scope that declared them, so assignments on either side
+   stay visible to the other. */
+typedef struct {
+    int       count;
+    EnvEntry *entries[];
+} CaptureSet;
 
 struct Value {
     ValueType type;
     int ref_count;
+    int gc_slot : 29;     /* cycle collector slot (0 = untracked), see gc.h */
+    unsigned pinned : 1;  /* shared by a running parallel loop: refcounting suspended */
+    unsigned shared : 1;  /* immutable and shared between interpreters: atomic refcount */
+    unsigned frozen : 1;  /* see value_freeze: never written, never refcounted */
     union {
         long long  int_val;
         double     float_val;
@@ -55,9 +87,10 @@ struct Value {
             Value *val;
         } variant;
         struct {
-            AstNode *ast;
-            Env     *closure;
-            char    *name;
+            AstNode    *ast;
+            Env        *closure;    /* holds a ref */
+            char       *name;
+            CaptureSet *captures;   /* NULL when closure is the full defining env */
         } fn;
         struct {
             Value   **fields;
@@ -70,6 +103,9 @@ struct Value {
         } scope;
         struct {
             BuiltinFn fn;
+            NativeFn  native;   /* set instead of fn for host functions */
+            void     *ctx;      /* passed to native */
+            const NativeSig *sig;   /* NULL = unchecked; must outlive the value */
             char     *name;
         } builtin;
         struct {
@@ -85,6 +121,12 @@ struct Value {
             char *name;
             PatDef *patdef;  /* non-null if this module is a pattern constructor */
         } module;
+        Channel *chan;       /* see actor.h */
+        Generator *gen;      /* see generator.h */
+        struct {
+            long long start, step;
+            long long len;   /* elements start + k * step for 0 <= k < len */
+        } range;
     };
 };
 
@@ -96,18 +138,53 @@ Value *value_new_string(const char *s);
 Value *value_new_bool(int v);
 Value *value_new_tuple(int count);
 Value *value_new_function(AstNode *ast, Env *closure, const char *name);
-Value *value_new_builtin(BuiltinFn fn, const char *name);
+Value *value_new_builtin(BuiltinFn fn, const NativeSig *sig, const char *name);
+Value *value_new_native(NativeFn fn, void *ctx, const NativeSig *sig, const char *name);
 Value *value_new_pat_inst(PatDef *def, int field_count);
 Value *value_new_scope(Env *env, AstNode *ast);
 Value *value_new_module(const char *name, Env *env);
 Value *value_new_type(const char *type_name);
 Value *value_new_pat_type(const char *type_name, PatDef *def);
 Value *value_type_of(Value *v);   /* reflect: returns a VAL_TYPE describing v's type */
+const char *value_kind_name(ValueType t);   /* "int", "string", ... for messages */
 Value *value_new_optional(Value *val, int present);
+Value *value_new_channel(Channel *ch);   /* takes ownership of ch; the value is shared */
+Value *value_new_generator(Generator *g);   /* takes ownership of g */
+Value *value_new_range(long long start, long long step, long long len);
+
+/* start + k * step, computed so that k * step may overflow on the way: the
+   elements of a range all fit in a long long even where that product does
+   not. */
+static inline long long range_elem(long long start, long long step, long long k) {
+    return (long long)((unsigned long long)start + (unsigned long long)k * (unsigned long long)step);
+}
 
 void   value_incref(Value *v);
 void   value_decref(Value *v);
+void   value_clear(Value *v);     /* drop everything v owns; v itself stays allocated */
 Value *value_copy(Value *v);
+Value *value_deep_copy(Value *v); /* independent of v's allocation; see mem_arena_* */
+void   value_share(Value *v);     /* make v (immutable, not in an arena) shared, see actor.h */
+Value *value_send_copy(Value *v); /* value_deep_copy for another interpreter, see actor.h */
+void   value_adopt(Value *v);     /* charge a value_send_copy to the current interpreter */
+
+/* Frozen values an interpreter made, freed with it. */
+typedef struct {
+    Value **items;
+    int     count, cap;
+} FrozenSet;
+
+/* Deep-freeze v: it and everything it holds become immutable and are no longer
+   reference counted, so reading them costs no writes.  They stay charged to
+   the running interpreter and are freed by value_free_frozen when it goes (or
+   with their arena).  A frozen graph without pattern instances is also
+   shared: parallel loops read it as it is and other interpreters receive it
+   by reference; once sent, it is charged to none and lives as long as the
+   process.  Returns 0, or -1 with *why set when something in it cannot be
+   frozen: a function, scope, module or generator, or a value a running
+   parallel loop shares. */
+int    value_freeze(Value *v, const char **why);
+void   value_free_frozen(FrozenSet *s);   /* all but what was sent; empties s */
 
 /* Conversion / printing */
 char  *value_to_string(Value *v);
@@ -0,0 +1,186 @@
+/* Embedding API: compile once, run and call many times, host functions. */
+
+#include "lang.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+    } while (0)
+
+static LangValue *host_scale(void *ctx, LangValue **args, int argc) {
+    long long factor = *(long long *)ctx;
+    return lang_int(argc > 0 ? lang_to_int(args[0]) * factor : 0);
+}
+
+/* (text, times): declared (string, int), so no checks needed here */
+static LangValue *host_repeat(void *ctx, LangValue **args, int argc) {
+    (void)ctx;
+    long long n = lang_to_int(args[1]);
+    if (n < 0) { lang_raise("repeat: negative count %lld", n); return NULL; }
+    const char *t = lang_to_string(args[0]);
+    size_t len = strlen(t);
+    char buf[256] = "";
+    for (long long i = 0; i < n && (size_t)(i + 1) * len < sizeof(buf); i++) strcat(buf, t);
+    (void)argc;
+    return lang_string(buf);
+}
+
+/* calls back into the interpreter that called it */
+static LangValue *host_callback(void *ctx, LangValue **args, int argc) {
+    (void)args; (void)argc;
+    lang_call(ctx, "noop", NULL, 0, NULL);
+    return lang_null();
+}
+
+static const char *rules =
+    "fn score(x:i32, label:string):(result:i32, tag:string) {\n"
+    "    result = host_scale(x) + 1\n"
+    "    tag = label\n"
+    "}\n"
+    "score(2, \"warm\").result\n";
+
+int main(void) {
+    char err[256];
+    CHECK(lang_compile("var = 1", "bad.lang", err, sizeof(err)) == NULL);
+    CHECK(strncmp(err, "bad.lang: ", 10) == 0);
+
+    LangProgram *P = lang_compile(rules, "rules.lang", err, sizeof(err));
+    CHECK(P != NULL);
+    if (!P) return 1;
+
+    long long factor = 10;
+    LangInterp *L = lang_new();
+    CHECK(lang_register(L, "host_scale", host_scale, &factor) == 0);
+
+    /* the same program, run many times in a reused environment */
+    LangValue *r = NULL;
+    for (int i = 0; i < 1000; i++) {
+        CHECK(lang_run(L, P, &r) == 0);
+        if (i < 999) lang_release(r);
+    }
+    CHECK(lang_type(r) == LANG_INT && lang_to_int(r) == 21);
+    lang_release(r);
+
+    /* calling a script function by name with host values */
+    LangValue *args[2] = { lang_int(4), lang_string("hot") };
+    CHECK(lang_call(L, "score", args, 2, &r) == 0);
+    CHECK(lang_to_int(lang_field(r, "result")) == 41);
+    CHECK(strcmp(lang_to_string(lang_field(r, "tag")), "hot") == 0);
+    CHECK(lang_tuple_count(r) == 2);
+    lang_release(r);
+
+    CHECK(lang_call(L, "missing", NULL, 0, NULL) != 0);
+    CHECK(strstr(lang_error(L), "missing") != NULL);
+
+    /* a fresh environment forgets script definitions but keeps host functions */
+    lang_reset(L);
+    CHECK(lang_call(L, "score", args, 2, NULL) != 0);
+    CHECK(lang_run(L, P, &r) == 0 && lang_to_int(r) == 21);
+    lang_release(r);
+    factor = 2;
+    CHECK(lang_call(L, "score", args, 2, &r) == 0 && lang_to_int(lang_field(r, "result")) == 9);
+    lang_release(r);
+
+    /* runtime errors and limits */
+    LangProgram *loop = lang_compile("var i = 0\nwhile (i >= 0) { i = i + 1 }\n", "loop.lang", err, sizeof(err));
+    lang_set_limits(L, 0, 10000, 0);
+    CHECK(lang_run(L, loop, NULL) != 0);
+    CHECK(strstr(lang_error(L), "step limit exceeded") != NULL);
+    lang_set_limits(L, 0, 0, 0);
+    CHECK(lang_call(L, "score", args, 2, NULL) == 0);
+
+    /* a call back in counts against the run it is part of, not afresh */
+    LangProgram *nested = lang_compile(
+        "fn noop() {}\n"
+        "var i = 0\n"
+        "while (i < 100000) { cb(); i = i + 1 }\n", "nested.lang", err, sizeof(err));
+    CHECK(lang_register(L, "cb", host_callback, L) == 0);
+    lang_set_limits(L, 0, 5000, 0);
+    CHECK(lang_run(L, nested, NULL) != 0);
+    CHECK(strstr(lang_error(L), "step limit exceeded") != NULL);
+    lang_set_limits(L, 0, 0, 0);
+    lang_program_free(nested);
+
+    /* declared signatures and host-raised errors */
+    static const LangType repeat_types[] = { LANG_STRING, LANG_INT };
+    LangNativeDef repeat = { "repeat", host_repeat, NULL, 2, 2, repeat_types, 2 };
+    CHECK(lang_define(L, &repeat) == 0);
+    LangNativeDef bad = repeat;
+    bad.max_args = 1;
+    CHECK(lang_define(L, &bad) != 0 && strstr(lang_error(L), "arity") != NULL);
+    bad = repeat;
+    bad.type_count = LANG_MAX_TYPED_ARGS + 1;
+    CHECK(lang_define(L, &bad) != 0);
+
+    LangProgram *calls[4];
+    calls[0] = lang_compile("repeat(\"ab\", 3)", "ok.lang", err, sizeof(err));
+    calls[1] = lang_compile("repeat(\"ab\")", "arity.lang", err, sizeof(err));
+    calls[2] = lang_compile("repeat(3, \"ab\")", "types.lang", err, sizeof(err));
+    calls[3] = lang_compile("var x = 1\nrepeat(\"ab\", -1)", "raise.lang", err, sizeof(err));
+    CHECK(lang_run(L, calls[0], &r) == 0 && strcmp(lang_to_string(r), "ababab") == 0);
+    lang_release(r);
+    CHECK(lang_run(L, calls[1], NULL) != 0);
+    CHECK(strstr(lang_error(L), "repeat: expected 2 arguments, got 1") != NULL);
+    CHECK(lang_run(L, calls[2], NULL) != 0);
+    CHECK(strstr(lang_error(L), "repeat: argument 1 must be string, got int") != NULL);
+    CHECK(lang_run(L, calls[3], NULL) != 0);
+    CHECK(strstr(lang_error(L), "line 2") != NULL && strstr(lang_error(L), "negative count -1") != NULL);
+    for (int i = 0; i < 4; i++) lang_program_free(calls[i]);
+
+    LangProgram *assert_fail = lang_compile("assert(1 == 2, \"math\")", "assert.lang", err, sizeof(err));
+    CHECK(lang_run(L, assert_fail, NULL) != 0 && strstr(lang_error(L), "Assertion failed: math") != NULL);
+    lang_program_free(assert_fail);
+    /* a long message is cut short, not the location in front of it */
+    char long_assert[400];
+    snprintf(long_assert, sizeof(long_assert), "assert(1 == 2, \"%0300d\")", 7);
+    assert_fail = lang_compile(long_assert, "assert.lang", err, sizeof(err));
+    CHECK(lang_run(L, assert_fail, NULL) != 0);
+    CHECK(strncmp(lang_error(L), "Runtime error at line 1 col 7: Assertion failed: 000", 52) == 0);
+    lang_program_free(assert_fail);
+    CHECK(lang_call(L, "score", args, 2, NULL) == 0);
+
+    /* several interpreters share one program */
+    LangInterp *L2 = lang_new();
+    lang_register(L2, "host_scale", host_scale, &factor);
+    CHECK(lang_run(L2, P, &r) == 0 && lang_to_int(r) == 5);
+    lang_release(r);
+
+    /* requests run in an arena reset after each one: the result and what the
+       run assigns to globals are copied out, and nothing else is kept */
+    LangProgram *setup = lang_compile("var hits = 0\nvar last = \"\"\n", "setup.lang", err, sizeof(err));
+    LangProgram *req = lang_compile(
+        "var s = \"\"\n"
+        "for (i : 100) { s = concat(s, \"x\") }\n"
+        "hits = hits + 1\n"
+        "last = s\n"
+        "(hits = hits, size = len(last), current = mem_stats().current)\n",
+        "request.lang", err, sizeof(err));
+    CHECK(lang_run(L2, setup, NULL) == 0);
+    long long current[2] = { 0, 0 };
+    for (int i = 0; i < 2; i++) {
+        CHECK(lang_run_scoped(L2, req, &r) == 0);
+        CHECK(lang_to_int(lang_field(r, "hits")) == i + 1);
+        CHECK(lang_to_int(lang_field(r, "size")) == 100);
+        current[i] = lang_to_int(lang_field(r, "current"));
+        lang_release(r);
+    }
+    CHECK(current[0] > 0 && current[1] == current[0]);
+    LangProgram *leftover = lang_compile("assert(hits == 2 && len(last) == 100)\ns", "leftover.lang", err, sizeof(err));
+    CHECK(lang_run_scoped(L2, leftover, NULL) != 0 && strstr(lang_error(L2), "undefined variable 's'") != NULL);
+    lang_program_free(leftover);
+    lang_program_free(req);
+    lang_program_free(setup);
+
+    lang_release(args[0]);
+    lang_release(args[1]);
+    lang_free(L2);
+    lang_free(L);
+    lang_program_free(loop);
+    lang_program_free(P);
+
+    if (failures) fprintf(stderr, "%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
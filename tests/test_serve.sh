@@ -0,0 +1,122 @@
+#!/bin/sh
+# Pre-forking server: prelude definitions, script and call requests, captured
+# output, errors, workers replaced after --max-requests, parallel loops in
+# forked workers, globals kept across requests run in arenas (--arena), and
+# modules parsed again once edited.
+#   sh tests/test_serve.sh INTERPRETER LANGCLIENT TESTS_DIR
+
+interp=$1
+client=$2
+dir=$3
+sock=${TMPDIR:-/tmp}/lang-serve-$$.sock
+log=${TMPDIR:-/tmp}/lang-serve-$$.log
+
+"$interp" --serve="$sock" --workers=2 --max-requests=3 "$dir/serve_prelude.txt" >"$log" 2>&1 &
+server=$!
+trap 'kill $server 2>/dev/null; rm -f "$log"' EXIT
+
+n=0
+while [ ! -S "$sock" ]; do
+    n=$((n + 1))
+    if [ $n -gt 100 ]; then echo "server did not start"; cat "$log"; exit 1; fi
+    sleep 0.05
+done
+
+fail() { echo "FAIL: $1"; echo "  got: $2"; exit 1; }
+expect() {   # expect DESCRIPTION EXPECTED ACTUAL
+    [ "$2" = "$3" ] || fail "$1" "$3"
+}
+
+expect "call with arguments" "(result: 5)" "$("$client" "$sock" call add 2 3)"
+expect "call with a string" "(text: hello, world)" "$("$client" "$sock" call greet '"world"')"
+out=$(printf 'print("from a script")\nadd(40, 2).result\n' | "$client" "$sock" run)
+expect "script output and result" "from a script
+42" "$out"
+
+# a request's own definitions stay out of the next request's way
+"$client" "$sock" run <<'LANG' >/dev/null
+var greeting = "shadowed"
+LANG
+expect "request scope" "(text: hello, again)" "$("$client" "$sock" call greet '"again"')"
+
+err=$("$client" "$sock" call missing 2>&1 >/dev/null)
+expect "unknown function" "no function named 'missing'" "$err"
+err=$(printf 'assert(1 == 2, "nope")\n' | "$client" "$sock" run 2>&1 >/dev/null)
+case $err in *"Assertion failed: nope"*) ;; *) fail "runtime error" "$err" ;; esac
+err=$(printf 'var = 1\n' | "$client" "$sock" run 2>&1)
+[ $? -eq 1 ] || fail "syntax error status" "$err"
+
+# more requests than 2 workers x 3 each: workers are replaced as they retire
+i=0
+while [ $i -lt 12 ]; do
+    expect "request $i after recycling" "(result: $i)" "$("$client" "$sock" call add $i 0)"
+    i=$((i + 1))
+done
+
+kill $server
+wait $server
+[ ! -e "$sock" ] || fail "socket removed on shutdown" "$sock"
+grep -q "prelude loaded" "$log" || fail "prelude ran in the server" "$(cat "$log")"
+grep -q "server stopped" "$log" || fail "clean shutdown" "$(cat "$log")"
+
+# workers forked after the prelude used the thread pool run parallel loops
+"$interp" --threads=4 --arena --mem-limit=2M --serve="$sock" --workers=1 "$dir/serve_parallel_prelude.txt" >"$log" 2>&1 &
+server=$!
+n=0
+while [ ! -S "$sock" ]; do
+    n=$((n + 1))
+    if [ $n -gt 100 ]; then echo "parallel server did not start"; cat "$log"; exit 1; fi
+    sleep 0.05
+done
+expect "parallel loop in a forked worker" "499500" "$("$client" "$sock" call total 1000)"
+expect "prelude's parallel loop" "499500" "$(printf 'warm\n' | "$client" "$sock" run)"
+
+# requests run in an arena reset after each one: globals they assign are
+# copied out, and the worker's memory stays flat from request to request
+visit='var s = ""
+for (i : 50) { s = concat(s, "x") }
+visits = visits + 1
+last = s
+mem_stats().current'
+first=$(printf '%s\n' "$visit" | "$client" "$sock" run)
+second=$(printf '%s\n' "$visit" | "$client" "$sock" run)
+expect "memory after a second request" "$first" "$second"
+expect "globals assigned by earlier requests" "(2, 50)" \
+    "$(printf '(visits, len(last))\n' | "$client" "$sock" run)"
+# a request that churns through more than the limit in total passes all the same
+churn='var s = ""
+for (i : 100000) { s = concat("item ", string(i)) }
+s'
+expect "churn under --arena" "item 99999" "$(printf '%s\n' "$churn" | "$client" "$sock" run)"
+# a generator left suspended is discarded with the arena, its stack unmapped
+park='var g = count(10)
+for (v : g) { break }
+for (v : count(3)) { }
+mem_stats().current'
+first=$(printf '%s\n' "$park" | "$client" "$sock" run)
+second=$(printf '%s\n' "$park" | "$client" "$sock" run)
+expect "memory after a suspended generator" "$first" "$second"
+kill $server
+wait $server
+
+# a module edited after a worker parsed it is parsed again on its next import
+mods=${TMPDIR:-/tmp}/lang-serve-mods-$$
+mkdir -p "$mods"
+trap 'kill $server 2>/dev/null; rm -f "$log"; rm -rf "$mods"' EXIT
+printf 'print("modules ready")\n' >"$mods/prelude.lang"
+printf 'assert(1 == 2, "not yet")\n' >"$mods/flaky.lang"
+"$interp" --serve="$sock" --workers=1 "$mods/prelude.lang" >"$log" 2>&1 &
+server=$!
+n=0
+while [ ! -S "$sock" ]; do
+    n=$((n + 1))
+    if [ $n -gt 100 ]; then echo "module server did not start"; cat "$log"; exit 1; fi
+    sleep 0.05
+done
+err=$(printf 'import flaky\n' | "$client" "$sock" run 2>&1 >/dev/null)
+case $err in *"not yet"*) ;; *) fail "broken module" "$err" ;; esac
+printf 'var answer = 42\n' >"$mods/flaky.lang"
+expect "module fixed on disk" "42" "$(printf 'import flaky\nflaky.answer\n' | "$client" "$sock" run)"
+kill $server
+wait $server
+echo "serve: all requests answered"
@@ -0,0 +1,116 @@
+/* Interpreters on concurrent threads: one compiled program shared by all, one
+   interpreter per thread, no interference.  Meant to be run under
+   ThreadSanitizer as well (-DLANG_SANITIZE=thread / make SANITIZE=thread). */
+
+#include "lang.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define THREADS 8
+#define ROUNDS  40
+
+static int failures;
+static pthread_mutex_t failures_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            pthread_mutex_lock(&failures_lock); \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+            pthread_mutex_unlock(&failures_lock); \
+        } \
+    } while (0)
+
+/* Scopes stored in their own environment leave a cycle per make_cycle call
+   for the collector, so every interpreter exercises its own heap. */
+static const char *source =
+    "var calls = 0\n"
+    "fn make_cycle(n:i32):(result:i32) {\n"
+    "    var self = { calls = calls + 1 }\n"
+    "    result = n\n"
+    "}\n"
+    "fn work(seed:i32):(result:i32, label:string) {\n"
+    "    var acc = 0\n"
+    "    var k = 0\n"
+    "    while (k < 200) {\n"
+    "        acc = acc + make_cycle(k).result + host_id(seed)\n"
+    "        k = k + 1\n"
+    "    }\n"
+    "    result = acc\n"
+    "    label = concat(\"worker \", string(host_id(0)))\n"
+    "}\n"
+    "fn sweep():(result:i32) { result = gc_collect() }\n";
+
+static LangProgram *program;
+
+static LangValue *host_id(void *ctx, LangValue **args, int argc) {
+    (void)args; (void)argc;
+    return lang_int(*(int *)ctx);
+}
+
+typedef struct {
+    int       id;
+    long long swept[ROUNDS];   /* what each round's collection reclaimed */
+} Worker;
+
+static void *run_worker(void *arg) {
+    Worker *w = arg;
+    static const LangType id_types[] = { LANG_INT };
+    LangNativeDef def = { "host_id", host_id, &w->id, 1, 1, id_types, 1 };
+    LangInterp *L = lang_new();
+    CHECK(lang_define(L, &def) == 0);
+    for (int round = 0; round < ROUNDS; round++) {
+        if (round % 10 == 0) {
+            lang_reset(L);
+            CHECK(lang_run(L, program, NULL) == 0);
+        }
+        LangValue *seed = lang_int(round);
+        LangValue *r = NULL;
+        CHECK(lang_call(L, "work", &seed, 1, &r) == 0);
+        if (r) {
+            char want[32];
+            snprintf(want, sizeof(want), "worker %d", w->id);
+            CHECK(lang_to_int(lang_field(r, "result")) == 19900 + 200LL * w->id);
+            CHECK(lang_to_string(lang_field(r, "label")) &&
+                  strcmp(lang_to_string(lang_field(r, "label")), want) == 0);
+            lang_release(r);
+        }
+        CHECK(lang_call(L, "sweep", NULL, 0, &r) == 0);
+        w->swept[round] = r ? lang_to_int(lang_field(r, "result")) : -1;
+        lang_release(r);
+        lang_release(seed);
+    }
+    lang_free(L);
+    return NULL;
+}
+
+int main(void) {
+    char err[256];
+    program = lang_compile(source, "threads.lang", err, sizeof(err));
+    if (!program) {
+        fprintf(stderr, "%s\n", err);
+        return 1;
+    }
+
+    /* the same work on this thread alone gives the collector's expected counts */
+    Worker solo = { 0, { 0 } };
+    run_worker(&solo);
+
+    pthread_t threads[THREADS];
+    Worker workers[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        workers[i].id = i + 1;
+        CHECK(pthread_create(&threads[i], NULL, run_worker, &workers[i]) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < THREADS; i++)
+        for (int round = 0; round < ROUNDS; round++)
+            CHECK(workers[i].swept[round] == solo.swept[round]);
+    CHECK(solo.swept[0] > 0);
+
+    lang_program_free(program);
+    if (failures) fprintf(stderr, "%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
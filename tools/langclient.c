@@ -0,0 +1,118 @@
+/* Client for the interpreter's --serve mode (protocol in src/serve.h).
+ *
+ *     langclient SOCKET run [FILE]          script from FILE, or stdin
+ *     langclient SOCKET call NAME [ARG...]  each ARG an expression, e.g. 42 or '"text"'
+ *
+ * What the request printed goes to stdout, followed by the result (if not
+ * null); an error goes to stderr and exits with 1.  Exit status 2 means the
+ * server could not be reached. */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef struct {
+    char  *data;
+    size_t len, cap;
+} Buf;
+
+static void buf_add(Buf *b, const void *p, size_t n) {
+    if (b->len + n + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + n + 1) cap *= 2;
+        b->data = realloc(b->data, cap);
+        if (!b->data) { perror("langclient"); exit(2); }
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+}
+
+static void read_stream(int fd, Buf *b) {
+    char chunk[8192];
+    for (;;) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) { perror("langclient: read"); exit(2); }
+        if (n == 0) return;
+        buf_add(b, chunk, (size_t)n);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: langclient SOCKET run [FILE]\n"
+                    "       langclient SOCKET call NAME [ARG...]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) usage();
+    Buf req = { 0 };
+    if (strcmp(argv[2], "run") == 0 && argc <= 4) {
+        int in = 0;
+        if (argc == 4 && strcmp(argv[3], "-") != 0) {
+            FILE *f = fopen(argv[3], "r");
+            if (!f) { perror(argv[3]); return 2; }
+            in = dup(fileno(f));
+            fclose(f);
+        }
+        buf_add(&req, "run\n", 4);
+        read_stream(in, &req);
+    } else if (strcmp(argv[2], "call") == 0 && argc >= 4) {
+        buf_add(&req, "call ", 5);
+        buf_add(&req, argv[3], strlen(argv[3]));
+        buf_add(&req, "\n", 1);
+        for (int i = 4; i < argc; i++) {
+            if (strchr(argv[i], '\n')) { fprintf(stderr, "langclient: argument %d spans lines\n", i - 3); return 2; }
+            buf_add(&req, argv[i], strlen(argv[i]));
+            buf_add(&req, "\n", 1);
+        }
+    } else {
+        usage();
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(argv[1]) >= sizeof(addr.sun_path)) { fprintf(stderr, "langclient: socket path too long\n"); return 2; }
+    strcpy(addr.sun_path, argv[1]);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "langclient: %s: %s\n", argv[1], strerror(errno));
+        return 2;
+    }
+    for (size_t off = 0; off < req.len;) {
+        ssize_t n = write(fd, req.data + off, req.len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { perror("langclient: write"); return 2; }
+        off += (size_t)n;
+    }
+    shutdown(fd, SHUT_WR);
+
+    Buf reply = { 0 };
+    read_stream(fd, &reply);
+    close(fd);
+
+    char status[8];
+    size_t out_len, head_len;
+    int n = 0;
+    if (!reply.data || sscanf(reply.data, "%7s %zu\n%n", status, &out_len, &n) != 2 || !n ||
+        (head_len = (size_t)n) + out_len > reply.len) {
+        fprintf(stderr, "langclient: malformed reply\n");
+        return 2;
+    }
+    fwrite(reply.data + head_len, 1, out_len, stdout);
+    const char *rest = reply.data + head_len + out_len;
+    size_t rest_len = reply.len - head_len - out_len;
+    int ok = strcmp(status, "OK") == 0;
+    fwrite(rest, 1, rest_len, ok ? stdout : stderr);
+    free(req.data);
+    free(reply.data);
+    return ok ? 0 : 1;
+}